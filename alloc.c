@@ -0,0 +1,28 @@
+#include "alloc.h"
+
+#include <stdlib.h>
+
+static _Thread_local const Allocator *current = NULL;
+
+const Allocator *use_allocator(const Allocator *const allocator) {
+    const Allocator *const previous = current;
+    current = allocator;
+    return previous;
+}
+
+void *mem_realloc(void *const ptr, const size_t size) {
+    if (current == NULL) {
+        return realloc(ptr, size);
+    }
+    return current->realloc(current->context, ptr, size);
+}
+
+void mem_free(void *const ptr) {
+    if (current == NULL) {
+        free(ptr);
+        return;
+    }
+    if (ptr != NULL) {
+        current->free(current->context, ptr);
+    }
+}
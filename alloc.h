@@ -0,0 +1,23 @@
+#ifndef ALLOC_H
+#define ALLOC_H
+
+#include "vimline.h"
+
+#include <stddef.h>
+
+typedef VimlineAllocator Allocator;
+
+// Memory is allocated with the allocator set for the calling thread, which
+// the library sets to the editor's own for each call
+// Memory must be freed with the allocator it was allocated with, so
+// completions loaded in the background always use the default one
+
+// Set allocator of calling thread, or NULL for `realloc` and `free`
+// Returns previous allocator
+const Allocator *use_allocator(const Allocator *const allocator);
+
+void *mem_realloc(void *const ptr, const size_t size);
+
+void mem_free(void *const ptr);
+
+#endif
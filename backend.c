@@ -0,0 +1,14 @@
+#include "backend.h"
+
+#include <string.h>
+
+static const Backend *const BACKENDS[] = {&CURSES_BACKEND, &TERM_BACKEND};
+
+const Backend *find_backend(const char *const name) {
+    for (size_t i = 0; i < sizeof(BACKENDS) / sizeof(BACKENDS[0]); ++i) {
+        if (!strcmp(BACKENDS[i]->name, name)) {
+            return BACKENDS[i];
+        }
+    }
+    return NULL;
+}
@@ -0,0 +1,86 @@
+#ifndef BACKEND_H
+#define BACKEND_H
+
+#include <sys/types.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Returned by `read_key` when no key arrived in time
+#define K_NONE (-1)
+
+typedef enum Style {
+    STYLE_NORMAL,
+    STYLE_VISUAL,
+    STYLE_PLACEHOLDER,
+    STYLE_MATCH,
+    STYLE_LABEL,
+    // Syntax highlighting
+    STYLE_NUMBER,
+    STYLE_STRING,
+    STYLE_VARIABLE,
+    STYLE_OPERATOR,
+    STYLE_COMMENT,
+} Style;
+
+// Terminal input and drawing
+// Positions are zero-based screen cells, and drawing may be held until
+// `flush`
+typedef struct Backend {
+    const char *name;
+    // Take over terminal, reading keys from `input_fd`
+    void (*open)(const int input_fd);
+    // Give terminal back as it was
+    void (*close)(void);
+    void (*size)(int *const rows, int *const cols);
+    // Find size again, after terminal was resized
+    void (*resize)(void);
+    // Wait at most `timeout_ms` for a key, or forever if negative
+    // Returns `K_NONE` if no key was read
+    int (*read_key)(const int timeout_ms);
+    void (*clear)(void);
+    void (*box)(
+        const uint32_t x,
+        const uint32_t y,
+        const uint32_t width,
+        const bool left_open,
+        const bool right_open,
+        const bool invalid  // Line does not match pattern
+    );
+    // Write UTF-8 text in one style
+    void (*text)(
+        const uint32_t x,
+        const uint32_t y,
+        const char *const text,
+        const uint32_t len,
+        const Style style
+    );
+    // Move cells of row `y` from column `from` up to `end` by `count`
+    // columns, right if positive, leaving cells from `end` on as they were
+    // Uncovered cells are blank
+    // Returns false, drawing nothing, if terminal cannot insert and delete
+    // characters
+    bool (*shift)(
+        const uint32_t y,
+        const uint32_t from,
+        const uint32_t end,
+        const int count
+    );
+    // Write dim text at start of row, and clear rest of row
+    void (*details)(const int row, const char *const text);
+    void (*cursor)(const uint32_t x, const uint32_t y);
+    // Set cursor shape, with an xterm `DECSCUSR` number
+    void (*cursor_shape)(const int shape);
+    // Returns bytes sent, or -1 if they are not counted
+    ssize_t (*flush)(void);
+} Backend;
+
+// Full ncurses screen
+extern const Backend CURSES_BACKEND;
+// Raw termios and ANSI sequences, without ncurses startup
+extern const Backend TERM_BACKEND;
+
+// Backend with this name, or NULL
+const Backend *find_backend(const char *const name);
+
+#endif
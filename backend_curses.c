@@ -0,0 +1,229 @@
+#include "backend.h"
+
+#include "editor.h"
+
+#include <ncurses.h>
+
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+const int PAIR_BOX = 1;
+const int PAIR_DETAILS = 2;
+const int PAIR_VISUAL = 3;
+const int PAIR_MATCH = 4;
+const int PAIR_INVALID = 5;
+const int PAIR_NUMERAL = 6;
+const int PAIR_STRING = 7;
+const int PAIR_VARIABLE = 8;
+const int PAIR_OPERATOR = 9;
+const int ATTR_BOX = COLOR_PAIR(PAIR_BOX) | A_DIM;
+const int ATTR_DETAILS = COLOR_PAIR(PAIR_DETAILS) | A_DIM;
+const int ATTR_VISUAL = COLOR_PAIR(PAIR_VISUAL);
+const int ATTR_PLACEHOLDER = A_DIM;
+const int ATTR_MATCH = COLOR_PAIR(PAIR_MATCH) | A_BOLD;
+const int ATTR_LABEL = A_BOLD;
+const int ATTR_BOX_INVALID = COLOR_PAIR(PAIR_INVALID);
+const int ATTR_NUMBER = COLOR_PAIR(PAIR_NUMERAL);
+const int ATTR_STRING = COLOR_PAIR(PAIR_STRING);
+const int ATTR_VARIABLE = COLOR_PAIR(PAIR_VARIABLE);
+const int ATTR_OPERATOR = COLOR_PAIR(PAIR_OPERATOR);
+const int ATTR_COMMENT = A_DIM;
+
+static int style_attr(const Style style) {
+    switch (style) {
+        case STYLE_VISUAL:
+            return ATTR_VISUAL;
+        case STYLE_PLACEHOLDER:
+            return ATTR_PLACEHOLDER;
+        case STYLE_MATCH:
+            return ATTR_MATCH;
+        case STYLE_LABEL:
+            return ATTR_LABEL;
+        case STYLE_NUMBER:
+            return ATTR_NUMBER;
+        case STYLE_STRING:
+            return ATTR_STRING;
+        case STYLE_VARIABLE:
+            return ATTR_VARIABLE;
+        case STYLE_OPERATOR:
+            return ATTR_OPERATOR;
+        case STYLE_COMMENT:
+            return ATTR_COMMENT;
+        default:
+            return A_NORMAL;
+    }
+}
+
+static void curses_open(const int input_fd) {
+    if (input_fd != STDIN_FILENO) {
+        FILE *const input = fdopen(input_fd, "r");
+        if (input == NULL) {
+            perror("Failed to open terminal");
+            exit(1);
+        }
+        newterm(NULL, stdout, input);
+    } else {
+        initscr();
+    }
+    noecho();              // Disable echoing
+    cbreak();              // Disable line buffering
+    keypad(stdscr, TRUE);  // Enable raw key input
+    set_escdelay(0);       // Disable Escape key delay
+
+    // Enable bracketed paste
+    define_key("\033[200~", K_PASTE_START);
+    define_key("\033[201~", K_PASTE_END);
+    printf("\033[?2004h");
+    fflush(stdout);
+
+    start_color();         // Enable color
+    use_default_colors();  // Don't change the background color
+
+    init_pair(PAIR_BOX, COLOR_BLUE, -1);
+    init_pair(PAIR_DETAILS, COLOR_WHITE, -1);
+    init_pair(PAIR_VISUAL, -1, COLOR_BLUE);
+    init_pair(PAIR_MATCH, COLOR_YELLOW, -1);
+    init_pair(PAIR_INVALID, COLOR_RED, -1);
+    init_pair(PAIR_NUMERAL, COLOR_MAGENTA, -1);
+    init_pair(PAIR_STRING, COLOR_GREEN, -1);
+    init_pair(PAIR_VARIABLE, COLOR_CYAN, -1);
+    init_pair(PAIR_OPERATOR, COLOR_YELLOW, -1);
+}
+
+static void curses_close(void) {
+    printf("\033[?2004l");  // Disable bracketed paste
+    fflush(stdout);
+    endwin();
+}
+
+static void curses_size(int *const rows, int *const cols) {
+    *rows = getmaxy(stdscr);
+    *cols = getmaxx(stdscr);
+}
+
+static void curses_resize(void) {
+    struct winsize size;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) == 0) {
+        resizeterm(size.ws_row, size.ws_col);
+    }
+}
+
+static int curses_read_key(const int timeout_ms) {
+    timeout(timeout_ms);
+    int key;
+    // Resizes are handled before keys are read
+    do {
+        key = getch();
+    } while (key == KEY_RESIZE);
+    return key != ERR ? key : K_NONE;
+}
+
+static void curses_clear(void) {
+    erase();
+}
+
+static void curses_box(
+    const uint32_t x,
+    const uint32_t y,
+    const uint32_t w,
+    const bool left_open,
+    const bool right_open,
+    const bool invalid
+) {
+    const int attr = invalid ? ATTR_BOX_INVALID : ATTR_BOX;
+    attron(attr);
+
+    // Top
+    move(y, x);
+    addch(ACS_ULCORNER);
+    for (uint32_t i = 0; i < w - 2; ++i) {
+        addch(ACS_HLINE);
+    }
+    addch(ACS_URCORNER);
+
+    // Sides
+    move(y + 1, x);
+    addch(left_open ? ':' : ACS_VLINE);
+    move(y + 1, x + w - 1);
+    addch(right_open ? ':' : ACS_VLINE);
+
+    // Bottom
+    move(y + 2, x);
+    addch(ACS_LLCORNER);
+    for (uint32_t i = 0; i < w - 2; ++i) {
+        addch(ACS_HLINE);
+    }
+    addch(ACS_LRCORNER);
+
+    attroff(attr);
+}
+
+static void curses_text(
+    const uint32_t x,
+    const uint32_t y,
+    const char *const text,
+    const uint32_t len,
+    const Style style
+) {
+    attrset(style_attr(style));
+    mvaddnstr(y, x, text, len);
+    attrset(A_NORMAL);
+}
+
+static bool curses_shift(
+    const uint32_t y,
+    const uint32_t from,
+    const uint32_t end,
+    const int count
+) {
+    (void) y;
+    (void) from;
+    (void) end;
+    (void) count;
+    // ncurses finds inserted and deleted characters itself when refreshing
+    return false;
+}
+
+static void curses_details(const int row, const char *const text) {
+    move(row, 0);
+    attron(ATTR_DETAILS);
+    addstr(text);
+    attroff(ATTR_DETAILS);
+    clrtoeol();
+}
+
+static void curses_cursor(const uint32_t x, const uint32_t y) {
+    move(y, x);
+}
+
+static void curses_cursor_shape(const int shape) {
+    // Not known to ncurses, so sent directly
+    printf("\033[%d q", shape);
+    fflush(stdout);
+}
+
+static ssize_t curses_flush(void) {
+    refresh();
+    // Written by ncurses, so not counted
+    return -1;
+}
+
+const Backend CURSES_BACKEND = {
+    .name = "curses",
+    .open = curses_open,
+    .close = curses_close,
+    .size = curses_size,
+    .resize = curses_resize,
+    .read_key = curses_read_key,
+    .clear = curses_clear,
+    .box = curses_box,
+    .text = curses_text,
+    .shift = curses_shift,
+    .details = curses_details,
+    .cursor = curses_cursor,
+    .cursor_shape = curses_cursor_shape,
+    .flush = curses_flush,
+};
@@ -0,0 +1,373 @@
+#include "backend.h"
+
+#include "editor.h"
+#include "keys.h"
+#include "output.h"
+#include "utf8.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define INPUT_CAPACITY (4096)
+// How long to wait for the rest of a key sequence cut short by a read
+#define SEQUENCE_WAIT_MS (50)
+
+// Enter alternate screen, clear it, and enable bracketed paste
+#define SEQ_OPEN "\033[?1049h\033[H\033[2J\033[?2004h"
+// Reset style, disable bracketed paste, and leave alternate screen
+#define SEQ_CLOSE "\033[0m\033[?2004l\033[?1049l"
+// DEC line drawing characters, for box corners and lines
+#define SEQ_LINES_ON "\033(0"
+#define SEQ_LINES_OFF "\033(B"
+#define LINE_UPPER_LEFT 'l'
+#define LINE_UPPER_RIGHT 'k'
+#define LINE_LOWER_LEFT 'm'
+#define LINE_LOWER_RIGHT 'j'
+#define LINE_HORIZONTAL 'q'
+#define LINE_VERTICAL 'x'
+
+#define SGR_BOX "\033[0;2;34m"
+#define SGR_BOX_INVALID "\033[0;31m"
+#define SGR_DETAILS "\033[0;2;37m"
+#define SGR_NORMAL "\033[0m"
+
+static const char *const STYLE_SGR[] = {
+    [STYLE_NORMAL] = SGR_NORMAL,
+    [STYLE_VISUAL] = "\033[0;44m",
+    [STYLE_PLACEHOLDER] = "\033[0;2m",
+    [STYLE_MATCH] = "\033[0;1;33m",
+    [STYLE_LABEL] = "\033[0;1m",
+    [STYLE_NUMBER] = "\033[0;35m",
+    [STYLE_STRING] = "\033[0;32m",
+    [STYLE_VARIABLE] = "\033[0;36m",
+    [STYLE_OPERATOR] = "\033[0;33m",
+    [STYLE_COMMENT] = "\033[0;2m",
+};
+
+static struct {
+    int input_fd;
+    struct termios saved;
+    int rows;
+    int cols;
+    // Bytes read but not yet decoded
+    char input[INPUT_CAPACITY];
+    size_t input_start;
+    size_t input_len;
+    // Everything drawn since last flush, sent with one write
+    char *output;
+    size_t output_len;
+    size_t output_capacity;
+    // Where drawing left the cursor, if known, so moves can be relative
+    bool at_known;
+    uint32_t at_x;
+    uint32_t at_y;
+    // Whether terminal can insert and delete characters (ICH and DCH)
+    bool edit_chars;
+} term;
+
+static void term_resize(void) {
+    struct winsize size;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) == 0 && size.ws_row > 0
+        && size.ws_col > 0)
+    {
+        term.rows = size.ws_row;
+        term.cols = size.ws_col;
+    } else {
+        term.rows = 24;
+        term.cols = 80;
+    }
+    // Terminal may have moved it
+    term.at_known = false;
+}
+
+static void put(const char *const bytes, const size_t len) {
+    if (term.output_len + len > term.output_capacity) {
+        size_t capacity =
+            term.output_capacity > 0 ? term.output_capacity : 4096;
+        while (term.output_len + len > capacity) {
+            capacity *= 2;
+        }
+        term.output = realloc(term.output, capacity);
+        if (term.output == NULL) {
+            perror("Failed to allocate output");
+            exit(1);
+        }
+        term.output_capacity = capacity;
+    }
+    memcpy(&term.output[term.output_len], bytes, len);
+    term.output_len += len;
+}
+
+static void put_string(const char *const string) {
+    put(string, strlen(string));
+}
+
+static void put_byte(const char byte) {
+    put(&byte, 1);
+}
+
+__attribute__((format(printf, 1, 2)))
+static void put_format(const char *const format, ...) {
+    char bytes[64];
+    va_list args;
+    va_start(args, format);
+    const int len = vsnprintf(bytes, sizeof(bytes), format, args);
+    va_end(args);
+    put(bytes, len);
+}
+
+// Move cursor, relative to where it is if on the same row, as that is
+// shorter
+static void put_move(const uint32_t x, const uint32_t y) {
+    if (term.at_known && y == term.at_y) {
+        if (x > term.at_x) {
+            put_format("\033[%uC", x - term.at_x);
+        } else if (x < term.at_x) {
+            put_format("\033[%uD", term.at_x - x);
+        }
+    } else {
+        put_format("\033[%u;%uH", y + 1, x + 1);
+    }
+    term.at_known = true;
+    term.at_x = x;
+    term.at_y = y;
+}
+
+static ssize_t term_flush(void) {
+    const size_t len = term.output_len;
+    write_all(STDOUT_FILENO, term.output, len);
+    term.output_len = 0;
+    return len;
+}
+
+// Whether terminal named by `TERM` has ICH and DCH, which all but the
+// oldest do
+static bool has_edit_chars(void) {
+    const char *const name = getenv("TERM");
+    return name != NULL && strcmp(name, "dumb") && strcmp(name, "vt52")
+        && strncmp(name, "vt100", 5);
+}
+
+static void term_open(const int input_fd) {
+    term.input_fd = input_fd;
+    if (tcgetattr(input_fd, &term.saved) != 0) {
+        perror("Failed to read terminal settings");
+        exit(1);
+    }
+    // Like ncurses `cbreak` and `noecho`, so <C-c> still interrupts
+    struct termios raw = term.saved;
+    raw.c_lflag &= ~(ICANON | ECHO);
+    raw.c_cc[VMIN] = 1;
+    raw.c_cc[VTIME] = 0;
+    if (tcsetattr(input_fd, TCSANOW, &raw) != 0) {
+        perror("Failed to set terminal settings");
+        exit(1);
+    }
+
+    term_resize();
+    term.edit_chars = has_edit_chars();
+
+    // Sent with first frame
+    put_string(SEQ_OPEN);
+}
+
+static void term_close(void) {
+    put_string(SEQ_CLOSE);
+    term_flush();
+    tcsetattr(term.input_fd, TCSANOW, &term.saved);
+}
+
+static void term_size(int *const rows, int *const cols) {
+    *rows = term.rows;
+    *cols = term.cols;
+}
+
+// Wait for input to read, for at most `timeout_ms` if not negative
+// Returns false on timeout
+static bool wait_input(const int timeout_ms) {
+    struct pollfd input = {.fd = term.input_fd, .events = POLLIN};
+    return poll(&input, 1, timeout_ms) > 0;
+}
+
+// Read more after undecoded input
+static void read_input(void) {
+    memmove(term.input, &term.input[term.input_start], term.input_len);
+    term.input_start = 0;
+    const ssize_t count = read(
+        term.input_fd, &term.input[term.input_len],
+        INPUT_CAPACITY - term.input_len
+    );
+    if (count < 0 && errno == EINTR) {
+        return;
+    }
+    if (count <= 0) {
+        term_close();
+        fprintf(stderr, "Failed to read terminal.\n");
+        exit(1);
+    }
+    term.input_len += count;
+}
+
+static int term_read_key(const int timeout_ms) {
+    if (term.input_len == 0) {
+        if (!wait_input(timeout_ms)) {
+            return K_NONE;
+        }
+        read_input();
+    }
+    while (term.input_len < INPUT_CAPACITY
+        && partial_key(&term.input[term.input_start], term.input_len)
+        && wait_input(SEQUENCE_WAIT_MS))
+    {
+        read_input();
+    }
+    if (term.input_len == 0) {
+        return K_NONE;
+    }
+
+    int key;
+    const size_t len =
+        decode_key(&term.input[term.input_start], term.input_len, &key);
+    term.input_start += len;
+    term.input_len -= len;
+    return key;
+}
+
+static void term_clear(void) {
+    put_string(SGR_NORMAL "\033[2J");
+}
+
+static void put_box_row(
+    const uint32_t x,
+    const uint32_t y,
+    const uint32_t w,
+    const char left,
+    const char right
+) {
+    put_move(x, y);
+    put_byte(left);
+    for (uint32_t i = 0; i < w - 2; ++i) {
+        put_byte(LINE_HORIZONTAL);
+    }
+    put_byte(right);
+}
+
+static void term_box(
+    const uint32_t x,
+    const uint32_t y,
+    const uint32_t w,
+    const bool left_open,
+    const bool right_open,
+    const bool invalid
+) {
+    put_string(invalid ? SGR_BOX_INVALID : SGR_BOX);
+    put_string(SEQ_LINES_ON);
+    put_box_row(x, y, w, LINE_UPPER_LEFT, LINE_UPPER_RIGHT);
+    put_move(x, y + 1);
+    put_byte(left_open ? ':' : LINE_VERTICAL);
+    term.at_x = x + 1;
+    put_move(x + w - 1, y + 1);
+    put_byte(right_open ? ':' : LINE_VERTICAL);
+    put_box_row(x, y + 2, w, LINE_LOWER_LEFT, LINE_LOWER_RIGHT);
+    put_string(SEQ_LINES_OFF SGR_NORMAL);
+    term.at_known = false;
+}
+
+static void term_text(
+    const uint32_t x,
+    const uint32_t y,
+    const char *const text,
+    const uint32_t len,
+    const Style style
+) {
+    put_move(x, y);
+    // Style is always reset after drawing
+    if (style != STYLE_NORMAL) {
+        put_string(STYLE_SGR[style]);
+    }
+    put(text, len);
+    if (style != STYLE_NORMAL) {
+        put_string(SGR_NORMAL);
+    }
+
+    // Cursor is left after text, unless it waits to wrap at the last column
+    uint32_t width = 0;
+    uint32_t index = 0;
+    while (index < len) {
+        uint32_t char_width;
+        index += utf8_decode(&text[index], len - index, &char_width);
+        width += char_width;
+    }
+    term.at_x = x + width;
+    if (term.at_x >= (uint32_t) term.cols) {
+        term.at_known = false;
+    }
+}
+
+// Cursor is not moved
+static bool term_shift(
+    const uint32_t y,
+    const uint32_t from,
+    const uint32_t end,
+    const int count
+) {
+    if (!term.edit_chars) {
+        return false;
+    }
+    // Each insert is paired with a delete, so cells from `end` on are
+    // moved back to where they were
+    if (count > 0) {
+        put_move(end - count, y);
+        put_format("\033[%dP", count);
+        put_move(from, y);
+        put_format("\033[%d@", count);
+    } else {
+        put_move(from, y);
+        put_format("\033[%dP", -count);
+        put_move(end + count, y);
+        put_format("\033[%d@", -count);
+    }
+    return true;
+}
+
+static void term_details(const int row, const char *const text) {
+    put_move(0, row);
+    put_string(SGR_DETAILS);
+    // Stop before last column, so the screen never scrolls
+    put(text, strnlen(text, term.cols > 0 ? term.cols - 1 : 0));
+    put_string(SGR_NORMAL "\033[K");
+    term.at_known = false;
+}
+
+static void term_cursor(const uint32_t x, const uint32_t y) {
+    put_move(x, y);
+}
+
+static void term_cursor_shape(const int shape) {
+    put_format("\033[%d q", shape);
+}
+
+const Backend TERM_BACKEND = {
+    .name = "term",
+    .open = term_open,
+    .close = term_close,
+    .size = term_size,
+    .resize = term_resize,
+    .read_key = term_read_key,
+    .clear = term_clear,
+    .box = term_box,
+    .text = term_text,
+    .shift = term_shift,
+    .details = term_details,
+    .cursor = term_cursor,
+    .cursor_shape = term_cursor_shape,
+    .flush = term_flush,
+};
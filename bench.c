@@ -0,0 +1,380 @@
+// Microbenchmarks for the editing kernels
+// Usage: vimline-bench [--json] [FILTER]
+
+#include "buffer.h"
+#include "editor.h"
+#include "highlight.h"
+#include "regex.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define MIN_BENCH_NS (100 * 1000 * 1000)
+
+static const uint32_t SIZES[] = {100, 10 * 1000, 1000 * 1000};
+
+typedef struct Mix {
+    const char *name;
+    const char *alphabet;
+} Mix;
+
+static const Mix MIXES[] = {
+    {"words", "abcdefghijklmnopqrstuvwxyz      "},
+    {"punct", "abc123.,;:()[]{}-_=+ "},
+    {"utf8", "abc \xc3\xa9\xc3\xbc \xe4\xb8\xad\xe6\x96\x87 "},
+    {"spaces", "ab                              "},
+};
+
+typedef struct Result {
+    uint64_t ops;
+    uint64_t bytes;  // Bytes of input touched, for throughput
+} Result;
+
+typedef Result (*BenchFn)(State *const state);
+
+static bool json = false;
+static volatile uint64_t sink;
+// Counts lines benched, so benches reset what they keep for the last line
+static uint32_t run = 0;
+
+static uint64_t now_ns(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (uint64_t) time.tv_sec * 1000 * 1000 * 1000 + time.tv_nsec;
+}
+
+static char *generate_line(const Mix *const mix, const uint32_t size) {
+    char *const line = malloc(size);
+    if (line == NULL) {
+        perror("Failed to allocate line");
+        exit(1);
+    }
+    const char *const alphabet = mix->alphabet;
+    const uint32_t alphabet_len = strlen(alphabet);
+    // Fixed seed, so runs are comparable
+    uint32_t seed = 0x9e3779b9;
+    uint32_t i = 0;
+    while (i < size) {
+        seed = seed * 1664525 + 1013904223;
+        // Copy whole UTF-8 characters, padding with spaces at the end
+        uint32_t start = (seed >> 16) % alphabet_len;
+        while (start > 0 && utf8_continuation(alphabet[start])) {
+            --start;
+        }
+        const uint32_t len = utf8_length(alphabet[start]);
+        if (i + len > size) {
+            line[i++] = ' ';
+            continue;
+        }
+        memcpy(&line[i], &alphabet[start], len);
+        i += len;
+    }
+    return line;
+}
+
+static Result bench_word_start(State *const state) {
+    Result result = {0, 0};
+    state->snap.cursor = 0;
+    const uint32_t len = buffer_len(&state->snap.input);
+    while (state->snap.cursor + 1 < len) {
+        state->snap.cursor = find_word_start(&state->snap, false);
+        ++result.ops;
+    }
+    result.bytes = len;
+    return result;
+}
+
+static Result bench_word_end(State *const state) {
+    Result result = {0, 0};
+    state->snap.cursor = 0;
+    const uint32_t len = buffer_len(&state->snap.input);
+    while (state->snap.cursor + 1 < len) {
+        state->snap.cursor = find_word_end(&state->snap, false);
+        ++result.ops;
+    }
+    result.bytes = len;
+    return result;
+}
+
+static Result bench_word_back(State *const state) {
+    Result result = {0, 0};
+    const uint32_t len = buffer_len(&state->snap.input);
+    state->snap.cursor = subsat(len, 1);
+    while (state->snap.cursor > 0) {
+        state->snap.cursor = find_word_back(&state->snap, false);
+        ++result.ops;
+    }
+    result.bytes = len;
+    return result;
+}
+
+static Result bench_visual_select(State *const state) {
+    const uint32_t len = buffer_len(&state->snap.input);
+    state->visual_start = len / 4;
+    state->snap.cursor = len / 2;
+    uint64_t selected = 0;
+    for (uint32_t i = 0; i < len; ++i) {
+        selected += in_visual_select(state, i);
+    }
+    sink = selected;
+    return (Result) {len, len};
+}
+
+// Type a word in the middle of the line, then backspace over it
+static Result bench_insert_delete(State *const state) {
+    static const char WORD[] = "inserted";
+    const uint32_t count = sizeof(WORD) - 1;
+    state->snap.cursor = buffer_len(&state->snap.input) / 2;
+    handle_key(state, 'i');
+    for (uint32_t i = 0; i < count; ++i) {
+        handle_key(state, WORD[i]);
+    }
+    for (uint32_t i = 0; i < count; ++i) {
+        handle_key(state, K_BACKSPACE);
+    }
+    handle_key(state, K_ESCAPE);
+    return (Result) {count * 2, count * 2};
+}
+
+// Look up display columns across the line, then map them back
+static Result bench_columns(State *const state) {
+    const Buffer *const input = &state->snap.input;
+    const uint32_t len = buffer_len(input);
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < 64; ++i) {
+        const uint32_t index = char_start(input, (uint64_t) len * i / 64);
+        uint32_t start;
+        total += column_index(input, index_column(input, index), &start);
+    }
+    sink = total;
+    return (Result) {128, 0};
+}
+
+// Uppercase the whole line, then lowercase it again
+static Result bench_change_case(State *const state) {
+    const uint32_t len = buffer_len(&state->snap.input);
+    state->snap.cursor = 0;
+    handle_key(state, 'v');
+    handle_key(state, '$');
+    handle_key(state, 'U');
+    handle_key(state, 'v');
+    handle_key(state, '$');
+    handle_key(state, 'u');
+    return (Result) {2, len * 2};
+}
+
+// Delete a character, then undo and redo it
+static Result bench_history(State *const state) {
+    state->snap.cursor = buffer_len(&state->snap.input) / 2;
+    splice_input(state, state->snap.cursor, 1, NULL, 0);
+    push_history(state);
+    undo_history(state);
+    redo_history(state);
+    undo_history(state);
+    return (Result) {4, 4};
+}
+
+static void type_keys(State *const state, const char *const keys) {
+    for (const char *key = keys; *key != '\0'; ++key) {
+        handle_key(state, *key);
+    }
+}
+
+// Delete with counts, then undo each as one change
+static Result bench_count_delete(State *const state) {
+    const uint32_t len = buffer_len(&state->snap.input);
+    state->snap.cursor = char_start(&state->snap.input, len / 4);
+    type_keys(state, "500x");
+    const uint32_t deleted = len - buffer_len(&state->snap.input);
+    type_keys(state, "ud20w");
+    const uint32_t deleted_words = len - buffer_len(&state->snap.input);
+    type_keys(state, "u");
+    return (Result) {4, deleted + deleted_words};
+}
+
+// Replay a 500 key macro which inserts and deletes a character
+static Result bench_macro(State *const state) {
+    state->snap.cursor = buffer_len(&state->snap.input) / 2;
+    if (state->registers['a' - 'a'].len == 0) {
+        handle_key(state, 'q');
+        handle_key(state, 'a');
+        for (uint32_t i = 0; i < 125; ++i) {
+            handle_key(state, 'i');
+            handle_key(state, 'm');
+            handle_key(state, K_ESCAPE);
+            handle_key(state, 'x');
+        }
+        handle_key(state, 'q');
+    }
+    handle_key(state, '@');
+    handle_key(state, 'a');
+    return (Result) {500, 0};
+}
+
+// Pattern matching any line, so the whole DFA runs
+static Validator *line_validator(State *const state) {
+    static Regex regex;
+    static Validator validator;
+    static uint32_t validated = 0;
+    if (regex.transitions == NULL) {
+        const char *error;
+        if (!regex_compile(&regex, "(\\w+|\\s|\\W)*", &error)) {
+            fprintf(stderr, "Invalid pattern: %s.\n", error);
+            exit(1);
+        }
+    }
+    if (validated != run) {
+        validator_free(&validator);
+        validator_init(&validator, &regex);
+        validator_matches(&validator, &state->snap.input);
+        validated = run;
+    }
+    return &validator;
+}
+
+static bool validate(Validator *const validator, Buffer *const input) {
+    validator_edited(validator, buffer_take_edited(input));
+    return validator_matches(validator, input);
+}
+
+// Type a character at the end of the line and validate, then delete it
+static Result bench_validate_end(State *const state) {
+    Validator *const validator = line_validator(state);
+    const uint32_t len = buffer_len(&state->snap.input);
+    splice_input(state, len, 0, "x", 1);
+    sink = validate(validator, &state->snap.input);
+    splice_input(state, len, 1, NULL, 0);
+    sink = validate(validator, &state->snap.input);
+    return (Result) {2, 2};
+}
+
+// Type a character in the middle of the line, so the rest is validated again
+static Result bench_validate_middle(State *const state) {
+    Validator *const validator = line_validator(state);
+    const uint32_t middle = buffer_len(&state->snap.input) / 2;
+    splice_input(state, middle, 0, "x", 1);
+    sink = validate(validator, &state->snap.input);
+    splice_input(state, middle, 1, NULL, 0);
+    sink = validate(validator, &state->snap.input);
+    return (Result) {2, (buffer_len(&state->snap.input) - middle) * 2};
+}
+
+// Type a character at the end of the line, and find tokens to show there
+static Result bench_highlight_end(State *const state) {
+    static Highlighter highlighter;
+    static uint32_t highlighted = 0;
+    Buffer *const input = &state->snap.input;
+    if (highlighted != run) {
+        highlight_free(&highlighter);
+        highlighted = run;
+    }
+    const uint32_t len = buffer_len(input);
+    const uint32_t start = len > 70 ? len - 70 : 0;
+    splice_input(state, len, 0, "x", 1);
+    highlight_edited(&highlighter, buffer_take_edited(input));
+    sink = highlight_range(&highlighter, input, start, len + 1);
+    splice_input(state, len, 1, NULL, 0);
+    highlight_edited(&highlighter, buffer_take_edited(input));
+    sink = highlight_range(&highlighter, input, start, len);
+    return (Result) {2, 2};
+}
+
+typedef struct Bench {
+    const char *name;
+    BenchFn fn;
+} Bench;
+
+static const Bench BENCHES[] = {
+    {"word_start", bench_word_start},
+    {"word_end", bench_word_end},
+    {"word_back", bench_word_back},
+    {"visual_select", bench_visual_select},
+    {"columns", bench_columns},
+    {"insert_delete", bench_insert_delete},
+    {"change_case", bench_change_case},
+    {"history", bench_history},
+    {"macro", bench_macro},
+    {"count_delete", bench_count_delete},
+    {"validate_end", bench_validate_end},
+    {"validate_middle", bench_validate_middle},
+    {"highlight_end", bench_highlight_end},
+};
+
+static void run_bench(
+    const Bench *const bench,
+    const Mix *const mix,
+    const uint32_t size
+) {
+    char *const line = generate_line(mix, size);
+    State state;
+    if (!editor_init(&state, line, size, 70)) {
+        perror("Failed to allocate line");
+        exit(1);
+    }
+    ++run;
+
+    // Warm up, then repeat until enough time has passed
+    bench->fn(&state);
+    Result total = {0, 0};
+    const uint64_t start = now_ns();
+    uint64_t elapsed = 0;
+    while (elapsed < MIN_BENCH_NS) {
+        const Result result = bench->fn(&state);
+        total.ops += result.ops;
+        total.bytes += result.bytes;
+        elapsed = now_ns() - start;
+    }
+
+    const double ns_per_op = (double) elapsed / total.ops;
+    const double mb_per_s = total.bytes / (elapsed / 1e9) / 1e6;
+    if (json) {
+        printf(
+            "{\"bench\":\"%s\",\"mix\":\"%s\",\"size\":%u,\"ops\":%llu,"
+            "\"ns_per_op\":%.3f,\"mb_per_s\":%.3f}\n",
+            bench->name,
+            mix->name,
+            size,
+            (unsigned long long) total.ops,
+            ns_per_op,
+            mb_per_s
+        );
+    } else {
+        printf(
+            "%-14s %-7s %8u %12.2f ns/op %10.2f MB/s\n",
+            bench->name,
+            mix->name,
+            size,
+            ns_per_op,
+            mb_per_s
+        );
+    }
+    fflush(stdout);
+
+    editor_free(&state);
+    free(line);
+}
+
+int main(const int argc, const char *const *const argv) {
+    const char *filter = NULL;
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--json")) {
+            json = true;
+        } else {
+            filter = argv[i];
+        }
+    }
+
+    for (size_t b = 0; b < sizeof(BENCHES) / sizeof(Bench); ++b) {
+        if (filter != NULL && strstr(BENCHES[b].name, filter) == NULL) {
+            continue;
+        }
+        for (size_t m = 0; m < sizeof(MIXES) / sizeof(Mix); ++m) {
+            for (size_t s = 0; s < sizeof(SIZES) / sizeof(uint32_t); ++s) {
+                run_bench(&BENCHES[b], &MIXES[m], SIZES[s]);
+            }
+        }
+    }
+    return 0;
+}
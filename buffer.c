@@ -0,0 +1,406 @@
+#include "buffer.h"
+
+#include "alloc.h"
+#include "charclass.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BUFFER_MIN_CAPACITY (64)
+#define PIECES_MIN_CAPACITY (8)
+
+static void *allocate(void *const ptr, const size_t size) {
+    void *const result = mem_realloc(ptr, size);
+    if (result == NULL) {
+        perror("Failed to allocate input buffer");
+        exit(1);
+    }
+    return result;
+}
+
+static const char *piece_text(
+    const Buffer *const buffer,
+    const Piece *const piece
+) {
+    if (piece->added) {
+        return &buffer->added[piece->start];
+    }
+    return &buffer->original[piece->start];
+}
+
+// Whether text can be appended to piece without creating a new one
+static bool piece_extends(
+    const Buffer *const buffer,
+    const Piece *const piece
+) {
+    return piece->added && piece->start + piece->len == buffer->added_len;
+}
+
+static void set_cache(
+    const Buffer *const buffer,
+    const uint32_t piece,
+    const uint32_t start
+) {
+    Buffer *const mutable = (Buffer *) buffer;
+    mutable->cache_piece = piece;
+    mutable->cache_start = start;
+}
+
+// Find piece containing `index`, walking from last piece looked up
+// `index` must be less than buffer length
+static uint32_t locate(
+    const Buffer *const buffer,
+    const uint32_t index,
+    uint32_t *const start
+) {
+    uint32_t piece = buffer->cache_piece;
+    uint32_t piece_start = buffer->cache_start;
+    while (index < piece_start) {
+        --piece;
+        piece_start -= buffer->pieces[piece].len;
+    }
+    while (index >= piece_start + buffer->pieces[piece].len) {
+        piece_start += buffer->pieces[piece].len;
+        ++piece;
+    }
+    set_cache(buffer, piece, piece_start);
+    *start = piece_start;
+    return piece;
+}
+
+// Make room for `count` pieces at `at`
+static void open_pieces(
+    Buffer *const buffer,
+    const uint32_t at,
+    const uint32_t count
+) {
+    if (buffer->piece_count + count > buffer->piece_capacity) {
+        uint32_t capacity = buffer->piece_capacity > 0
+            ? buffer->piece_capacity
+            : PIECES_MIN_CAPACITY;
+        while (capacity < buffer->piece_count + count) {
+            capacity *= 2;
+        }
+        buffer->pieces = allocate(buffer->pieces, capacity * sizeof(Piece));
+        buffer->piece_capacity = capacity;
+    }
+    memmove(
+        &buffer->pieces[at + count],
+        &buffer->pieces[at],
+        (buffer->piece_count - at) * sizeof(Piece)
+    );
+    buffer->piece_count += count;
+}
+
+static void close_pieces(
+    Buffer *const buffer,
+    const uint32_t at,
+    const uint32_t count
+) {
+    memmove(
+        &buffer->pieces[at],
+        &buffer->pieces[at + count],
+        (buffer->piece_count - at - count) * sizeof(Piece)
+    );
+    buffer->piece_count -= count;
+}
+
+static Piece append_added(
+    Buffer *const buffer,
+    const char *const text,
+    const uint32_t len
+) {
+    if (buffer->added_len + len > buffer->added_capacity) {
+        uint32_t capacity = buffer->added_capacity > 0
+            ? buffer->added_capacity
+            : BUFFER_MIN_CAPACITY;
+        while (capacity < buffer->added_len + len) {
+            capacity *= 2;
+        }
+        buffer->added = allocate(buffer->added, capacity);
+        buffer->added_capacity = capacity;
+    }
+    memcpy(&buffer->added[buffer->added_len], text, len);
+    const Piece piece = {
+        .added = true,
+        .start = buffer->added_len,
+        .len = len,
+    };
+    buffer->added_len += len;
+    return piece;
+}
+
+bool buffer_init(
+    Buffer *const buffer,
+    const char *const original,
+    const uint32_t original_len
+) {
+    buffer->original = original;
+    buffer->original_len = original_len;
+    buffer->added = NULL;
+    buffer->added_len = 0;
+    buffer->added_capacity = 0;
+    buffer->pieces = NULL;
+    buffer->piece_count = 0;
+    buffer->piece_capacity = 0;
+    buffer->len = 0;
+    buffer->cache_piece = 0;
+    buffer->cache_start = 0;
+    buffer->edited = 0;
+    columns_init(&buffer->columns);
+
+    if (original_len > 0) {
+        buffer->pieces = mem_realloc(NULL, PIECES_MIN_CAPACITY * sizeof(Piece));
+        if (buffer->pieces == NULL) {
+            return false;
+        }
+        buffer->piece_capacity = PIECES_MIN_CAPACITY;
+        open_pieces(buffer, 0, 1);
+        buffer->pieces[0] = (Piece) {
+            .added = false,
+            .start = 0,
+            .len = original_len,
+        };
+        buffer->len = original_len;
+    }
+    return true;
+}
+
+void buffer_free(Buffer *const buffer) {
+    mem_free(buffer->added);
+    mem_free(buffer->pieces);
+    columns_free(&buffer->columns);
+    buffer_init(buffer, NULL, 0);
+}
+
+uint32_t buffer_len(const Buffer *const buffer) {
+    return buffer->len;
+}
+
+char buffer_get(const Buffer *const buffer, const uint32_t index) {
+    uint32_t start;
+    const uint32_t piece = locate(buffer, index, &start);
+    return piece_text(buffer, &buffer->pieces[piece])[index - start];
+}
+
+const char *buffer_span(
+    const Buffer *const buffer,
+    const uint32_t index,
+    uint32_t *const len
+) {
+    uint32_t start;
+    const uint32_t piece = locate(buffer, index, &start);
+    *len = buffer->pieces[piece].len - (index - start);
+    return &piece_text(buffer, &buffer->pieces[piece])[index - start];
+}
+
+const char *buffer_span_before(
+    const Buffer *const buffer,
+    const uint32_t end,
+    uint32_t *const len
+) {
+    uint32_t start;
+    const uint32_t piece = locate(buffer, end - 1, &start);
+    *len = end - start;
+    return piece_text(buffer, &buffer->pieces[piece]);
+}
+
+uint32_t buffer_find_class(
+    const Buffer *const buffer,
+    uint32_t from,
+    const uint32_t to,
+    const uint8_t mask
+) {
+    while (from < to) {
+        uint32_t len;
+        const char *const span = buffer_span(buffer, from, &len);
+        if (len > to - from) {
+            len = to - from;
+        }
+        const size_t index = find_class(span, len, mask);
+        if (index < len) {
+            return from + index;
+        }
+        from += len;
+    }
+    return to;
+}
+
+uint32_t buffer_find_class_back(
+    const Buffer *const buffer,
+    const uint32_t from,
+    const uint32_t to,
+    const uint8_t mask
+) {
+    uint32_t end = to;
+    while (end > from) {
+        uint32_t len;
+        const char *span = buffer_span_before(buffer, end, &len);
+        if (len > end - from) {
+            span += len - (end - from);
+            len = end - from;
+        }
+        const size_t index = find_class_back(span, len, mask);
+        if (index < len) {
+            return end - len + index;
+        }
+        end -= len;
+    }
+    return to;
+}
+
+// `len` must not be 0
+static void insert_pieces(
+    Buffer *const buffer,
+    const uint32_t index,
+    const char *const text,
+    const uint32_t len
+) {
+    // Find piece which text should follow
+    uint32_t at = buffer->piece_count;
+    uint32_t start = buffer->len;
+    if (index < buffer->len) {
+        at = locate(buffer, index, &start);
+        // Split piece
+        if (index > start) {
+            const Piece piece = buffer->pieces[at];
+            const uint32_t split = index - start;
+            open_pieces(buffer, at + 1, 1);
+            buffer->pieces[at].len = split;
+            buffer->pieces[at + 1] = (Piece) {
+                .added = piece.added,
+                .start = piece.start + split,
+                .len = piece.len - split,
+            };
+            ++at;
+            start = index;
+        }
+    }
+
+    // Typing appends to the same piece
+    if (at > 0 && piece_extends(buffer, &buffer->pieces[at - 1])) {
+        Piece *const previous = &buffer->pieces[at - 1];
+        append_added(buffer, text, len);
+        previous->len += len;
+        buffer->len += len;
+        set_cache(buffer, at - 1, start - (previous->len - len));
+        return;
+    }
+
+    const Piece piece = append_added(buffer, text, len);
+    open_pieces(buffer, at, 1);
+    buffer->pieces[at] = piece;
+    buffer->len += len;
+    set_cache(buffer, at, start);
+}
+
+// `len` must be in bounds, and not 0
+static void delete_pieces(
+    Buffer *const buffer,
+    const uint32_t index,
+    uint32_t len
+) {
+    buffer->len -= len;
+
+    uint32_t start;
+    uint32_t at = locate(buffer, index, &start);
+    const uint32_t split = index - start;
+
+    if (split > 0) {
+        Piece *const piece = &buffer->pieces[at];
+        // Delete from middle of piece
+        if (split + len < piece->len) {
+            const Piece tail = {
+                .added = piece->added,
+                .start = piece->start + split + len,
+                .len = piece->len - split - len,
+            };
+            piece->len = split;
+            open_pieces(buffer, at + 1, 1);
+            buffer->pieces[at + 1] = tail;
+            return;
+        }
+        // Delete end of piece
+        len -= piece->len - split;
+        piece->len = split;
+        ++at;
+    } else if (at > 0) {
+        // Piece at `at` may be removed, so cache the previous one
+        set_cache(buffer, at - 1, start - buffer->pieces[at - 1].len);
+    } else {
+        set_cache(buffer, 0, 0);
+    }
+
+    // Delete whole pieces
+    uint32_t end = at;
+    while (end < buffer->piece_count && len >= buffer->pieces[end].len) {
+        len -= buffer->pieces[end].len;
+        ++end;
+    }
+    close_pieces(buffer, at, end - at);
+
+    // Delete start of piece
+    if (len > 0) {
+        buffer->pieces[at].start += len;
+        buffer->pieces[at].len -= len;
+    }
+}
+
+void buffer_insert(
+    Buffer *const buffer,
+    const uint32_t index,
+    const char *const text,
+    const uint32_t len
+) {
+    if (len == 0) {
+        return;
+    }
+    insert_pieces(buffer, index, text, len);
+    if (index < buffer->edited) {
+        buffer->edited = index;
+    }
+    columns_edit(&buffer->columns, buffer, index, 0, len);
+}
+
+void buffer_delete(Buffer *const buffer, const uint32_t index, uint32_t len) {
+    if (index >= buffer->len) {
+        return;
+    }
+    if (len > buffer->len - index) {
+        len = buffer->len - index;
+    }
+    if (len == 0) {
+        return;
+    }
+    delete_pieces(buffer, index, len);
+    if (index < buffer->edited) {
+        buffer->edited = index;
+    }
+    columns_edit(&buffer->columns, buffer, index, len, 0);
+}
+
+uint32_t buffer_take_edited(Buffer *const buffer) {
+    const uint32_t edited =
+        buffer->edited < buffer->len ? buffer->edited : buffer->len;
+    buffer->edited = buffer->len;
+    return edited;
+}
+
+void buffer_copy(
+    const Buffer *const buffer,
+    const uint32_t index,
+    const uint32_t len,
+    char *const dest
+) {
+    uint32_t copied = 0;
+    while (copied < len) {
+        uint32_t span_len;
+        const char *const span = buffer_span(buffer, index + copied, &span_len);
+        if (span_len > len - copied) {
+            span_len = len - copied;
+        }
+        memcpy(&dest[copied], span, span_len);
+        copied += span_len;
+    }
+}
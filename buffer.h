@@ -0,0 +1,107 @@
+#ifndef BUFFER_H
+#define BUFFER_H
+
+#include "columns.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Span of text in either the original or the added text
+typedef struct Piece {
+    bool added;
+    uint32_t start;
+    uint32_t len;
+} Piece;
+
+// Piece table holding a single line of text
+// Original text is never copied or modified, so it may be mmapped
+// Inserted text is appended to `added`, which is never modified otherwise
+// Not null-terminated
+typedef struct Buffer {
+    const char *original;
+    uint32_t original_len;
+    char *added;
+    uint32_t added_len;
+    uint32_t added_capacity;
+    Piece *pieces;
+    uint32_t piece_count;
+    uint32_t piece_capacity;
+    uint32_t len;
+    // Last piece looked up, so sequential access is O(1)
+    // Updated by const accessors
+    uint32_t cache_piece;
+    uint32_t cache_start;
+    // Lowest index edited since `buffer_take_edited`
+    uint32_t edited;
+    Columns columns;
+} Buffer;
+
+// `original` must outlive buffer
+// Returns false if out of memory, leaving an empty buffer which must still be
+// freed
+bool buffer_init(
+    Buffer *const buffer,
+    const char *const original,
+    const uint32_t original_len
+);
+
+void buffer_free(Buffer *const buffer);
+
+uint32_t buffer_len(const Buffer *const buffer);
+
+char buffer_get(const Buffer *const buffer, const uint32_t index);
+
+// Get contiguous text starting at `index`, and set `len` to its length
+// Returned text is valid until buffer is next modified
+const char *buffer_span(
+    const Buffer *const buffer,
+    const uint32_t index,
+    uint32_t *const len
+);
+
+// Get contiguous text ending at `end`, and set `len` to its length
+// Returned text is valid until buffer is next modified
+const char *buffer_span_before(
+    const Buffer *const buffer,
+    const uint32_t end,
+    uint32_t *const len
+);
+
+// Index of first byte in `[from, to)` whose class is in `mask`, or `to`
+uint32_t buffer_find_class(
+    const Buffer *const buffer,
+    uint32_t from,
+    const uint32_t to,
+    const uint8_t mask
+);
+
+// Index of last byte in `[from, to)` whose class is in `mask`, or `to`
+uint32_t buffer_find_class_back(
+    const Buffer *const buffer,
+    const uint32_t from,
+    const uint32_t to,
+    const uint8_t mask
+);
+
+void buffer_insert(
+    Buffer *const buffer,
+    const uint32_t index,
+    const char *const text,
+    const uint32_t len
+);
+
+void buffer_delete(Buffer *const buffer, const uint32_t index, uint32_t len);
+
+// Lowest index edited since last call, or buffer length if none
+// Bytes before it are unchanged
+uint32_t buffer_take_edited(Buffer *const buffer);
+
+// Copy `len` bytes starting at `index` into `dest` (not null-terminated)
+void buffer_copy(
+    const Buffer *const buffer,
+    const uint32_t index,
+    const uint32_t len,
+    char *const dest
+);
+
+#endif
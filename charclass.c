@@ -0,0 +1,316 @@
+#include "charclass.h"
+
+#if defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__))
+    #define CHARCLASS_X86
+    #include <immintrin.h>
+#endif
+
+#define CLASS_OF(ch)                                     \
+    ((ch) == ' ' || ((ch) >= '\t' && (ch) <= '\r')       \
+         ? CLASS_SPACE                                   \
+         : ((ch) >= '0' && (ch) <= '9')                  \
+                 || ((ch) >= 'A' && (ch) <= 'Z')         \
+                 || ((ch) >= 'a' && (ch) <= 'z')         \
+                 || (ch) >= 0x80                         \
+             ? CLASS_WORD                                \
+             : CLASS_PUNCT)
+#define CLASS_OF_4(ch) \
+    CLASS_OF(ch), CLASS_OF((ch) + 1), CLASS_OF((ch) + 2), CLASS_OF((ch) + 3)
+#define CLASS_OF_16(ch)                                         \
+    CLASS_OF_4(ch), CLASS_OF_4((ch) + 4), CLASS_OF_4((ch) + 8), \
+        CLASS_OF_4((ch) + 12)
+#define CLASS_OF_64(ch)                                              \
+    CLASS_OF_16(ch), CLASS_OF_16((ch) + 16), CLASS_OF_16((ch) + 32), \
+        CLASS_OF_16((ch) + 48)
+
+const uint8_t CHAR_CLASSES[256] = {
+    CLASS_OF_64(0),
+    CLASS_OF_64(64),
+    CLASS_OF_64(128),
+    CLASS_OF_64(192),
+};
+
+size_t find_class_scalar(
+    const char *const text,
+    const size_t len,
+    const uint8_t mask
+) {
+    for (size_t i = 0; i < len; ++i) {
+        if (char_class(text[i]) & mask) {
+            return i;
+        }
+    }
+    return len;
+}
+
+size_t find_class_back_scalar(
+    const char *const text,
+    const size_t len,
+    const uint8_t mask
+) {
+    for (size_t i = len; i > 0; --i) {
+        if (char_class(text[i - 1]) & mask) {
+            return i - 1;
+        }
+    }
+    return len;
+}
+
+void convert_case_scalar(char *const text, const size_t len, const bool upper) {
+    const char first = upper ? 'a' : 'A';
+    for (size_t i = 0; i < len; ++i) {
+        if (text[i] >= first && text[i] <= first + 25) {
+            text[i] ^= 0x20;
+        }
+    }
+}
+
+#ifdef CHARCLASS_X86
+
+// Set bytes whose class is in `mask`
+// Bytes are compared as signed, so bytes >= 0x80 are negative
+static inline __m128i class_mask_sse2(const __m128i v, const uint8_t mask) {
+    const __m128i space = _mm_or_si128(
+        _mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+        _mm_and_si128(
+            _mm_cmpgt_epi8(v, _mm_set1_epi8('\t' - 1)),
+            _mm_cmpgt_epi8(_mm_set1_epi8('\r' + 1), v)
+        )
+    );
+    const __m128i folded = _mm_or_si128(v, _mm_set1_epi8(0x20));
+    const __m128i word = _mm_or_si128(
+        _mm_or_si128(
+            _mm_cmpgt_epi8(_mm_setzero_si128(), v),
+            _mm_and_si128(
+                _mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)),
+                _mm_cmpgt_epi8(_mm_set1_epi8('9' + 1), v)
+            )
+        ),
+        _mm_and_si128(
+            _mm_cmpgt_epi8(folded, _mm_set1_epi8('a' - 1)),
+            _mm_cmpgt_epi8(_mm_set1_epi8('z' + 1), folded)
+        )
+    );
+    __m128i result = _mm_setzero_si128();
+    if (mask & CLASS_SPACE) {
+        result = _mm_or_si128(result, space);
+    }
+    if (mask & CLASS_WORD) {
+        result = _mm_or_si128(result, word);
+    }
+    if (mask & CLASS_PUNCT) {
+        result = _mm_or_si128(
+            result,
+            _mm_andnot_si128(_mm_or_si128(space, word), _mm_set1_epi8(-1))
+        );
+    }
+    return result;
+}
+
+__attribute__((target("avx2"))) static inline __m256i class_mask_avx2(
+    const __m256i v,
+    const uint8_t mask
+) {
+    const __m256i space = _mm256_or_si256(
+        _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),
+        _mm256_and_si256(
+            _mm256_cmpgt_epi8(v, _mm256_set1_epi8('\t' - 1)),
+            _mm256_cmpgt_epi8(_mm256_set1_epi8('\r' + 1), v)
+        )
+    );
+    const __m256i folded = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+    const __m256i word = _mm256_or_si256(
+        _mm256_or_si256(
+            _mm256_cmpgt_epi8(_mm256_setzero_si256(), v),
+            _mm256_and_si256(
+                _mm256_cmpgt_epi8(v, _mm256_set1_epi8('0' - 1)),
+                _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), v)
+            )
+        ),
+        _mm256_and_si256(
+            _mm256_cmpgt_epi8(folded, _mm256_set1_epi8('a' - 1)),
+            _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), folded)
+        )
+    );
+    __m256i result = _mm256_setzero_si256();
+    if (mask & CLASS_SPACE) {
+        result = _mm256_or_si256(result, space);
+    }
+    if (mask & CLASS_WORD) {
+        result = _mm256_or_si256(result, word);
+    }
+    if (mask & CLASS_PUNCT) {
+        result = _mm256_or_si256(
+            result,
+            _mm256_andnot_si256(
+                _mm256_or_si256(space, word), _mm256_set1_epi8(-1)
+            )
+        );
+    }
+    return result;
+}
+
+static size_t find_class_sse2(
+    const char *const text,
+    const size_t len,
+    const uint8_t mask
+) {
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        const __m128i v = _mm_loadu_si128((const __m128i *) &text[i]);
+        const uint32_t bits = _mm_movemask_epi8(class_mask_sse2(v, mask));
+        if (bits != 0) {
+            return i + __builtin_ctz(bits);
+        }
+    }
+    return i + find_class_scalar(&text[i], len - i, mask);
+}
+
+static size_t find_class_back_sse2(
+    const char *const text,
+    const size_t len,
+    const uint8_t mask
+) {
+    size_t end = len;
+    for (; end >= 16; end -= 16) {
+        const __m128i v = _mm_loadu_si128((const __m128i *) &text[end - 16]);
+        const uint32_t bits = _mm_movemask_epi8(class_mask_sse2(v, mask));
+        if (bits != 0) {
+            return end - 16 + (31 - __builtin_clz(bits));
+        }
+    }
+    const size_t i = find_class_back_scalar(text, end, mask);
+    return i < end ? i : len;
+}
+
+__attribute__((target("avx2"))) static size_t find_class_avx2(
+    const char *const text,
+    const size_t len,
+    const uint8_t mask
+) {
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        const __m256i v = _mm256_loadu_si256((const __m256i *) &text[i]);
+        const uint32_t bits = _mm256_movemask_epi8(class_mask_avx2(v, mask));
+        if (bits != 0) {
+            return i + __builtin_ctz(bits);
+        }
+    }
+    return i + find_class_sse2(&text[i], len - i, mask);
+}
+
+__attribute__((target("avx2"))) static size_t find_class_back_avx2(
+    const char *const text,
+    const size_t len,
+    const uint8_t mask
+) {
+    size_t end = len;
+    for (; end >= 32; end -= 32) {
+        const __m256i v =
+            _mm256_loadu_si256((const __m256i *) &text[end - 32]);
+        const uint32_t bits = _mm256_movemask_epi8(class_mask_avx2(v, mask));
+        if (bits != 0) {
+            return end - 32 + (31 - __builtin_clz(bits));
+        }
+    }
+    const size_t i = find_class_back_sse2(text, end, mask);
+    return i < end ? i : len;
+}
+
+static void convert_case_sse2(
+    char *const text,
+    const size_t len,
+    const bool upper
+) {
+    const __m128i lo = _mm_set1_epi8((upper ? 'a' : 'A') - 1);
+    const __m128i hi = _mm_set1_epi8((upper ? 'z' : 'Z') + 1);
+    const __m128i bit = _mm_set1_epi8(0x20);
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *) &text[i]);
+        const __m128i letter =
+            _mm_and_si128(_mm_cmpgt_epi8(v, lo), _mm_cmpgt_epi8(hi, v));
+        v = _mm_xor_si128(v, _mm_and_si128(letter, bit));
+        _mm_storeu_si128((__m128i *) &text[i], v);
+    }
+    convert_case_scalar(&text[i], len - i, upper);
+}
+
+__attribute__((target("avx2"))) static void convert_case_avx2(
+    char *const text,
+    const size_t len,
+    const bool upper
+) {
+    const __m256i lo = _mm256_set1_epi8((upper ? 'a' : 'A') - 1);
+    const __m256i hi = _mm256_set1_epi8((upper ? 'z' : 'Z') + 1);
+    const __m256i bit = _mm256_set1_epi8(0x20);
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *) &text[i]);
+        const __m256i letter = _mm256_and_si256(
+            _mm256_cmpgt_epi8(v, lo), _mm256_cmpgt_epi8(hi, v)
+        );
+        v = _mm256_xor_si256(v, _mm256_and_si256(letter, bit));
+        _mm256_storeu_si256((__m256i *) &text[i], v);
+    }
+    convert_case_sse2(&text[i], len - i, upper);
+}
+
+// Reads flags set as the program starts, so is safe from any thread
+static bool has_avx2(void) {
+    return __builtin_cpu_supports("avx2");
+}
+
+size_t find_class(
+    const char *const text,
+    const size_t len,
+    const uint8_t mask
+) {
+    if (has_avx2()) {
+        return find_class_avx2(text, len, mask);
+    }
+    return find_class_sse2(text, len, mask);
+}
+
+size_t find_class_back(
+    const char *const text,
+    const size_t len,
+    const uint8_t mask
+) {
+    if (has_avx2()) {
+        return find_class_back_avx2(text, len, mask);
+    }
+    return find_class_back_sse2(text, len, mask);
+}
+
+void convert_case(char *const text, const size_t len, const bool upper) {
+    if (has_avx2()) {
+        convert_case_avx2(text, len, upper);
+    } else {
+        convert_case_sse2(text, len, upper);
+    }
+}
+
+#else
+
+size_t find_class(
+    const char *const text,
+    const size_t len,
+    const uint8_t mask
+) {
+    return find_class_scalar(text, len, mask);
+}
+
+size_t find_class_back(
+    const char *const text,
+    const size_t len,
+    const uint8_t mask
+) {
+    return find_class_back_scalar(text, len, mask);
+}
+
+void convert_case(char *const text, const size_t len, const bool upper) {
+    convert_case_scalar(text, len, upper);
+}
+
+#endif
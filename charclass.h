@@ -0,0 +1,53 @@
+#ifndef CHARCLASS_H
+#define CHARCLASS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Byte classes used by word motions, matching `isspace`/`isalnum` in the
+// "C" locale, except that all bytes of UTF-8 characters are word bytes
+enum CharClass {
+    CLASS_SPACE = 1 << 0,
+    CLASS_WORD = 1 << 1,
+    CLASS_PUNCT = 1 << 2,
+};
+
+#define CLASS_ANY (CLASS_SPACE | CLASS_WORD | CLASS_PUNCT)
+#define CLASS_NONSPACE (CLASS_WORD | CLASS_PUNCT)
+
+extern const uint8_t CHAR_CLASSES[256];
+
+static inline uint8_t char_class(const char ch) {
+    return CHAR_CLASSES[(unsigned char) ch];
+}
+
+// Index of first byte whose class is in `mask`, or `len` if none
+size_t find_class(const char *const text, const size_t len, const uint8_t mask);
+
+// Index of last byte whose class is in `mask`, or `len` if none
+size_t find_class_back(
+    const char *const text,
+    const size_t len,
+    const uint8_t mask
+);
+
+// Convert ASCII letters in place
+void convert_case(char *const text, const size_t len, const bool upper);
+
+// Reference implementations, giving identical results to the above
+size_t find_class_scalar(
+    const char *const text,
+    const size_t len,
+    const uint8_t mask
+);
+
+size_t find_class_back_scalar(
+    const char *const text,
+    const size_t len,
+    const uint8_t mask
+);
+
+void convert_case_scalar(char *const text, const size_t len, const bool upper);
+
+#endif
@@ -0,0 +1,84 @@
+#include "output.h"
+#include "serve.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <errno.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Prompt process, which is not in the terminal's foreground process group,
+// so is sent <C-c> from here
+static volatile sig_atomic_t prompt_pid = 0;
+
+static void forward_signal(const int signal) {
+    if (prompt_pid > 0) {
+        kill(prompt_pid, signal);
+    }
+}
+
+// Print everything but the last byte, which is returned as the exit status
+static int print_reply(const int conn) {
+    char buffer[4096];
+    // Last byte is held back until more is read
+    bool held = false;
+    char last = 0;
+    while (true) {
+        const ssize_t count = read(conn, buffer, sizeof(buffer));
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count < 0) {
+            perror("Failed to read reply");
+            return 1;
+        }
+        if (count == 0) {
+            break;
+        }
+        if ((held && !write_all(STDOUT_FILENO, &last, 1))
+            || !write_all(STDOUT_FILENO, buffer, count - 1))
+        {
+            perror("Failed to write output");
+            return 1;
+        }
+        held = true;
+        last = buffer[count - 1];
+    }
+    if (!held) {
+        fprintf(stderr, "Server closed connection.\n");
+        return 1;
+    }
+    return (unsigned char) last;
+}
+
+int main(const int argc, const char *const *const argv) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: vimline-client SOCKET [OPTION]...\n");
+        return 1;
+    }
+    const int tty_fd = open("/dev/tty", O_RDWR);
+    if (tty_fd < 0) {
+        perror("Failed to open terminal");
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    // Options are sent after program name, in place of socket
+    const char *options[argc];
+    options[0] = argv[0];
+    for (int i = 2; i < argc; ++i) {
+        options[i - 1] = argv[i];
+    }
+    uint32_t pid;
+    const int conn = serve_request(argv[1], tty_fd, argc - 1, options, &pid);
+    close(tty_fd);
+
+    prompt_pid = pid;
+    struct sigaction action = {.sa_handler = forward_signal};
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    return print_reply(conn);
+}
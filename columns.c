@@ -0,0 +1,410 @@
+#include "columns.h"
+
+#include "alloc.h"
+#include "buffer.h"
+#include "utf8.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Edits split chunks longer than `CHUNK_MAX` into chunks of `CHUNK_SIZE`
+#define CHUNK_SIZE (128)
+#define CHUNK_MAX (512)
+#define CHUNKS_MIN_CAPACITY (8)
+
+// Widths can change for characters up to this many bytes around an edit
+#define EDIT_CONTEXT (UTF8_MAX - 1)
+
+// Fenwick trees are 1-based, with `count` values
+
+static void tree_add(
+    uint32_t *const tree,
+    const uint32_t count,
+    uint32_t index,
+    const uint32_t delta
+) {
+    for (++index; index <= count; index += index & -index) {
+        tree[index] += delta;
+    }
+}
+
+// Sum of first `count` values
+static uint32_t tree_sum(const uint32_t *const tree, uint32_t count) {
+    uint32_t sum = 0;
+    for (; count > 0; count -= count & -count) {
+        sum += tree[count];
+    }
+    return sum;
+}
+
+// Number of leading values whose sum is at most `value`
+// `sum` is set to their sum
+static uint32_t tree_search(
+    const uint32_t *const tree,
+    const uint32_t count,
+    const uint32_t value,
+    uint32_t *const sum
+) {
+    uint32_t step = 1;
+    while (step * 2 <= count) {
+        step *= 2;
+    }
+    uint32_t index = 0;
+    *sum = 0;
+    for (; step > 0; step /= 2) {
+        if (index + step <= count && *sum + tree[index + step] <= value) {
+            index += step;
+            *sum += tree[index];
+        }
+    }
+    return index;
+}
+
+static void build_trees(Columns *const columns) {
+    uint32_t *const len_tree = columns->len_tree;
+    uint32_t *const column_tree = columns->column_tree;
+    for (uint32_t i = 1; i <= columns->count; ++i) {
+        len_tree[i] = columns->chunks[i - 1].len;
+        column_tree[i] = columns->chunks[i - 1].columns;
+    }
+    for (uint32_t i = 1; i <= columns->count; ++i) {
+        const uint32_t parent = i + (i & -i);
+        if (parent <= columns->count) {
+            len_tree[parent] += len_tree[i];
+            column_tree[parent] += column_tree[i];
+        }
+    }
+}
+
+// Advance from character at `index` over characters starting before `end`,
+// while they fit within `limit` columns
+// Widths are added to `columns`
+static uint32_t advance(
+    const Buffer *const buffer,
+    uint32_t index,
+    const uint32_t end,
+    const uint32_t limit,
+    uint32_t *const columns
+) {
+    while (index < end && *columns < limit) {
+        uint32_t span_len;
+        const char *const span = buffer_span(buffer, index, &span_len);
+        uint32_t len = span_len;
+        if (len > end - index) {
+            len = end - index;
+        }
+        if (len > limit - *columns) {
+            len = limit - *columns;
+        }
+        // ASCII characters are one column each
+        uint32_t ascii = 0;
+        while (ascii < len && (unsigned char) span[ascii] < 0x80) {
+            ++ascii;
+        }
+        index += ascii;
+        *columns += ascii;
+        if (ascii < len) {
+            // Character may continue in the next piece
+            const char *const text = &span[ascii];
+            uint32_t width;
+            uint32_t char_len;
+            if (utf8_length(*text) <= span_len - ascii) {
+                char_len = utf8_decode(text, span_len - ascii, &width);
+            } else {
+                char copy[UTF8_MAX];
+                char_len = char_at(buffer, index, copy, &width);
+            }
+            if (*columns + width > limit) {
+                break;
+            }
+            index += char_len;
+            *columns += width;
+        }
+    }
+    return index;
+}
+
+// Columns of characters starting in `[start, end)`
+static uint32_t chunk_columns(
+    const Buffer *const buffer,
+    uint32_t start,
+    const uint32_t end
+) {
+    if (!char_boundary(buffer, start)) {
+        start = next_char(buffer, start);
+    }
+    uint32_t columns = 0;
+    advance(buffer, start, end, UINT32_MAX, &columns);
+    return columns;
+}
+
+// Grow arrays to hold `count` chunks
+// Returns false if out of memory, keeping arrays which did grow
+static bool reserve_chunks(Columns *const columns, const uint32_t count) {
+    if (count <= columns->capacity) {
+        return true;
+    }
+    uint32_t capacity = columns->capacity > 0
+        ? columns->capacity
+        : CHUNKS_MIN_CAPACITY;
+    while (capacity < count) {
+        capacity *= 2;
+    }
+    Chunk *const chunks =
+        mem_realloc(columns->chunks, capacity * sizeof(Chunk));
+    if (chunks == NULL) {
+        return false;
+    }
+    columns->chunks = chunks;
+    uint32_t *const len_tree =
+        mem_realloc(columns->len_tree, (capacity + 1) * sizeof(uint32_t));
+    if (len_tree == NULL) {
+        return false;
+    }
+    columns->len_tree = len_tree;
+    uint32_t *const column_tree =
+        mem_realloc(columns->column_tree, (capacity + 1) * sizeof(uint32_t));
+    if (column_tree == NULL) {
+        return false;
+    }
+    columns->column_tree = column_tree;
+    columns->capacity = capacity;
+    return true;
+}
+
+// Replace `old_count` chunks at `first` with chunks covering `len` bytes at
+// `start`
+static void replace_chunks(
+    Columns *const columns,
+    const Buffer *const buffer,
+    const uint32_t first,
+    const uint32_t old_count,
+    const uint32_t start,
+    const uint32_t len
+) {
+    const uint32_t new_count = (len + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    const uint32_t count = columns->count - old_count + new_count;
+    if (!reserve_chunks(columns, count)) {
+        perror("Failed to allocate column index");
+        exit(1);
+    }
+    if (first + old_count < columns->count) {
+        memmove(
+            &columns->chunks[first + new_count],
+            &columns->chunks[first + old_count],
+            (columns->count - first - old_count) * sizeof(Chunk)
+        );
+    }
+    columns->count = count;
+
+    for (uint32_t i = 0; i < new_count; ++i) {
+        const uint32_t chunk_start = start + i * CHUNK_SIZE;
+        const uint32_t chunk_len = i + 1 < new_count
+            ? CHUNK_SIZE
+            : len - i * CHUNK_SIZE;
+        columns->chunks[first + i] = (Chunk) {
+            .len = chunk_len,
+            .columns =
+                chunk_columns(buffer, chunk_start, chunk_start + chunk_len),
+        };
+    }
+    build_trees(columns);
+}
+
+bool columns_build(Columns *const columns, const Buffer *const buffer) {
+    if (columns->built) {
+        return true;
+    }
+    const uint32_t len = buffer_len(buffer);
+    if (!reserve_chunks(columns, (len + CHUNK_SIZE - 1) / CHUNK_SIZE)) {
+        return false;
+    }
+    replace_chunks(columns, buffer, 0, 0, 0, len);
+    columns->built = true;
+    return true;
+}
+
+// Build index if this is the first lookup
+static const Columns *prepare(const Buffer *const buffer) {
+    Columns *const columns = (Columns *) &buffer->columns;
+    if (!columns_build(columns, buffer)) {
+        perror("Failed to allocate column index");
+        exit(1);
+    }
+    return columns;
+}
+
+void columns_init(Columns *const columns) {
+    columns->built = false;
+    columns->chunks = NULL;
+    columns->count = 0;
+    columns->capacity = 0;
+    columns->len_tree = NULL;
+    columns->column_tree = NULL;
+}
+
+void columns_free(Columns *const columns) {
+    mem_free(columns->chunks);
+    mem_free(columns->len_tree);
+    mem_free(columns->column_tree);
+    columns_init(columns);
+}
+
+void columns_edit(
+    Columns *const columns,
+    const Buffer *const buffer,
+    const uint32_t index,
+    const uint32_t removed_len,
+    const uint32_t inserted_len
+) {
+    if (!columns->built) {
+        return;
+    }
+    const uint32_t len = buffer_len(buffer);
+    if (columns->count == 0 || len == 0) {
+        replace_chunks(columns, buffer, 0, columns->count, 0, len);
+        return;
+    }
+
+    // Find chunks overlapping edit, by position before edit
+    const uint32_t old_len = len - inserted_len + removed_len;
+    const uint32_t from = index > EDIT_CONTEXT ? index - EDIT_CONTEXT : 0;
+    uint32_t to = index + removed_len + EDIT_CONTEXT;
+    if (to > old_len) {
+        to = old_len;
+    }
+    uint32_t start;
+    uint32_t last_start;
+    const uint32_t first =
+        tree_search(columns->len_tree, columns->count, from, &start);
+    const uint32_t last =
+        tree_search(columns->len_tree, columns->count, to - 1, &last_start);
+    const uint32_t old_end = last_start + columns->chunks[last].len;
+    const uint32_t region = old_end - start - removed_len + inserted_len;
+
+    // Usually only one chunk changes, so trees can be updated in place
+    if (first == last && region > 0 && region <= CHUNK_MAX) {
+        Chunk *const chunk = &columns->chunks[first];
+        const uint32_t width = chunk_columns(buffer, start, start + region);
+        tree_add(columns->len_tree, columns->count, first, region - chunk->len);
+        tree_add(
+            columns->column_tree,
+            columns->count,
+            first,
+            width - chunk->columns
+        );
+        chunk->len = region;
+        chunk->columns = width;
+        return;
+    }
+
+    replace_chunks(columns, buffer, first, last - first + 1, start, region);
+}
+
+bool char_boundary(const Buffer *const buffer, const uint32_t index) {
+    const uint32_t len = buffer_len(buffer);
+    if (index >= len || !utf8_continuation(buffer_get(buffer, index))) {
+        return true;
+    }
+    // Look for lead byte of a valid sequence containing `index`
+    for (uint32_t back = 1; back < UTF8_MAX && back <= index; ++back) {
+        const char lead = buffer_get(buffer, index - back);
+        if (utf8_continuation(lead)) {
+            continue;
+        }
+        const uint32_t end = index - back + utf8_length(lead);
+        if (end <= index || end > len) {
+            return true;
+        }
+        for (uint32_t i = index + 1; i < end; ++i) {
+            if (!utf8_continuation(buffer_get(buffer, i))) {
+                return true;
+            }
+        }
+        return false;
+    }
+    return true;
+}
+
+uint32_t char_start(const Buffer *const buffer, uint32_t index) {
+    while (index > 0 && !char_boundary(buffer, index)) {
+        --index;
+    }
+    return index;
+}
+
+uint32_t next_char(const Buffer *const buffer, uint32_t index) {
+    const uint32_t len = buffer_len(buffer);
+    if (index >= len) {
+        return len;
+    }
+    do {
+        ++index;
+    } while (index < len && !char_boundary(buffer, index));
+    return index;
+}
+
+uint32_t prev_char(const Buffer *const buffer, const uint32_t index) {
+    if (index == 0) {
+        return 0;
+    }
+    return char_start(buffer, index - 1);
+}
+
+uint32_t last_char(const Buffer *const buffer) {
+    return prev_char(buffer, buffer_len(buffer));
+}
+
+uint32_t char_at(
+    const Buffer *const buffer,
+    const uint32_t index,
+    char *const text,
+    uint32_t *const width
+) {
+    uint32_t len = buffer_len(buffer) - index;
+    if (len > UTF8_MAX) {
+        len = UTF8_MAX;
+    }
+    buffer_copy(buffer, index, len, text);
+    return utf8_decode(text, len, width);
+}
+
+uint32_t index_column(const Buffer *const buffer, const uint32_t index) {
+    const Columns *const columns = prepare(buffer);
+    if (index >= buffer_len(buffer)) {
+        return tree_sum(columns->column_tree, columns->count);
+    }
+    uint32_t start;
+    const uint32_t chunk =
+        tree_search(columns->len_tree, columns->count, index, &start);
+    uint32_t column = tree_sum(columns->column_tree, chunk);
+    if (!char_boundary(buffer, start)) {
+        start = next_char(buffer, start);
+    }
+    advance(buffer, start, index, UINT32_MAX, &column);
+    return column;
+}
+
+uint32_t total_columns(const Buffer *const buffer) {
+    const Columns *const columns = prepare(buffer);
+    return tree_sum(columns->column_tree, columns->count);
+}
+
+uint32_t column_index(
+    const Buffer *const buffer,
+    const uint32_t column,
+    uint32_t *const start
+) {
+    const Columns *const columns = prepare(buffer);
+    const uint32_t chunk =
+        tree_search(columns->column_tree, columns->count, column, start);
+    if (chunk >= columns->count) {
+        return buffer_len(buffer);
+    }
+    uint32_t index = tree_sum(columns->len_tree, chunk);
+    if (!char_boundary(buffer, index)) {
+        index = next_char(buffer, index);
+    }
+    return advance(buffer, index, buffer_len(buffer), column, start);
+}
@@ -0,0 +1,88 @@
+#ifndef COLUMNS_H
+#define COLUMNS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct Buffer Buffer;
+
+// Run of bytes, and the display columns of characters starting in it
+typedef struct Chunk {
+    uint32_t len;
+    uint32_t columns;
+} Chunk;
+
+// Index of byte offsets to display columns, in chunks of at most a few
+// hundred bytes
+// Prefix sums of chunk lengths and columns are kept in Fenwick trees, so
+// lookups are O(log n), and most edits only update one chunk
+// Built on first lookup, then updated by every buffer edit
+typedef struct Columns {
+    bool built;
+    Chunk *chunks;
+    uint32_t count;
+    uint32_t capacity;
+    uint32_t *len_tree;
+    uint32_t *column_tree;
+} Columns;
+
+void columns_init(Columns *const columns);
+
+void columns_free(Columns *const columns);
+
+// Build index now, instead of on first lookup
+// Returns false if out of memory
+bool columns_build(Columns *const columns, const Buffer *const buffer);
+
+// Update index after `removed_len` bytes at `index` were replaced with
+// `inserted_len` bytes
+void columns_edit(
+    Columns *const columns,
+    const Buffer *const buffer,
+    const uint32_t index,
+    const uint32_t removed_len,
+    const uint32_t inserted_len
+);
+
+// Characters are UTF-8 sequences, or single bytes if invalid
+
+// Whether `index` is the first byte of a character
+bool char_boundary(const Buffer *const buffer, const uint32_t index);
+
+// Start of character containing `index`
+uint32_t char_start(const Buffer *const buffer, const uint32_t index);
+
+// Start of character after the one at `index`, or buffer length
+uint32_t next_char(const Buffer *const buffer, const uint32_t index);
+
+// Start of character before `index`, or 0
+uint32_t prev_char(const Buffer *const buffer, const uint32_t index);
+
+// Start of last character, or 0 if empty
+uint32_t last_char(const Buffer *const buffer);
+
+// Copy character at `index` into `text` (at least `UTF8_MAX` bytes), and set
+// `width` to its display width
+// Returns length of character
+uint32_t char_at(
+    const Buffer *const buffer,
+    const uint32_t index,
+    char *const text,
+    uint32_t *const width
+);
+
+// Display column of character at `index`
+uint32_t index_column(const Buffer *const buffer, const uint32_t index);
+
+// Total display width of buffer
+uint32_t total_columns(const Buffer *const buffer);
+
+// Start of character covering display `column`, or buffer length if none
+// `start` is set to the first column of the character
+uint32_t column_index(
+    const Buffer *const buffer,
+    const uint32_t column,
+    uint32_t *const start
+);
+
+#endif
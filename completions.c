@@ -0,0 +1,230 @@
+#define _GNU_SOURCE  // qsort_r
+
+#include "completions.h"
+
+#include "alloc.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define WORDS_MIN_CAPACITY (1024)
+
+static void *allocate(void *const ptr, const size_t size) {
+    void *const result = mem_realloc(ptr, size);
+    if (result == NULL) {
+        perror("Failed to allocate completions");
+        exit(1);
+    }
+    return result;
+}
+
+static int compare_text(
+    const char *const lhs,
+    const uint32_t lhs_len,
+    const char *const rhs,
+    const uint32_t rhs_len
+) {
+    const int result = memcmp(lhs, rhs, lhs_len < rhs_len ? lhs_len : rhs_len);
+    if (result != 0) {
+        return result;
+    }
+    return (lhs_len > rhs_len) - (lhs_len < rhs_len);
+}
+
+static int compare_words(
+    const void *const lhs,
+    const void *const rhs,
+    void *const data
+) {
+    const Word *const left = lhs;
+    const Word *const right = rhs;
+    return compare_text(
+        &((const char *) data)[left->start],
+        left->len,
+        &((const char *) data)[right->start],
+        right->len
+    );
+}
+
+// Index lines, then sort them unless already sorted
+static void *build(void *const arg) {
+    Completions *const completions = arg;
+    const char *const data = completions->data;
+    const char *const end = &data[completions->size];
+
+    Word *words = NULL;
+    uint32_t count = 0;
+    uint32_t capacity = 0;
+    bool sorted = true;
+    const char *line = data;
+    while (line < end) {
+        const char *newline = memchr(line, '\n', end - line);
+        if (newline == NULL) {
+            newline = end;
+        }
+        uint32_t len = newline - line;
+        if (len > 0 && line[len - 1] == '\r') {
+            --len;
+        }
+        if (len > 0) {
+            if (count >= capacity) {
+                capacity = capacity > 0 ? capacity * 2 : WORDS_MIN_CAPACITY;
+                words = allocate(words, capacity * sizeof(Word));
+            }
+            words[count] = (Word) {line - data, len};
+            if (count > 0 && sorted) {
+                sorted = compare_words(
+                    &words[count - 1], &words[count], (void *) data
+                ) <= 0;
+            }
+            ++count;
+        }
+        line = newline + 1;
+    }
+
+    if (!sorted) {
+        qsort_r(words, count, sizeof(Word), compare_words, (void *) data);
+    }
+    // Remove duplicates
+    uint32_t unique = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+        if (unique == 0
+            || compare_words(&words[unique - 1], &words[i], (void *) data) != 0)
+        {
+            words[unique++] = words[i];
+        }
+    }
+
+    completions->words = words;
+    completions->count = unique;
+    atomic_store_explicit(&completions->ready, true, memory_order_release);
+    return NULL;
+}
+
+void completions_open(Completions *const completions, const char *filename) {
+    const int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        perror("Failed to open completions file");
+        exit(1);
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        perror("Failed to read completions file");
+        exit(1);
+    }
+    if (info.st_size > UINT32_MAX) {
+        fprintf(stderr, "Completions file is too large.\n");
+        exit(1);
+    }
+
+    completions->data = NULL;
+    completions->size = info.st_size;
+    completions->words = NULL;
+    completions->count = 0;
+    completions->joined = false;
+    atomic_init(&completions->ready, false);
+    if (completions->size > 0) {
+        const char *const data =
+            mmap(NULL, completions->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            perror("Failed to map completions file");
+            exit(1);
+        }
+        completions->data = data;
+    }
+    close(fd);
+
+    if (pthread_create(&completions->thread, NULL, build, completions) != 0) {
+        fprintf(stderr, "Failed to start loading completions.\n");
+        exit(1);
+    }
+}
+
+void completions_wait(Completions *const completions) {
+    if (!completions->joined) {
+        pthread_join(completions->thread, NULL);
+        completions->joined = true;
+    }
+}
+
+void completions_close(Completions *const completions) {
+    completions_wait(completions);
+    if (completions->data != NULL) {
+        munmap((void *) completions->data, completions->size);
+    }
+    mem_free(completions->words);
+}
+
+bool completions_ready(const Completions *const completions) {
+    return atomic_load_explicit(
+        (atomic_bool *) &completions->ready, memory_order_acquire
+    );
+}
+
+// Compare word with `prefix`, treating it as equal if it starts with it
+static int compare_prefix(
+    const Completions *const completions,
+    const uint32_t index,
+    const char *const prefix,
+    const uint32_t prefix_len
+) {
+    const Word word = completions->words[index];
+    return compare_text(
+        &completions->data[word.start],
+        word.len < prefix_len ? word.len : prefix_len,
+        prefix,
+        prefix_len
+    );
+}
+
+uint32_t completions_find(
+    const Completions *const completions,
+    const char *const prefix,
+    const uint32_t prefix_len,
+    uint32_t *const count
+) {
+    *count = 0;
+    if (!completions_ready(completions)) {
+        return 0;
+    }
+    // First word not before prefix
+    uint32_t low = 0;
+    uint32_t high = completions->count;
+    while (low < high) {
+        const uint32_t middle = low + (high - low) / 2;
+        if (compare_prefix(completions, middle, prefix, prefix_len) < 0) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    const uint32_t first = low;
+    // First word after prefix
+    high = completions->count;
+    while (low < high) {
+        const uint32_t middle = low + (high - low) / 2;
+        if (compare_prefix(completions, middle, prefix, prefix_len) <= 0) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    *count = low - first;
+    return first;
+}
+
+const char *completions_word(
+    const Completions *const completions,
+    const uint32_t index,
+    uint32_t *const len
+) {
+    const Word word = completions->words[index];
+    *len = word.len;
+    return &completions->data[word.start];
+}
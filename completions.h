@@ -0,0 +1,56 @@
+#ifndef COMPLETIONS_H
+#define COMPLETIONS_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Word at `start` in the mapped file
+typedef struct Word {
+    uint32_t start;
+    uint32_t len;
+} Word;
+
+// Words from a file with one word per line, sorted without duplicates
+// Words sharing a prefix are a contiguous range, found by binary search
+// The file is mapped on open, then indexed and sorted on a background
+// thread, so nothing is found until it is ready
+typedef struct Completions {
+    const char *data;
+    size_t size;
+    Word *words;
+    uint32_t count;
+    pthread_t thread;
+    bool joined;
+    atomic_bool ready;
+} Completions;
+
+// Exits if file cannot be read, before indexing starts
+void completions_open(Completions *const completions, const char *filename);
+
+// Wait for indexing to finish
+void completions_wait(Completions *const completions);
+
+void completions_close(Completions *const completions);
+
+bool completions_ready(const Completions *const completions);
+
+// First word starting with `prefix`, with `count` set to the number of such
+// words
+// If not ready, `count` is 0
+uint32_t completions_find(
+    const Completions *const completions,
+    const char *const prefix,
+    const uint32_t prefix_len,
+    uint32_t *const count
+);
+
+const char *completions_word(
+    const Completions *const completions,
+    const uint32_t index,
+    uint32_t *const len
+);
+
+#endif
@@ -0,0 +1,1521 @@
+#include "editor.h"
+
+#include "alloc.h"
+#include "charclass.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+const uint32_t CURSOR_LEFT = 5;         // Min left padding
+const uint32_t CURSOR_RIGHT_FULL = 3;   // Min right padding
+const uint32_t CURSOR_RIGHT_EMPTY = 1;  // (^) when cursor is at end of input
+const uint32_t COUNT_MAX = 1000 * 1000;  // Larger counts are clamped
+
+uint32_t subsat(const uint32_t lhs, const uint32_t rhs) {
+    if (rhs >= lhs) {
+        return 0;
+    }
+    return lhs - rhs;
+}
+
+uint32_t min(const uint32_t lhs, const uint32_t rhs) {
+    if (rhs >= lhs) {
+        return lhs;
+    }
+    return rhs;
+}
+
+uint32_t difference(const uint32_t lhs, const uint32_t rhs) {
+    if (lhs >= rhs) {
+        return lhs - rhs;
+    }
+    return rhs - lhs;
+}
+
+bool editor_init(
+    State *const state,
+    const char *const value,
+    const uint32_t value_len,
+    const uint32_t width
+) {
+    state->mode = MODE_NORMAL;
+    Buffer *const input = &state->snap.input;
+    // Index is built here, where running out of memory can be returned
+    const bool allocated = buffer_init(input, value, value_len)
+        && columns_build(&input->columns, input);
+    state->snap.cursor = 0;
+    state->snap.offset = 0;
+    if (allocated) {
+        state->snap.cursor = last_char(input);
+        state->snap.offset = subsat(
+            index_column(input, state->snap.cursor) + CURSOR_RIGHT_EMPTY + 1,
+            width
+        );
+    }
+    state->visual_start = 0;
+    history_init(&state->history);
+    state->width = width;
+    state->typed_len = 0;
+    state->placeholder = NULL;
+    state->filename = NULL;
+    state->output_fd = -1;
+    state->recall = NULL;
+    state->recall_index = RECALL_NONE;
+    state->draft = NULL;
+    state->draft_len = 0;
+    state->draft_cursor = 0;
+    state->draft_offset = 0;
+    state->search = (Search) {
+        .return_mode = MODE_NORMAL,
+        .query = NULL,
+        .query_len = 0,
+        .query_capacity = 0,
+        .match = RECALL_NONE,
+        .position = 0,
+        .failing = false,
+    };
+    state->completions = NULL;
+    state->completion.active = false;
+    for (uint32_t i = 0; i < REGISTER_COUNT; ++i) {
+        state->registers[i] = (KeyList) {.keys = NULL, .len = 0, .capacity = 0};
+    }
+    state->recording = REGISTER_NONE;
+    state->last_register = REGISTER_NONE;
+    state->replaying = 0;
+    state->pending = 0;
+    state->count = 0;
+    state->operator = 0;
+    state->operator_count = 0;
+    state->yanked = NULL;
+    state->yanked_len = 0;
+    state->yanked_capacity = 0;
+    state->change = (KeyList) {.keys = NULL, .len = 0, .capacity = 0};
+    state->last_change = (KeyList) {.keys = NULL, .len = 0, .capacity = 0};
+    state->repeating = false;
+    state->edits = 0;
+    state->change_edits = 0;
+    state->replay_depth = 0;
+    return allocated;
+}
+
+void editor_free(State *const state) {
+    buffer_free(&state->snap.input);
+    history_free(&state->history);
+    mem_free(state->draft);
+    mem_free(state->search.query);
+    for (uint32_t i = 0; i < REGISTER_COUNT; ++i) {
+        mem_free(state->registers[i].keys);
+    }
+    mem_free(state->change.keys);
+    mem_free(state->last_change.keys);
+    mem_free(state->yanked);
+}
+
+const char *mode_name(enum VimMode mode) {
+    switch (mode) {
+        case MODE_NORMAL:
+            return "NORMAL";
+        case MODE_INSERT:
+            return "INSERT";
+        case MODE_REPLACE:
+            return "REPLACE";
+        case MODE_VISUAL:
+            return "VISUAL";
+        case MODE_SEARCH:
+            return "SEARCH";
+        default:
+            return "?";
+    }
+}
+
+int find_word_start(const Snap *const snap, const bool full_word) {
+    const Buffer *const input = &snap->input;
+    const uint32_t input_len = buffer_len(input);
+    // Empty line
+    if (input_len < 1) {
+        return 0;
+    }
+    // At end of line
+    if (snap->cursor + 1 >= input_len) {
+        return last_char(input);
+    }
+    uint32_t index = snap->cursor;
+    const uint8_t class = char_class(buffer_get(input, index));
+    // On non-space
+    // Look for first space
+    // OR first punctuation after word
+    // OR first word after punctuation
+    // (If distinguishing words and punctuation)
+    if (class != CLASS_SPACE) {
+        const uint8_t mask = full_word ? CLASS_SPACE : CLASS_ANY & ~class;
+        index = buffer_find_class(input, index + 1, input_len, mask);
+        if (index >= input_len) {
+            return last_char(input);
+        }
+        if (char_class(buffer_get(input, index)) != CLASS_SPACE) {
+            return index;
+        }
+    }
+    // On a space
+    // Look for first non-space character
+    index = buffer_find_class(input, index + 1, input_len, CLASS_NONSPACE);
+    if (index >= input_len) {
+        // No next word found
+        // Go to end of line
+        return last_char(input);
+    }
+    return index;
+}
+
+int find_word_end(const Snap *const snap, const bool full_word) {
+    const Buffer *const input = &snap->input;
+    const uint32_t input_len = buffer_len(input);
+    // Empty line
+    if (input_len < 1) {
+        return 0;
+    }
+    // Always move at least one character
+    const uint32_t next = next_char(input, snap->cursor);
+    // At end of line
+    if (next >= input_len) {
+        return last_char(input);
+    }
+    // On a sequence of spaces (>=1)
+    // Look for start of next word, start from there instead
+    uint32_t index =
+        buffer_find_class(input, next, input_len - 1, CLASS_NONSPACE);
+    // On non-space
+    // Word ends before first space
+    // OR first punctuation after word
+    // OR first word after punctuation
+    // (If distinguishing words and punctuation)
+    const uint8_t class = char_class(buffer_get(input, index));
+    const uint8_t mask = full_word ? CLASS_SPACE : CLASS_ANY & ~class;
+    index = buffer_find_class(input, index + 1, input_len, mask);
+    if (index >= input_len) {
+        // No next word found
+        // Go to end of line
+        return last_char(input);
+    }
+    return char_start(input, index - 1);
+}
+
+int find_word_back(const Snap *const snap, const bool full_word) {
+    const Buffer *const input = &snap->input;
+    // At start of line
+    if (snap->cursor <= 1) {
+        return 0;
+    }
+    // Start at previous character
+    // On a sequence of spaces (>=1)
+    // Look for end of previous word, start from there instead
+    uint32_t index =
+        buffer_find_class_back(input, 1, snap->cursor, CLASS_NONSPACE);
+    if (index >= snap->cursor) {
+        index = 0;
+    }
+    // Now on a non-space
+    // Word starts after first space before it
+    // OR first punctuation before word
+    // OR first word before punctuation
+    // (If distinguishing words and punctuation)
+    const uint8_t class = char_class(buffer_get(input, index));
+    const uint8_t mask = full_word ? CLASS_SPACE : CLASS_ANY & ~class;
+    const uint32_t before = buffer_find_class_back(input, 0, index, mask);
+    if (before >= index) {
+        // No previous word found
+        // Go to start of line
+        return 0;
+    }
+    return before + 1;
+}
+
+// Replace `removed_len` bytes at `index` with `text`
+void splice_input(
+    State *const state,
+    const uint32_t index,
+    uint32_t removed_len,
+    const char *const text,
+    const uint32_t text_len
+) {
+    removed_len =
+        min(removed_len, subsat(buffer_len(&state->snap.input), index));
+    history_record(
+        &state->history,
+        &state->snap.input,
+        index,
+        removed_len,
+        text,
+        text_len,
+        state->snap.cursor,
+        state->snap.offset
+    );
+    buffer_delete(&state->snap.input, index, removed_len);
+    buffer_insert(&state->snap.input, index, text, text_len);
+    ++state->edits;
+}
+
+void change_case(
+    State *const state,
+    const uint32_t start,
+    uint32_t size,
+    const bool upper
+) {
+    size = min(size, subsat(buffer_len(&state->snap.input), start));
+    if (size == 0) {
+        return;
+    }
+    char *const text = mem_realloc(NULL, size);
+    if (text == NULL) {
+        perror("Failed to allocate memory");
+        exit(1);
+    }
+    buffer_copy(&state->snap.input, start, size, text);
+    convert_case(text, size, upper);
+    splice_input(state, start, size, text, size);
+    mem_free(text);
+}
+
+void push_history(State *const state) {
+    if (state->replay_depth > 0) {
+        return;
+    }
+    history_commit(&state->history, state->snap.cursor, state->snap.offset);
+}
+
+void undo_history(State *const state) {
+    history_undo(
+        &state->history,
+        &state->snap.input,
+        &state->snap.cursor,
+        &state->snap.offset
+    );
+}
+
+void redo_history(State *const state) {
+    history_redo(
+        &state->history,
+        &state->snap.input,
+        &state->snap.cursor,
+        &state->snap.offset
+    );
+}
+
+void update_offset_left(Snap *const snap) {
+    const uint32_t column = index_column(&snap->input, snap->cursor);
+    if (column < snap->offset + CURSOR_LEFT) {
+        snap->offset = subsat(column, CURSOR_LEFT);
+    }
+}
+
+void update_offset_right(Snap *const snap, const uint32_t width) {
+    const uint32_t column = index_column(&snap->input, snap->cursor);
+    const uint32_t cursor_right =
+        (next_char(&snap->input, snap->cursor) >= buffer_len(&snap->input))
+        ? CURSOR_RIGHT_EMPTY
+        : CURSOR_RIGHT_FULL;
+    if (column + cursor_right > snap->offset + width) {
+        snap->offset = subsat(column + cursor_right, width);
+    }
+}
+
+// Collect bytes of a character typed one byte at a time
+// Returns length of `state->typed` once it holds a whole printable character
+static uint32_t type_char(State *const state, const int key) {
+    if (key < 0 || key > 0xff) {
+        state->typed_len = 0;
+        return 0;
+    }
+    const char byte = key;
+    if (utf8_continuation(byte) && state->typed_len > 0) {
+        state->typed[state->typed_len++] = byte;
+    } else if (utf8_length(byte) > 1) {
+        state->typed[0] = byte;
+        state->typed_len = 1;
+    } else {
+        state->typed_len = 0;
+        if (key >= 0x80 || !isprint(key)) {
+            return 0;
+        }
+        state->typed[0] = byte;
+        return 1;
+    }
+    const uint32_t len = state->typed_len;
+    if (len < utf8_length(state->typed[0])) {
+        return 0;
+    }
+    state->typed_len = 0;
+    return len;
+}
+
+// Start of last character, or end of line when inserting
+static uint32_t line_end(const State *const state) {
+    if (state->mode == MODE_INSERT) {
+        return buffer_len(&state->snap.input);
+    }
+    return last_char(&state->snap.input);
+}
+
+static void scroll_to_cursor(State *const state) {
+    state->snap.offset = 0;
+    update_offset_right(&state->snap, state->width);
+}
+
+// Replace whole line as a single edit, with cursor at `cursor`, or at end
+// of line if `cursor` is past the end
+static void replace_input(
+    State *const state,
+    const char *const text,
+    const uint32_t len,
+    const uint32_t cursor
+) {
+    splice_input(state, 0, buffer_len(&state->snap.input), text, len);
+    state->snap.cursor = min(cursor, line_end(state));
+    scroll_to_cursor(state);
+    push_history(state);
+}
+
+// Replace whole line without recording an edit, to preview a search match
+// Must be restored to draft before the next recorded edit
+static void show_input(
+    State *const state,
+    const char *const text,
+    const uint32_t len
+) {
+    Buffer *const input = &state->snap.input;
+    buffer_delete(input, 0, buffer_len(input));
+    buffer_insert(input, 0, text, len);
+}
+
+static void save_draft(State *const state) {
+    const Buffer *const input = &state->snap.input;
+    state->draft = mem_realloc(state->draft, buffer_len(input) + 1);
+    if (state->draft == NULL) {
+        perror("Failed to allocate memory");
+        exit(1);
+    }
+    buffer_copy(input, 0, buffer_len(input), state->draft);
+    state->draft_len = buffer_len(input);
+    state->draft_cursor = state->snap.cursor;
+    state->draft_offset = state->snap.offset;
+}
+
+static void show_draft(State *const state) {
+    show_input(state, state->draft, state->draft_len);
+    state->snap.cursor = state->draft_cursor;
+    state->snap.offset = state->draft_offset;
+}
+
+static void recall_older(State *const state) {
+    Recall *const recall = state->recall;
+    if (recall == NULL) {
+        return;
+    }
+    if (state->recall_index == RECALL_NONE) {
+        recall_refresh(recall);
+        save_draft(state);
+        state->recall_index = recall->count;
+    }
+    if (state->recall_index == 0) {
+        return;
+    }
+    --state->recall_index;
+    uint32_t len;
+    char *const entry = recall_entry(recall, state->recall_index, &len);
+    replace_input(state, entry, len, len);
+    mem_free(entry);
+}
+
+static void recall_newer(State *const state) {
+    Recall *const recall = state->recall;
+    if (state->recall_index == RECALL_NONE) {
+        return;
+    }
+    ++state->recall_index;
+    // Back to line being edited
+    if (state->recall_index >= recall->count) {
+        state->recall_index = RECALL_NONE;
+        replace_input(state, state->draft, state->draft_len, state->draft_len);
+        return;
+    }
+    uint32_t len;
+    char *const entry = recall_entry(recall, state->recall_index, &len);
+    replace_input(state, entry, len, len);
+    mem_free(entry);
+}
+
+static void start_search(State *const state) {
+    if (state->recall == NULL) {
+        return;
+    }
+    recall_refresh(state->recall);
+    save_draft(state);
+    state->search.return_mode = state->mode;
+    state->search.query_len = 0;
+    state->search.match = RECALL_NONE;
+    state->search.failing = false;
+    state->mode = MODE_SEARCH;
+}
+
+// Search entries from `from` down, showing newest match
+// If nothing matches, the previous match stays shown
+static void update_search(State *const state, const uint32_t from) {
+    Search *const search = &state->search;
+    uint32_t position;
+    const uint32_t match = recall_search(
+        state->recall, from, search->query, search->query_len, &position
+    );
+    search->failing = match == RECALL_NONE && search->query_len > 0;
+    if (match == RECALL_NONE) {
+        if (search->query_len == 0) {
+            search->match = RECALL_NONE;
+            show_draft(state);
+        }
+        return;
+    }
+    search->match = match;
+    search->position = position;
+    uint32_t len;
+    char *const entry = recall_entry(state->recall, match, &len);
+    show_input(state, entry, len);
+    mem_free(entry);
+    state->snap.cursor = position;
+    scroll_to_cursor(state);
+}
+
+static void end_search(State *const state, const bool accept) {
+    Search *const search = &state->search;
+    show_draft(state);
+    state->mode = search->return_mode;
+    if (accept && search->match != RECALL_NONE) {
+        uint32_t len;
+        char *const entry = recall_entry(state->recall, search->match, &len);
+        replace_input(state, entry, len, search->position);
+        mem_free(entry);
+    }
+}
+
+static void add_to_query(
+    State *const state,
+    const char *const text,
+    const uint32_t len
+) {
+    Search *const search = &state->search;
+    if (search->query_len + len > search->query_capacity) {
+        search->query_capacity = (search->query_len + len) * 2;
+        search->query = mem_realloc(search->query, search->query_capacity);
+        if (search->query == NULL) {
+            perror("Failed to allocate memory");
+            exit(1);
+        }
+    }
+    memcpy(&search->query[search->query_len], text, len);
+    search->query_len += len;
+}
+
+// Show word `current` of completion in place of what was inserted
+static void show_completion(State *const state, const uint32_t current) {
+    Completion *const completion = &state->completion;
+    uint32_t len;
+    const char *const word = completions_word(
+        state->completions, completion->first + current, &len
+    );
+    const uint32_t start = state->snap.cursor - completion->inserted;
+    splice_input(
+        state,
+        start,
+        completion->inserted,
+        &word[completion->prefix_len],
+        len - completion->prefix_len
+    );
+    completion->current = current;
+    completion->inserted = len - completion->prefix_len;
+    state->snap.cursor = start + completion->inserted;
+    update_offset_right(&state->snap, state->width);
+}
+
+// Complete word before cursor with what all matching words start with
+// Repeating shows each matching word in turn
+static void complete_word(State *const state) {
+    Completion *const completion = &state->completion;
+    if (completion->active) {
+        // After the common prefix, `current` is `count`, so this starts at 0
+        if (completion->count > 1) {
+            const uint32_t next = completion->current + 1;
+            show_completion(state, next < completion->count ? next : 0);
+        }
+        return;
+    }
+
+    const Buffer *const input = &state->snap.input;
+    const uint32_t cursor = state->snap.cursor;
+    if (state->completions == NULL || cursor == 0
+        || char_class(buffer_get(input, cursor - 1)) == CLASS_SPACE)
+    {
+        return;
+    }
+    const uint32_t start = find_word_back(&state->snap, false);
+    const uint32_t prefix_len = cursor - start;
+    char *const prefix = mem_realloc(NULL, prefix_len);
+    if (prefix == NULL) {
+        perror("Failed to allocate completion");
+        exit(1);
+    }
+    buffer_copy(input, start, prefix_len, prefix);
+    uint32_t count;
+    const uint32_t first =
+        completions_find(state->completions, prefix, prefix_len, &count);
+    mem_free(prefix);
+    if (count == 0) {
+        return;
+    }
+
+    *completion = (Completion) {
+        .active = true,
+        .first = first,
+        .count = count,
+        .current = count,
+        .prefix_len = prefix_len,
+        .inserted = 0,
+    };
+    // Words are sorted, so the first and last share the least
+    uint32_t first_len;
+    uint32_t last_len;
+    const char *const first_word =
+        completions_word(state->completions, first, &first_len);
+    const char *const last_word =
+        completions_word(state->completions, first + count - 1, &last_len);
+    uint32_t common = prefix_len;
+    while (common < first_len && common < last_len
+           && first_word[common] == last_word[common])
+    {
+        ++common;
+    }
+    while (common > prefix_len && common < first_len
+           && utf8_continuation(first_word[common]))
+    {
+        --common;
+    }
+    if (count > 1 && common > prefix_len) {
+        splice_input(
+            state,
+            cursor,
+            0,
+            &first_word[prefix_len],
+            common - prefix_len
+        );
+        completion->inserted = common - prefix_len;
+        state->snap.cursor += completion->inserted;
+        update_offset_right(&state->snap, state->width);
+    } else {
+        show_completion(state, 0);
+    }
+}
+
+bool in_visual_select(const State *const state, const uint32_t index) {
+    if (state->snap.cursor == state->visual_start) {
+        return index == state->visual_start;
+    }
+    if (state->snap.cursor < state->visual_start) {
+        return index >= state->snap.cursor && index <= state->visual_start;
+    }
+    return index >= state->visual_start && index <= state->snap.cursor;
+}
+
+// Insert pasted text as a single edit
+static void add_key(KeyList *const list, const int key) {
+    if (list->len >= list->capacity) {
+        list->capacity = list->capacity > 0 ? list->capacity * 2 : 64;
+        list->keys = mem_realloc(list->keys, list->capacity * sizeof(int));
+        if (list->keys == NULL) {
+            perror("Failed to allocate keys");
+            exit(1);
+        }
+    }
+    list->keys[list->len++] = key;
+}
+
+// Keys typed by the user, not replayed, are recorded
+static void record_key(State *const state, const int key) {
+    if (state->recording != REGISTER_NONE && state->replay_depth == 0) {
+        add_key(&state->registers[state->recording], key);
+    }
+}
+
+// Add key to change, unless repeating one
+// A change starts with a key pressed in normal mode
+static void begin_key(State *const state, const int key) {
+    if (state->repeating) {
+        return;
+    }
+    // Count and operator keys start the change they belong to
+    if (state->mode == MODE_NORMAL && state->count == 0
+        && state->operator == 0)
+    {
+        state->change.len = 0;
+        state->change_edits = state->edits;
+    }
+    add_key(&state->change, key);
+}
+
+// Recalling lines replaces the line, but is not a change to repeat
+static bool is_repeatable(const int key) {
+    switch (key) {
+        case 'k':
+        case 'j':
+        case K_UP:
+        case K_DOWN:
+        case '/':
+            return false;
+        default:
+            return true;
+    }
+}
+
+// Keep keys of change for `.` once back in normal mode, if line was edited
+static void end_key(State *const state) {
+    if (state->repeating || state->mode != MODE_NORMAL || state->count > 0
+        || state->operator != 0)
+    {
+        return;
+    }
+    if (state->edits != state->change_edits && state->change.len > 0
+        && is_repeatable(state->change.keys[0]))
+    {
+        const KeyList last = state->last_change;
+        state->last_change = state->change;
+        state->change = last;
+    }
+    state->change.len = 0;
+    state->change_edits = state->edits;
+}
+
+// Handle keys back to back, committing their edits as one change
+static enum Action replay_keys(
+    State *const state,
+    const int *const keys,
+    const uint32_t len
+) {
+    ++state->replay_depth;
+    enum Action action = ACTION_NONE;
+    for (uint32_t i = 0; i < len && action == ACTION_NONE; ++i) {
+        if (keys[i] != K_PASTE_START) {
+            action = handle_key(state, keys[i]);
+            continue;
+        }
+        char *const text = mem_realloc(NULL, len - i);
+        if (text == NULL) {
+            perror("Failed to allocate paste");
+            exit(1);
+        }
+        uint32_t text_len = 0;
+        for (++i; i < len && keys[i] != K_PASTE_END; ++i) {
+            text[text_len++] = keys[i];
+        }
+        paste_input(state, text, text_len);
+        mem_free(text);
+    }
+    --state->replay_depth;
+    // Insert is committed when it ends
+    if (state->mode == MODE_NORMAL) {
+        push_history(state);
+    }
+    return action;
+}
+
+static int register_index(const int key) {
+    if (key >= 'a' && key <= 'z') {
+        return key - 'a';
+    }
+    return REGISTER_NONE;
+}
+
+static enum Action replay_register(State *const state, const int index) {
+    // A register replaying itself would never end
+    if (index == REGISTER_NONE || state->replaying & (1u << index)) {
+        return ACTION_NONE;
+    }
+    const uint32_t bit = 1u << index;
+    state->last_register = index;
+    state->replaying |= bit;
+    const KeyList *const keys = &state->registers[index];
+    const enum Action action = replay_keys(state, keys->keys, keys->len);
+    state->replaying &= ~bit;
+    return action;
+}
+
+static enum Action repeat_change(State *const state) {
+    if (state->last_change.len == 0) {
+        return ACTION_NONE;
+    }
+    state->repeating = true;
+    const KeyList *const keys = &state->last_change;
+    const enum Action action = replay_keys(state, keys->keys, keys->len);
+    state->repeating = false;
+    return action;
+}
+
+void paste_input(
+    State *const state,
+    const char *const text,
+    const uint32_t len
+) {
+    if (len == 0) {
+        return;
+    }
+    // Kept as bytes, which are never mistaken for paste keys
+    record_key(state, K_PASTE_START);
+    begin_key(state, K_PASTE_START);
+    for (uint32_t i = 0; i < len; ++i) {
+        record_key(state, (unsigned char) text[i]);
+        if (!state->repeating) {
+            add_key(&state->change, (unsigned char) text[i]);
+        }
+    }
+    record_key(state, K_PASTE_END);
+    if (!state->repeating) {
+        add_key(&state->change, K_PASTE_END);
+    }
+    state->completion.active = false;
+    switch (state->mode) {
+        case MODE_INSERT:
+            splice_input(state, state->snap.cursor, 0, text, len);
+            state->snap.cursor += len;
+            update_offset_right(&state->snap, state->width);
+            break;
+        case MODE_NORMAL:
+            splice_input(state, state->snap.cursor, 0, text, len);
+            state->snap.cursor =
+                prev_char(&state->snap.input, state->snap.cursor + len);
+            update_offset_right(&state->snap, state->width);
+            push_history(state);
+            break;
+        default:
+            break;
+    }
+    end_key(state);
+}
+
+// Index after `count` characters from `index`, stopping at end of line
+static uint32_t skip_chars(
+    const Buffer *const input,
+    uint32_t index,
+    const uint32_t count
+) {
+    const uint32_t len = buffer_len(input);
+    for (uint32_t i = 0; i < count && index < len; ++i) {
+        index = next_char(input, index);
+    }
+    return index;
+}
+
+// Whether a word starts at `index`, rather than a word motion having stopped
+// at the end of the line
+static bool is_word_start(
+    const Buffer *const input,
+    const uint32_t index,
+    const bool full_word
+) {
+    if (index >= buffer_len(input)) {
+        return false;
+    }
+    const uint8_t class = char_class(buffer_get(input, index));
+    if (class == CLASS_SPACE) {
+        return false;
+    }
+    if (index == 0) {
+        return true;
+    }
+    const uint8_t before = char_class(buffer_get(input, index - 1));
+    return full_word ? before == CLASS_SPACE : before != class;
+}
+
+// Whether the word at `index` ends with the character there
+static bool is_word_end(
+    const Buffer *const input,
+    const uint32_t index,
+    const bool full_word
+) {
+    const uint32_t next = next_char(input, index);
+    if (next >= buffer_len(input)) {
+        return true;
+    }
+    const uint8_t class = char_class(buffer_get(input, next));
+    return full_word ? class == CLASS_SPACE
+                     : class != char_class(buffer_get(input, index));
+}
+
+// Move cursor by motion `count` times, without scrolling
+// Only the cursor index changes, so a count costs no more than the motions
+// Returns times moved, fewer than `count` if it could go no further, or -1 if
+// key is not a motion
+static int move_cursor(
+    State *const state,
+    const int key,
+    const uint32_t count
+) {
+    const Buffer *const input = &state->snap.input;
+    uint32_t *const cursor = &state->snap.cursor;
+    switch (key) {
+        case '^':
+        case '_':
+            *cursor = buffer_find_class(
+                input, 0, buffer_len(input), CLASS_NONSPACE
+            );
+            return 1;
+        case '0':
+            *cursor = 0;
+            return 1;
+        case '$':
+            *cursor = last_char(input);
+            return 1;
+        case 'h':
+        case K_LEFT:
+        case 'l':
+        case K_RIGHT:
+        case 'w':
+        case 'e':
+        case 'b':
+        case 'W':
+        case 'E':
+        case 'B':
+            break;
+        default:
+            return -1;
+    }
+    uint32_t moved = 0;
+    for (; moved < count; ++moved) {
+        const uint32_t from = *cursor;
+        switch (key) {
+            case 'h':
+            case K_LEFT:
+                *cursor = prev_char(input, *cursor);
+                break;
+            case 'l':
+            case K_RIGHT:
+                if (next_char(input, *cursor) < buffer_len(input)) {
+                    *cursor = next_char(input, *cursor);
+                }
+                break;
+            case 'w':
+            case 'W':
+                *cursor = find_word_start(&state->snap, key == 'W');
+                break;
+            case 'e':
+            case 'E':
+                *cursor = find_word_end(&state->snap, key == 'E');
+                break;
+            default:
+                *cursor = find_word_back(&state->snap, key == 'B');
+                break;
+        }
+        if (*cursor == from) {
+            break;
+        }
+    }
+    return moved;
+}
+
+// Bytes from `start` to `end` which an operator acts on with a motion
+// Returns false if key is not a motion
+static bool find_range(
+    State *const state,
+    const int key,
+    uint32_t count,
+    uint32_t *const start,
+    uint32_t *const end
+) {
+    const Buffer *const input = &state->snap.input;
+    const uint32_t len = buffer_len(input);
+    const uint32_t cursor = state->snap.cursor;
+    // Doubled operator acts on the whole line
+    if (key == state->operator) {
+        *start = 0;
+        *end = len;
+        return true;
+    }
+    // Like `x`, so the last character can be reached
+    if (key == 'l' || key == K_RIGHT) {
+        *start = cursor;
+        *end = skip_chars(input, cursor, count);
+        return true;
+    }
+    int motion = key;
+    // `cw` on a word changes to its end, like `ce`, but counting the word
+    // under the cursor
+    if (state->operator == 'c' && (key == 'w' || key == 'W') && cursor < len
+        && char_class(buffer_get(input, cursor)) != CLASS_SPACE)
+    {
+        motion = key == 'w' ? 'e' : 'E';
+        if (is_word_end(input, cursor, key == 'W')) {
+            --count;
+        }
+    }
+    const int moved = move_cursor(state, motion, count);
+    if (moved < 0) {
+        return false;
+    }
+    const uint32_t target = state->snap.cursor;
+    state->snap.cursor = cursor;
+    *start = min(cursor, target);
+    *end = *start + difference(cursor, target);
+    switch (motion) {
+        case 'e':
+        case 'E':
+        case '$':
+            // Includes character moved to
+            *end = skip_chars(input, *end, 1);
+            break;
+        case 'w':
+        case 'W':
+            // No word after the last one to stop before
+            if ((uint32_t) moved < count
+                || !is_word_start(input, target, motion == 'W'))
+            {
+                *end = len;
+            }
+            break;
+        default:
+            break;
+    }
+    return true;
+}
+
+// Keep bytes deleted or yanked, for `p` and `P`
+static void yank_text(
+    State *const state,
+    const uint32_t start,
+    const uint32_t len
+) {
+    if (len == 0) {
+        return;
+    }
+    if (len > state->yanked_capacity) {
+        state->yanked = mem_realloc(state->yanked, len);
+        if (state->yanked == NULL) {
+            perror("Failed to allocate yanked text");
+            exit(1);
+        }
+        state->yanked_capacity = len;
+    }
+    buffer_copy(&state->snap.input, start, len, state->yanked);
+    state->yanked_len = len;
+}
+
+// Delete bytes as one splice, leaving cursor where they were
+static void delete_range(
+    State *const state,
+    const uint32_t start,
+    const uint32_t end
+) {
+    yank_text(state, start, end - start);
+    if (end > start) {
+        splice_input(state, start, end - start, NULL, 0);
+    }
+    state->snap.cursor = start;
+}
+
+// Keep cursor on a character in normal mode
+static void clamp_cursor(State *const state) {
+    const Buffer *const input = &state->snap.input;
+    if (state->snap.cursor >= buffer_len(input)) {
+        state->snap.cursor = last_char(input);
+    }
+}
+
+// Apply pending operator over a motion
+// However large the count, this is one range, one splice and one entry in
+// history
+static void apply_operator(
+    State *const state,
+    const int key,
+    const uint32_t count
+) {
+    uint32_t start;
+    uint32_t end;
+    const bool found = find_range(state, key, count, &start, &end);
+    const int operator = state->operator;
+    state->operator = 0;
+    if (!found) {
+        return;
+    }
+    switch (operator) {
+        case 'y':
+            yank_text(state, start, end - start);
+            state->snap.cursor = start;
+            update_offset_left(&state->snap);
+            break;
+        case 'd':
+            delete_range(state, start, end);
+            clamp_cursor(state);
+            update_offset_left(&state->snap);
+            push_history(state);
+            break;
+        case 'c':
+            // Committed with the inserted text, once insert ends
+            delete_range(state, start, end);
+            state->mode = MODE_INSERT;
+            update_offset_left(&state->snap);
+            break;
+        default:
+            break;
+    }
+}
+
+// Insert kept text `count` times as one splice, after or before the cursor
+static void put_text(State *const state, const bool after, uint32_t count) {
+    Buffer *const input = &state->snap.input;
+    const uint32_t yanked_len = state->yanked_len;
+    if (yanked_len == 0) {
+        return;
+    }
+    // Keep line length well within a byte index
+    count = min(count, subsat(UINT32_MAX / 2, buffer_len(input)) / yanked_len);
+    if (count == 0) {
+        return;
+    }
+    const uint32_t len = yanked_len * count;
+    char *const text = mem_realloc(NULL, len);
+    if (text == NULL) {
+        perror("Failed to allocate memory");
+        exit(1);
+    }
+    for (uint32_t i = 0; i < count; ++i) {
+        memcpy(&text[i * yanked_len], state->yanked, yanked_len);
+    }
+    const uint32_t index = after && buffer_len(input) > 0
+        ? next_char(input, state->snap.cursor)
+        : state->snap.cursor;
+    splice_input(state, index, 0, text, len);
+    mem_free(text);
+    state->snap.cursor = prev_char(input, index + len);
+    update_offset_right(&state->snap, state->width);
+    push_history(state);
+}
+
+static enum Action dispatch_key(State *const state, const int key) {
+    Buffer *const input = &state->snap.input;
+    if (key != K_TAB) {
+        state->completion.active = false;
+    }
+
+    switch (state->mode) {
+        case MODE_NORMAL: {
+            // Digits make a count, though `0` alone is a motion
+            if ((key >= '1' && key <= '9')
+                || (key == '0' && state->count > 0))
+            {
+                state->count = min(state->count * 10 + (key - '0'), COUNT_MAX);
+                break;
+            }
+            const uint32_t count = state->count > 0 ? state->count : 1;
+            state->count = 0;
+            // Counts before and after an operator multiply
+            if (state->operator != 0) {
+                const uint64_t total = (uint64_t) count * state->operator_count;
+                apply_operator(
+                    state, key, total < COUNT_MAX ? total : COUNT_MAX
+                );
+                break;
+            }
+            switch (key) {
+                case K_RETURN:
+                    return ACTION_SUBMIT;
+                case 'r':
+                    state->mode = MODE_REPLACE;
+                    break;
+                case 'v':
+                    state->mode = MODE_VISUAL;
+                    state->visual_start = state->snap.cursor;
+                    break;
+                case 'V':
+                    state->mode = MODE_VISUAL;
+                    state->visual_start = 0;
+                    state->snap.cursor = last_char(input);
+                    break;
+                case 'i':
+                    state->mode = MODE_INSERT;
+                    break;
+                case 'a':
+                    state->mode = MODE_INSERT;
+                    state->snap.cursor = next_char(input, state->snap.cursor);
+                    break;
+                case 'I':
+                    state->mode = MODE_INSERT;
+                    state->snap.cursor = 0;
+                    state->snap.offset = 0;
+                    break;
+                case 'A':
+                    state->mode = MODE_INSERT;
+                    state->snap.cursor = buffer_len(input);
+                    state->snap.offset =
+                        subsat(total_columns(input) + 1, state->width);
+                    break;
+                case 'h':
+                case K_LEFT:
+                case 'b':
+                case 'B':
+                case '^':
+                case '_':
+                    move_cursor(state, key, count);
+                    update_offset_left(&state->snap);
+                    break;
+                case 'l':
+                case K_RIGHT:
+                case 'w':
+                case 'e':
+                case 'W':
+                case 'E':
+                    move_cursor(state, key, count);
+                    update_offset_right(&state->snap, state->width);
+                    break;
+                case '0':
+                    state->snap.cursor = 0;
+                    state->snap.offset = 0;
+                    break;
+                case '$':
+                    state->snap.cursor = last_char(input);
+                    state->snap.offset = subsat(
+                        index_column(input, state->snap.cursor) + 2,
+                        state->width
+                    );
+                    break;
+                case 'd':
+                case 'c':
+                case 'y':
+                    state->operator = key;
+                    state->operator_count = count;
+                    break;
+                case 'D':
+                    delete_range(state, state->snap.cursor, buffer_len(input));
+                    push_history(state);
+                    break;
+                case 'x':
+                    if (buffer_len(input) > 0) {
+                        delete_range(
+                            state,
+                            state->snap.cursor,
+                            skip_chars(input, state->snap.cursor, count)
+                        );
+                        clamp_cursor(state);
+                        update_offset_left(&state->snap);
+                        push_history(state);
+                    }
+                    break;
+                case 'p':
+                case 'P':
+                    put_text(state, key == 'p', count);
+                    break;
+                case 'u':
+                    for (uint32_t i = 0; i < count; ++i) {
+                        undo_history(state);
+                    }
+                    break;
+                case CTRL('r'):
+                    for (uint32_t i = 0; i < count; ++i) {
+                        redo_history(state);
+                    }
+                    break;
+                case 'k':
+                case K_UP:
+                    recall_older(state);
+                    break;
+                case 'j':
+                case K_DOWN:
+                    recall_newer(state);
+                    break;
+                case '/':
+                    start_search(state);
+                    break;
+                default:
+                    break;
+            }
+        } break;
+
+        case MODE_INSERT:
+            switch (key) {
+                case K_ESCAPE:
+                    state->mode = MODE_NORMAL;
+                    state->snap.cursor = prev_char(input, state->snap.cursor);
+                    push_history(state);
+                    break;
+                case K_RETURN:
+                    return ACTION_SUBMIT;
+                case K_LEFT:
+                    if (state->snap.cursor > 0) {
+                        state->snap.cursor =
+                            prev_char(input, state->snap.cursor);
+                        update_offset_left(&state->snap);
+                    }
+                    break;
+                case K_RIGHT:
+                    if (state->snap.cursor < buffer_len(input)) {
+                        state->snap.cursor =
+                            next_char(input, state->snap.cursor);
+                        update_offset_right(&state->snap, state->width);
+                    }
+                    break;
+                case K_UP:
+                    recall_older(state);
+                    break;
+                case K_DOWN:
+                    recall_newer(state);
+                    break;
+                case CTRL('r'):
+                    start_search(state);
+                    break;
+                case K_TAB:
+                    complete_word(state);
+                    break;
+                case K_BACKSPACE:
+                    if (state->snap.cursor > 0 && buffer_len(input) > 0) {
+                        const uint32_t prev =
+                            prev_char(input, state->snap.cursor);
+                        splice_input(
+                            state, prev, state->snap.cursor - prev, NULL, 0
+                        );
+                        state->snap.cursor = prev;
+                        update_offset_left(&state->snap);
+                    }
+                    break;
+                default: {
+                    const uint32_t len = type_char(state, key);
+                    if (len > 0) {
+                        splice_input(
+                            state, state->snap.cursor, 0, state->typed, len
+                        );
+                        state->snap.cursor += len;
+                        update_offset_right(&state->snap, state->width);
+                    }
+                } break;
+            };
+            break;
+
+        case MODE_REPLACE:
+            switch (key) {
+                case K_ESCAPE:
+                    state->mode = MODE_NORMAL;
+                    break;
+                default: {
+                    const uint32_t len = type_char(state, key);
+                    if (len > 0 && state->snap.cursor < buffer_len(input)) {
+                        splice_input(
+                            state,
+                            state->snap.cursor,
+                            next_char(input, state->snap.cursor)
+                                - state->snap.cursor,
+                            state->typed,
+                            len
+                        );
+                        state->mode = MODE_NORMAL;
+                        push_history(state);
+                    }
+                } break;
+            }
+            break;
+
+        case MODE_VISUAL: {
+            // Selection includes whole character at either end
+            const uint32_t start =
+                min(state->snap.cursor, state->visual_start);
+            const uint32_t last =
+                start + difference(state->snap.cursor, state->visual_start);
+            const uint32_t size = next_char(input, last) - start;
+            switch (key) {
+                case K_ESCAPE:
+                    state->mode = MODE_NORMAL;
+                    break;
+                case 'h':
+                case K_LEFT:
+                    if (state->snap.cursor > 0) {
+                        state->snap.cursor =
+                            prev_char(input, state->snap.cursor);
+                        update_offset_left(&state->snap);
+                    }
+                    break;
+                case 'l':
+                case K_RIGHT:
+                    if (next_char(input, state->snap.cursor)
+                        < buffer_len(input))
+                    {
+                        state->snap.cursor =
+                            next_char(input, state->snap.cursor);
+                        update_offset_right(&state->snap, state->width);
+                    }
+                    break;
+                case 'w':
+                    state->snap.cursor = find_word_start(&state->snap, false);
+                    update_offset_right(&state->snap, state->width);
+                    break;
+                case 'e':
+                    state->snap.cursor = find_word_end(&state->snap, false);
+                    update_offset_right(&state->snap, state->width);
+                    break;
+                case 'b':
+                    state->snap.cursor = find_word_back(&state->snap, false);
+                    update_offset_left(&state->snap);
+                    break;
+                case 'W':
+                    state->snap.cursor = find_word_start(&state->snap, true);
+                    update_offset_right(&state->snap, state->width);
+                    break;
+                case 'E':
+                    state->snap.cursor = find_word_end(&state->snap, true);
+                    update_offset_right(&state->snap, state->width);
+                    break;
+                case 'B':
+                    state->snap.cursor = find_word_back(&state->snap, true);
+                    update_offset_left(&state->snap);
+                    break;
+                case '^':
+                case '_':
+                    state->snap.cursor = buffer_find_class(
+                        input, 0, buffer_len(input), CLASS_NONSPACE
+                    );
+                    update_offset_left(&state->snap);
+                    break;
+                case '0':
+                    state->snap.cursor = 0;
+                    state->snap.offset = 0;
+                    break;
+                case '$':
+                    state->snap.cursor = last_char(input);
+                    state->snap.offset = subsat(
+                        index_column(input, state->snap.cursor) + 2,
+                        state->width
+                    );
+                    break;
+                case 'd':
+                case 'x': {
+                    delete_range(state, start, start + size);
+                    clamp_cursor(state);
+                    state->mode = MODE_NORMAL;
+                    push_history(state);
+                } break;
+                case 'y':
+                    yank_text(state, start, size);
+                    state->snap.cursor = start;
+                    state->mode = MODE_NORMAL;
+                    update_offset_left(&state->snap);
+                    break;
+                case 'u': {
+                    change_case(state, start, size, false);
+                    state->snap.cursor = start;
+                    state->mode = MODE_NORMAL;
+                    push_history(state);
+                }; break;
+                case 'U': {
+                    change_case(state, start, size, true);
+                    state->snap.cursor = start;
+                    state->mode = MODE_NORMAL;
+                    push_history(state);
+                }; break;
+                default:
+                    break;
+            }
+        } break;
+
+        case MODE_SEARCH: {
+            Search *const search = &state->search;
+            switch (key) {
+                case K_ESCAPE:
+                    end_search(state, false);
+                    break;
+                case K_RETURN:
+                    end_search(state, true);
+                    break;
+                case CTRL('r'):
+                    // Next older match
+                    if (search->match != RECALL_NONE && search->match > 0) {
+                        update_search(state, search->match - 1);
+                    }
+                    break;
+                case K_BACKSPACE:
+                    // Remove last character, then search from newest again
+                    while (search->query_len > 0
+                           && utf8_continuation(
+                               search->query[search->query_len - 1]
+                           ))
+                    {
+                        --search->query_len;
+                    }
+                    if (search->query_len > 0) {
+                        --search->query_len;
+                    }
+                    update_search(state, state->recall->count - 1);
+                    break;
+                default: {
+                    const uint32_t len = type_char(state, key);
+                    if (len > 0) {
+                        add_to_query(state, state->typed, len);
+                        // Longer query can only match the same or older
+                        update_search(
+                            state,
+                            search->match != RECALL_NONE
+                                ? search->match
+                                : state->recall->count - 1
+                        );
+                    }
+                } break;
+            }
+        } break;
+    }
+    return ACTION_NONE;
+}
+
+enum Action handle_key(State *const state, const int key) {
+    // Register to record into
+    if (state->pending == 'q') {
+        state->pending = 0;
+        const int index = register_index(key);
+        // `q` followed by anything else quits
+        if (index == REGISTER_NONE) {
+            return ACTION_QUIT;
+        }
+        state->recording = index;
+        state->registers[index].len = 0;
+        return ACTION_NONE;
+    }
+    if (state->mode == MODE_NORMAL && key == 'q' && state->pending == 0
+        && state->count == 0 && state->operator == 0)
+    {
+        if (state->recording != REGISTER_NONE) {
+            state->recording = REGISTER_NONE;
+        } else {
+            state->pending = key;
+        }
+        return ACTION_NONE;
+    }
+
+    record_key(state, key);
+    // Register to replay
+    if (state->pending == '@') {
+        state->pending = 0;
+        return replay_register(
+            state, key == '@' ? state->last_register : register_index(key)
+        );
+    }
+    if (state->mode == MODE_NORMAL) {
+        switch (key) {
+            // Neither takes a count or follows an operator
+            case '@':
+                state->count = 0;
+                state->operator = 0;
+                state->pending = key;
+                return ACTION_NONE;
+            case '.':
+                state->count = 0;
+                state->operator = 0;
+                return repeat_change(state);
+            default:
+                break;
+        }
+    }
+
+    begin_key(state, key);
+    const enum Action action = dispatch_key(state, key);
+    end_key(state);
+    return action;
+}
@@ -0,0 +1,184 @@
+#ifndef EDITOR_H
+#define EDITOR_H
+
+#include "buffer.h"
+#include "completions.h"
+#include "history.h"
+#include "recall.h"
+#include "utf8.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define CTRL(key) ((key) - 0x60)
+#define K_ESCAPE (0x1b)
+#define K_DOWN (0x102)
+#define K_UP (0x103)
+#define K_LEFT (0x104)
+#define K_RIGHT (0x105)
+#define K_BACKSPACE (0x107)
+#define K_TAB (0x09)
+#define K_RETURN (0x0a)
+// Above any ncurses key code
+#define K_PASTE_START (0x200)
+#define K_PASTE_END (0x201)
+
+// Registers `a` to `z`
+#define REGISTER_COUNT (26)
+#define REGISTER_NONE (-1)
+
+extern const uint32_t CURSOR_RIGHT_EMPTY;
+
+enum VimMode {
+    MODE_NORMAL,
+    MODE_INSERT,
+    MODE_REPLACE,
+    MODE_VISUAL,
+    MODE_SEARCH,
+};
+#define MODE_COUNT (MODE_SEARCH + 1)
+
+// What the caller should do after a key is handled
+enum Action {
+    ACTION_NONE,
+    ACTION_SUBMIT,
+    ACTION_QUIT,
+};
+
+// `cursor` is a byte index, always at the start of a character
+// `offset` is the first visible display column
+typedef struct Snap {
+    Buffer input;
+    uint32_t cursor;
+    uint32_t offset;
+} Snap;
+
+// Incremental search of recalled lines
+typedef struct Search {
+    enum VimMode return_mode;
+    char *query;
+    uint32_t query_len;
+    uint32_t query_capacity;
+    uint32_t match;  // Entry shown, or `RECALL_NONE`
+    uint32_t position;
+    bool failing;  // Query not found, so older match is still shown
+} Search;
+
+// Tab completion of the word before the cursor
+typedef struct Completion {
+    bool active;  // Last key was Tab, so Tab shows the next word
+    uint32_t first;
+    uint32_t count;
+    uint32_t current;     // Word shown, or `count` if only a common prefix
+    uint32_t prefix_len;  // Bytes of word typed before completing
+    uint32_t inserted;    // Bytes inserted before cursor
+} Completion;
+
+// Keys recorded into a register, or making up a change
+// Pastes are kept as the paste keys around the pasted bytes
+typedef struct KeyList {
+    int *keys;
+    uint32_t len;
+    uint32_t capacity;
+} KeyList;
+
+typedef struct State {
+    enum VimMode mode;
+    Snap snap;
+    uint32_t visual_start;
+    History history;
+    uint32_t width;  // Visible width of input
+    // Bytes of a character being typed
+    char typed[UTF8_MAX];
+    uint32_t typed_len;
+    const char *placeholder;
+    const char *filename;
+    int output_fd;  // Written instead of a file if not negative
+    // Lines from previous sessions, or NULL
+    Recall *recall;
+    // Entry shown, or `RECALL_NONE` if editing a new line
+    uint32_t recall_index;
+    // Line being edited, kept while recalling or searching
+    char *draft;
+    uint32_t draft_len;
+    uint32_t draft_cursor;
+    uint32_t draft_offset;
+    Search search;
+    // Words to complete, or NULL
+    const Completions *completions;
+    Completion completion;
+    KeyList registers[REGISTER_COUNT];
+    int recording;  // Register, or `REGISTER_NONE`
+    int last_register;
+    uint32_t replaying;  // Bit for each register being replayed
+    int pending;         // `q` or `@` waiting for a register, or 0
+    uint32_t count;      // Count typed before a command, or 0
+    int operator;        // `d`, `c` or `y` waiting for a motion, or 0
+    uint32_t operator_count;
+    // Text last deleted or yanked, for `p` and `P`
+    char *yanked;
+    uint32_t yanked_len;
+    uint32_t yanked_capacity;
+    // Keys since last in normal mode, kept for `.` if they edited the line
+    KeyList change;
+    KeyList last_change;
+    bool repeating;
+    uint32_t edits;  // Number of splices so far
+    uint32_t change_edits;
+    // Edits while replaying keys are committed as one change afterwards
+    uint32_t replay_depth;
+} State;
+
+uint32_t subsat(const uint32_t lhs, const uint32_t rhs);
+
+uint32_t min(const uint32_t lhs, const uint32_t rhs);
+
+uint32_t difference(const uint32_t lhs, const uint32_t rhs);
+
+// `value` is used in place, and must outlive state
+// Returns false if out of memory, leaving state which must still be freed
+bool editor_init(
+    State *const state,
+    const char *const value,
+    const uint32_t value_len,
+    const uint32_t width
+);
+
+// Free everything but `recall` and `completions`, which are not owned
+void editor_free(State *const state);
+
+const char *mode_name(enum VimMode mode);
+
+// Word motions return new cursor position
+int find_word_start(const Snap *const snap, const bool full_word);
+
+int find_word_end(const Snap *const snap, const bool full_word);
+
+int find_word_back(const Snap *const snap, const bool full_word);
+
+// Replace `removed_len` bytes at `index` with `text`
+void splice_input(
+    State *const state,
+    const uint32_t index,
+    uint32_t removed_len,
+    const char *const text,
+    const uint32_t text_len
+);
+
+void push_history(State *const state);
+
+void undo_history(State *const state);
+
+void redo_history(State *const state);
+
+bool in_visual_select(const State *const state, const uint32_t index);
+
+void paste_input(
+    State *const state,
+    const char *const text,
+    const uint32_t len
+);
+
+enum Action handle_key(State *const state, const int key);
+
+#endif
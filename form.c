@@ -0,0 +1,219 @@
+#define _GNU_SOURCE  // getline
+
+#include "form.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void *allocate(void *const ptr, const size_t size) {
+    void *const result = realloc(ptr, size);
+    if (result == NULL) {
+        perror("Failed to allocate form");
+        exit(1);
+    }
+    return result;
+}
+
+// Remove spaces around text, in place
+static char *trim(char *text) {
+    while (*text == ' ' || *text == '\t') {
+        ++text;
+    }
+    size_t len = strlen(text);
+    while (len > 0
+           && (text[len - 1] == ' ' || text[len - 1] == '\t'
+               || text[len - 1] == '\n' || text[len - 1] == '\r'))
+    {
+        --len;
+    }
+    text[len] = '\0';
+    return text;
+}
+
+static char *copy(const char *const text) {
+    const size_t len = strlen(text);
+    char *const result = allocate(NULL, len + 1);
+    memcpy(result, text, len + 1);
+    return result;
+}
+
+#define spec_panic(line, ...)                                  \
+    {                                                          \
+        fprintf(stderr, "Invalid form spec, line %u: ", line); \
+        fprintf(stderr, __VA_ARGS__);                          \
+        exit(1);                                               \
+    }
+
+// Where key of field is kept, or NULL if key is unknown
+static char **field_key(FormField *const field, const char *const key) {
+    if (!strcmp(key, "value")) {
+        return &field->value;
+    }
+    if (!strcmp(key, "placeholder")) {
+        return &field->placeholder;
+    }
+    if (!strcmp(key, "history")) {
+        return &field->history;
+    }
+    if (!strcmp(key, "output")) {
+        return &field->output;
+    }
+    return NULL;
+}
+
+void form_read(Form *const form, const char *const filename) {
+    FILE *const file = fopen(filename, "r");
+    if (file == NULL) {
+        perror("Failed to open form spec");
+        exit(1);
+    }
+
+    form->fields = NULL;
+    form->count = 0;
+    uint32_t capacity = 0;
+    char *line = NULL;
+    size_t line_capacity = 0;
+    uint32_t number = 0;
+    while (getline(&line, &line_capacity, file) >= 0) {
+        ++number;
+        char *const text = trim(line);
+        if (text[0] == '\0' || text[0] == '#') {
+            continue;
+        }
+
+        if (text[0] == '[') {
+            const size_t len = strlen(text);
+            if (text[len - 1] != ']') {
+                spec_panic(number, "expected `]`.\n");
+            }
+            text[len - 1] = '\0';
+            const char *const label = trim(&text[1]);
+            if (label[0] == '\0') {
+                spec_panic(number, "label is empty.\n");
+            }
+            for (uint32_t i = 0; i < form->count; ++i) {
+                if (!strcmp(form->fields[i].label, label)) {
+                    spec_panic(number, "label `%s` is repeated.\n", label);
+                }
+            }
+            if (form->count >= capacity) {
+                capacity = capacity > 0 ? capacity * 2 : 8;
+                form->fields =
+                    allocate(form->fields, capacity * sizeof(FormField));
+            }
+            form->fields[form->count++] = (FormField) {
+                .label = copy(label),
+                .value = NULL,
+                .placeholder = NULL,
+                .history = NULL,
+                .output = NULL,
+            };
+            continue;
+        }
+
+        char *const equals = strchr(text, '=');
+        if (equals == NULL) {
+            spec_panic(number, "expected `[label]` or `key = value`.\n");
+        }
+        *equals = '\0';
+        const char *const key = trim(text);
+        if (form->count == 0) {
+            spec_panic(number, "`%s` is not in a field.\n", key);
+        }
+        char **const slot = field_key(&form->fields[form->count - 1], key);
+        if (slot == NULL) {
+            spec_panic(number, "unknown key `%s`.\n", key);
+        }
+        if (*slot != NULL) {
+            spec_panic(number, "`%s` is repeated.\n", key);
+        }
+        *slot = copy(trim(&equals[1]));
+    }
+    free(line);
+    fclose(file);
+
+    if (form->count == 0) {
+        fprintf(stderr, "Form spec has no fields.\n");
+        exit(1);
+    }
+}
+
+// Text which grows as it is written
+typedef struct Text {
+    char *bytes;
+    uint32_t len;
+    uint32_t capacity;
+} Text;
+
+static void append(Text *const text, const char *const bytes, uint32_t len) {
+    if (text->len + len > text->capacity) {
+        while (text->len + len > text->capacity) {
+            text->capacity = text->capacity > 0 ? text->capacity * 2 : 256;
+        }
+        text->bytes = allocate(text->bytes, text->capacity);
+    }
+    memcpy(&text->bytes[text->len], bytes, len);
+    text->len += len;
+}
+
+// Write bytes as a JSON string, escaping quotes and control characters
+static void append_json(Text *const text, const char *bytes, uint32_t len) {
+    append(text, "\"", 1);
+    for (uint32_t i = 0; i < len; ++i) {
+        const unsigned char byte = bytes[i];
+        if (byte == '"' || byte == '\\') {
+            const char escaped[2] = {'\\', byte};
+            append(text, escaped, 2);
+        } else if (byte < 0x20 || byte == 0x7f) {
+            char escaped[7];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", byte);
+            append(text, escaped, 6);
+        } else {
+            append(text, &bytes[i], 1);
+        }
+    }
+    append(text, "\"", 1);
+}
+
+char *form_output(
+    const Form *const form,
+    const Buffer *const *const values,
+    const bool json,
+    uint32_t *const len
+) {
+    Text text = {.bytes = NULL, .len = 0, .capacity = 0};
+    char *value = NULL;
+    uint32_t value_capacity = 0;
+    if (json) {
+        append(&text, "{", 1);
+    }
+    for (uint32_t i = 0; i < form->count; ++i) {
+        const uint32_t value_len = buffer_len(values[i]);
+        if (value_len > value_capacity) {
+            value_capacity = value_len;
+            value = allocate(value, value_capacity);
+        }
+        if (value_len > 0) {
+            buffer_copy(values[i], 0, value_len, value);
+        }
+        if (json) {
+            const char *const label = form->fields[i].label;
+            append_json(&text, label, strlen(label));
+            append(&text, ": ", 2);
+            append_json(&text, value, value_len);
+            if (i + 1 < form->count) {
+                append(&text, ", ", 2);
+            }
+        } else {
+            append(&text, value, value_len);
+            append(&text, "\n", 1);
+        }
+    }
+    if (json) {
+        append(&text, "}\n", 2);
+    }
+    free(value);
+    *len = text.len;
+    return text.bytes;
+}
@@ -0,0 +1,40 @@
+#ifndef FORM_H
+#define FORM_H
+
+#include "buffer.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Field of a form, as given by its spec
+// Strings other than the label are NULL if not given
+typedef struct FormField {
+    char *label;
+    char *value;
+    char *placeholder;
+    char *history;  // Filename
+    char *output;   // Filename, also written with the rest
+} FormField;
+
+typedef struct Form {
+    FormField *fields;
+    uint32_t count;
+} Form;
+
+// Read spec of `[Label]` lines, each followed by `key = value` lines for its
+// field, where key is `value`, `placeholder`, `history` or `output`
+// Blank lines, and lines starting with `#`, are ignored
+// Reports an invalid spec and exits
+void form_read(Form *const form, const char *const filename);
+
+// Value of each field on its own line, or a JSON object of them by label
+// `values` has one line for each field
+// Returns text, which must be freed
+char *form_output(
+    const Form *const form,
+    const Buffer *const *const values,
+    const bool json,
+    uint32_t *const len
+);
+
+#endif
@@ -0,0 +1,130 @@
+#include "fuzzy.h"
+
+#include "charclass.h"
+
+#include <string.h>
+
+#if defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__))
+    #define FUZZY_X86
+    #include <immintrin.h>
+#endif
+
+#define SCORE_MATCH (16)
+#define BONUS_BOUNDARY (8)
+#define BONUS_CAMEL (7)
+#define BONUS_CONSECUTIVE (4)
+#define PENALTY_GAP_START (3)
+#define PENALTY_GAP (1)
+
+static inline char fold_byte(const char byte, const bool fold) {
+    return fold && byte >= 'A' && byte <= 'Z' ? byte | 0x20 : byte;
+}
+
+// Index of first byte from `start` matching `byte`, or `len` if none
+static uint32_t find_byte(
+    const char *const text,
+    const uint32_t start,
+    const uint32_t len,
+    const char byte,
+    const bool fold
+) {
+    if (fold && byte >= 'a' && byte <= 'z') {
+        uint32_t i = start;
+#ifdef FUZZY_X86
+        // Either case of a letter is the lowercase letter with 0x20 set
+        const __m128i target = _mm_set1_epi8(byte);
+        const __m128i bit = _mm_set1_epi8(0x20);
+        for (; i + 16 <= len; i += 16) {
+            const __m128i v = _mm_loadu_si128((const __m128i *) &text[i]);
+            const uint32_t bits = _mm_movemask_epi8(
+                _mm_cmpeq_epi8(_mm_or_si128(v, bit), target)
+            );
+            if (bits != 0) {
+                return i + __builtin_ctz(bits);
+            }
+        }
+#endif
+        for (; i < len; ++i) {
+            if ((text[i] | 0x20) == byte) {
+                return i;
+            }
+        }
+        return len;
+    }
+    const char *const found = memchr(&text[start], byte, len - start);
+    return found != NULL ? (uint32_t) (found - text) : len;
+}
+
+// Bonus for a match at `index`, by the byte before it
+static int32_t bonus(const char *const text, const uint32_t index) {
+    if (index == 0 || char_class(text[index - 1]) != CLASS_WORD) {
+        return BONUS_BOUNDARY;
+    }
+    const char prev = text[index - 1];
+    const char byte = text[index];
+    if (prev >= 'a' && prev <= 'z' && byte >= 'A' && byte <= 'Z') {
+        return BONUS_CAMEL;
+    }
+    return 0;
+}
+
+bool fuzzy_fold(const char *const query, const uint32_t query_len) {
+    for (uint32_t i = 0; i < query_len; ++i) {
+        if (query[i] >= 'A' && query[i] <= 'Z') {
+            return false;
+        }
+    }
+    return true;
+}
+
+int32_t fuzzy_score(
+    const char *const text,
+    const uint32_t len,
+    const char *const query,
+    const uint32_t query_len,
+    const bool fold,
+    uint32_t *const positions
+) {
+    if (query_len == 0) {
+        return 0;
+    }
+
+    // End of first complete match
+    uint32_t end = 0;
+    for (uint32_t matched = 0; matched < query_len; ++matched) {
+        end = find_byte(text, end, len, query[matched], fold);
+        if (end >= len) {
+            return FUZZY_NONE;
+        }
+        ++end;
+    }
+    uint32_t matched = query_len;
+
+    // Latest start of a match ending there
+    uint32_t start = end;
+    for (uint32_t i = end; i > 0 && matched > 0; --i) {
+        if (fold_byte(text[i - 1], fold) == query[matched - 1]) {
+            --matched;
+            start = i - 1;
+        }
+    }
+
+    int32_t score = 0;
+    uint32_t last = start;
+    for (uint32_t i = start; i < end && matched < query_len; ++i) {
+        if (fold_byte(text[i], fold) == query[matched]) {
+            score += SCORE_MATCH + bonus(text, i);
+            if (matched > 0 && last + 1 == i) {
+                score += BONUS_CONSECUTIVE;
+            }
+            if (positions != NULL) {
+                positions[matched] = i;
+            }
+            ++matched;
+            last = i;
+        } else {
+            score -= last + 1 == i ? PENALTY_GAP_START : PENALTY_GAP;
+        }
+    }
+    return score;
+}
@@ -0,0 +1,27 @@
+#ifndef FUZZY_H
+#define FUZZY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define FUZZY_NONE (INT32_MIN)
+
+// Whether matching ignores ASCII case, which it does unless `query` has an
+// uppercase letter
+bool fuzzy_fold(const char *const query, const uint32_t query_len);
+
+// Score of `text` containing the bytes of `query` in order, or
+// `FUZZY_NONE` if it does not
+// Matches are scored within the shortest window ending at the first
+// complete match, favouring consecutive bytes and starts of words
+// If `positions` is not NULL, it is set to the `query_len` matched indexes
+int32_t fuzzy_score(
+    const char *const text,
+    const uint32_t len,
+    const char *const query,
+    const uint32_t query_len,
+    const bool fold,
+    uint32_t *const positions
+);
+
+#endif
@@ -0,0 +1,238 @@
+#include "highlight.h"
+
+#include "alloc.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TOKENS_MIN_CAPACITY (64)
+// Bytes tokenized past the window, so scrolling a little needs no more
+#define HIGHLIGHT_MARGIN (64)
+
+static bool is_space(const char byte) {
+    return byte == ' ' || byte == '\t';
+}
+
+static bool is_operator(const char byte) {
+    return byte != '\0' && strchr("|&;<>()", byte) != NULL;
+}
+
+static bool is_digit(const char byte) {
+    return byte >= '0' && byte <= '9';
+}
+
+static bool is_name(const char byte) {
+    return is_digit(byte) || byte == '_' || (byte >= 'A' && byte <= 'Z')
+        || (byte >= 'a' && byte <= 'z');
+}
+
+// Byte at `index`, or `\0` past the end
+static char byte_at(const Buffer *const line, const uint32_t index) {
+    return index < buffer_len(line) ? buffer_get(line, index) : '\0';
+}
+
+// End of quoted string starting at `start`, after its closing quote
+// An unclosed string runs to the end of the line
+static uint32_t string_end(const Buffer *const line, const uint32_t start) {
+    const uint32_t len = buffer_len(line);
+    const char quote = buffer_get(line, start);
+    uint32_t index = start + 1;
+    while (index < len) {
+        const char byte = buffer_get(line, index);
+        ++index;
+        if (byte == quote) {
+            break;
+        }
+        // Only double quotes have escapes
+        if (byte == '\\' && quote == '"' && index < len) {
+            ++index;
+        }
+    }
+    return index;
+}
+
+// Whether word is digits, with an optional fraction
+static bool is_number(
+    const Buffer *const line,
+    const uint32_t start,
+    const uint32_t end
+) {
+    bool point = false;
+    for (uint32_t index = start; index < end; ++index) {
+        const char byte = buffer_get(line, index);
+        if (byte == '.' && !point && index > start && index + 1 < end) {
+            point = true;
+        } else if (!is_digit(byte)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Token starting at `start`, which is not a space
+static Token next_token(const Buffer *const line, const uint32_t start) {
+    const uint32_t len = buffer_len(line);
+    const char byte = buffer_get(line, start);
+    const char next = byte_at(line, start + 1);
+    Token token = {.start = start, .len = 1, .kind = TOKEN_WORD};
+
+    // Comments only start words
+    const char previous = start > 0 ? buffer_get(line, start - 1) : ' ';
+    if (byte == '#' && (is_space(previous) || is_operator(previous))) {
+        token.kind = TOKEN_COMMENT;
+        token.len = len - start;
+        return token;
+    }
+    if (byte == '\'' || byte == '"') {
+        token.kind = TOKEN_STRING;
+        token.len = string_end(line, start) - start;
+        return token;
+    }
+    if (is_operator(byte)) {
+        token.kind = TOKEN_OPERATOR;
+        token.len = is_operator(next) ? 2 : 1;
+        return token;
+    }
+    if (byte == '$') {
+        if (next == '(') {
+            token.kind = TOKEN_OPERATOR;
+            token.len = 2;
+            return token;
+        }
+        if (next == '{') {
+            uint32_t end = start + 2;
+            while (end < len && buffer_get(line, end) != '}') {
+                ++end;
+            }
+            token.kind = TOKEN_VARIABLE;
+            token.len = (end < len ? end + 1 : end) - start;
+            return token;
+        }
+        if (is_name(next)) {
+            uint32_t end = start + 2;
+            while (end < len && is_name(buffer_get(line, end))) {
+                ++end;
+            }
+            token.kind = TOKEN_VARIABLE;
+            token.len = end - start;
+            return token;
+        }
+        if (next != '\0' && strchr("?#@*!$-", next) != NULL) {
+            token.kind = TOKEN_VARIABLE;
+            token.len = 2;
+            return token;
+        }
+    }
+
+    // Word runs until a space, operator, quote or variable
+    uint32_t end = start + 1;
+    if (byte == '\\' && end < len) {
+        ++end;
+    }
+    while (end < len) {
+        const char current = buffer_get(line, end);
+        if (is_space(current) || is_operator(current) || current == '\''
+            || current == '"' || current == '$')
+        {
+            break;
+        }
+        end += current == '\\' && end + 1 < len ? 2 : 1;
+    }
+    token.len = end - start;
+    if (is_number(line, start, end)) {
+        token.kind = TOKEN_NUMBER;
+    }
+    return token;
+}
+
+void highlight_init(Highlighter *const highlighter) {
+    highlighter->tokens = NULL;
+    highlighter->count = 0;
+    highlighter->capacity = 0;
+    highlighter->end = 0;
+}
+
+void highlight_free(Highlighter *const highlighter) {
+    mem_free(highlighter->tokens);
+    highlight_init(highlighter);
+}
+
+// Index of first token ending after `index`, or token count
+static uint32_t find_token(
+    const Highlighter *const highlighter,
+    const uint32_t index
+) {
+    uint32_t low = 0;
+    uint32_t high = highlighter->count;
+    while (low < high) {
+        const uint32_t middle = low + (high - low) / 2;
+        const Token *const token = &highlighter->tokens[middle];
+        if (token->start + token->len > index) {
+            high = middle;
+        } else {
+            low = middle + 1;
+        }
+    }
+    return low;
+}
+
+void highlight_edited(Highlighter *const highlighter, const uint32_t index) {
+    if (index > highlighter->end) {
+        return;
+    }
+    // Token ending at the edit may continue into it
+    uint32_t count = find_token(highlighter, index);
+    while (count > 0) {
+        const Token *const last = &highlighter->tokens[count - 1];
+        if (last->start + last->len < index) {
+            break;
+        }
+        --count;
+    }
+    highlighter->count = count;
+    highlighter->end = 0;
+    if (count > 0) {
+        const Token *const last = &highlighter->tokens[count - 1];
+        highlighter->end = last->start + last->len;
+    }
+}
+
+uint32_t highlight_range(
+    Highlighter *const highlighter,
+    const Buffer *const line,
+    const uint32_t start,
+    const uint32_t end
+) {
+    const uint32_t len = buffer_len(line);
+    const uint32_t target = end + HIGHLIGHT_MARGIN < len
+        ? end + HIGHLIGHT_MARGIN
+        : len;
+    if (highlighter->end < end) {
+        uint32_t index = highlighter->end;
+        while (index < target) {
+            if (is_space(buffer_get(line, index))) {
+                ++index;
+                continue;
+            }
+            if (highlighter->count >= highlighter->capacity) {
+                highlighter->capacity = highlighter->capacity > 0
+                    ? highlighter->capacity * 2
+                    : TOKENS_MIN_CAPACITY;
+                highlighter->tokens = mem_realloc(
+                    highlighter->tokens,
+                    highlighter->capacity * sizeof(Token)
+                );
+                if (highlighter->tokens == NULL) {
+                    perror("Failed to allocate tokens");
+                    exit(1);
+                }
+            }
+            const Token token = next_token(line, index);
+            highlighter->tokens[highlighter->count++] = token;
+            index = token.start + token.len;
+        }
+        highlighter->end = index;
+    }
+    return find_token(highlighter, start);
+}
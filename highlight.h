@@ -0,0 +1,53 @@
+#ifndef HIGHLIGHT_H
+#define HIGHLIGHT_H
+
+#include "buffer.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef enum TokenKind {
+    TOKEN_WORD,
+    TOKEN_NUMBER,
+    TOKEN_STRING,
+    TOKEN_VARIABLE,
+    TOKEN_OPERATOR,
+    TOKEN_COMMENT,
+    TOKEN_KIND_COUNT,
+} TokenKind;
+
+// Words, and anything else coloured, but not the spaces between them
+typedef struct Token {
+    uint32_t start;
+    uint32_t len;
+    TokenKind kind;
+} Token;
+
+// Shell tokens of a line, found lazily from the start up to what has been
+// shown
+// Every token ends where the tokenizer is between tokens, so an edit only
+// forgets tokens from the one it touches, and tokenizing resumes there
+typedef struct Highlighter {
+    Token *tokens;
+    uint32_t count;
+    uint32_t capacity;
+    uint32_t end;  // Bytes tokenized
+} Highlighter;
+
+void highlight_init(Highlighter *const highlighter);
+
+void highlight_free(Highlighter *const highlighter);
+
+// Forget tokens which an edit at `index` may have changed
+void highlight_edited(Highlighter *const highlighter, const uint32_t index);
+
+// Tokenize line up to a little past `end`, if not done already
+// Returns index of first token ending after `start`, or token count
+uint32_t highlight_range(
+    Highlighter *const highlighter,
+    const Buffer *const line,
+    const uint32_t start,
+    const uint32_t end
+);
+
+#endif
@@ -0,0 +1,353 @@
+#include "history.h"
+
+#include "alloc.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define HISTORY_MIN_CAPACITY (16)
+#define EDIT_NONE (UINT32_MAX)
+
+// Stored unaligned in `Change.data`, so always accessed with `memcpy`
+typedef struct EditHeader {
+    uint32_t index;
+    uint32_t removed_len;
+    uint32_t inserted_len;
+    uint32_t prev;  // Offset of previous edit header, or `EDIT_NONE`
+} EditHeader;
+
+static void *allocate(void *const ptr, const size_t size) {
+    void *const result = mem_realloc(ptr, size);
+    if (result == NULL) {
+        perror("Failed to allocate history");
+        exit(1);
+    }
+    return result;
+}
+
+static void change_init(Change *const change) {
+    change->data = NULL;
+    change->size = 0;
+    change->capacity = 0;
+    change->last_edit = EDIT_NONE;
+    change->cursor_before = 0;
+    change->offset_before = 0;
+    change->cursor_after = 0;
+    change->offset_after = 0;
+}
+
+static void change_free(Change *const change) {
+    mem_free(change->data);
+    change_init(change);
+}
+
+static void change_reserve(Change *const change, const uint32_t extra) {
+    if (change->size + extra <= change->capacity) {
+        return;
+    }
+    uint32_t capacity = change->capacity > 0 ? change->capacity : 64;
+    while (capacity < change->size + extra) {
+        capacity *= 2;
+    }
+    change->data = allocate(change->data, capacity);
+    change->capacity = capacity;
+}
+
+static EditHeader read_header(const Change *const change, const uint32_t at) {
+    EditHeader header;
+    memcpy(&header, &change->data[at], sizeof(EditHeader));
+    return header;
+}
+
+static void write_header(
+    Change *const change,
+    const uint32_t at,
+    const EditHeader *const header
+) {
+    memcpy(&change->data[at], header, sizeof(EditHeader));
+}
+
+// Extend last edit instead of appending a new one, if possible
+// Covers typing, backspacing and repeated forward deletes
+static bool coalesce_edit(
+    Change *const change,
+    const Buffer *const buffer,
+    const uint32_t index,
+    const uint32_t removed_len,
+    const char *const inserted,
+    const uint32_t inserted_len
+) {
+    if (change->last_edit == EDIT_NONE) {
+        return false;
+    }
+    EditHeader last = read_header(change, change->last_edit);
+    const uint32_t last_end = last.index + last.inserted_len;
+
+    // Insert directly after last inserted text
+    if (removed_len == 0 && index == last_end) {
+        change_reserve(change, inserted_len);
+        memcpy(&change->data[change->size], inserted, inserted_len);
+        change->size += inserted_len;
+        last.inserted_len += inserted_len;
+        write_header(change, change->last_edit, &last);
+        return true;
+    }
+
+    if (inserted_len != 0) {
+        return false;
+    }
+
+    // Delete end of last inserted text
+    if (removed_len <= last.inserted_len && index + removed_len == last_end) {
+        change->size -= removed_len;
+        last.inserted_len -= removed_len;
+        write_header(change, change->last_edit, &last);
+        // Nothing left to undo
+        if (last.removed_len == 0 && last.inserted_len == 0
+            && last.prev == EDIT_NONE)
+        {
+            change->size = 0;
+            change->last_edit = EDIT_NONE;
+        }
+        return true;
+    }
+
+    if (last.inserted_len != 0) {
+        return false;
+    }
+
+    // Delete directly before last deletion
+    if (index + removed_len == last.index) {
+        change_reserve(change, removed_len);
+        char *const removed = &change->data[change->last_edit]
+            + sizeof(EditHeader);
+        memmove(&removed[removed_len], removed, last.removed_len);
+        buffer_copy(buffer, index, removed_len, removed);
+        change->size += removed_len;
+        last.index = index;
+        last.removed_len += removed_len;
+        write_header(change, change->last_edit, &last);
+        return true;
+    }
+
+    // Delete at same position as last deletion
+    if (index == last.index) {
+        change_reserve(change, removed_len);
+        buffer_copy(buffer, index, removed_len, &change->data[change->size]);
+        change->size += removed_len;
+        last.removed_len += removed_len;
+        write_header(change, change->last_edit, &last);
+        return true;
+    }
+
+    return false;
+}
+
+static bool is_noop_edit(
+    const Buffer *const buffer,
+    const uint32_t index,
+    const uint32_t removed_len,
+    const char *const inserted,
+    const uint32_t inserted_len
+) {
+    if (removed_len != inserted_len) {
+        return false;
+    }
+    for (uint32_t i = 0; i < removed_len; ++i) {
+        if (buffer_get(buffer, index + i) != inserted[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static Change *change_at(const History *const history, const uint32_t index) {
+    return &history
+                ->changes[(history->head + index) & (history->capacity - 1)];
+}
+
+static size_t change_bytes(const Change *const change) {
+    return sizeof(Change) + change->capacity;
+}
+
+static void grow_ring(History *const history) {
+    const uint32_t capacity = history->capacity > 0
+        ? history->capacity * 2
+        : HISTORY_MIN_CAPACITY;
+    Change *const changes = allocate(NULL, capacity * sizeof(Change));
+    // Unwrap into new array
+    for (uint32_t i = 0; i < history->len; ++i) {
+        changes[i] = *change_at(history, i);
+    }
+    mem_free(history->changes);
+    history->changes = changes;
+    history->capacity = capacity;
+    history->head = 0;
+}
+
+void history_init(History *const history) {
+    history->changes = NULL;
+    history->capacity = 0;
+    history->head = 0;
+    history->len = 0;
+    history->index = 0;
+    history->bytes = 0;
+    change_init(&history->pending);
+}
+
+void history_free(History *const history) {
+    for (uint32_t i = 0; i < history->len; ++i) {
+        change_free(change_at(history, i));
+    }
+    mem_free(history->changes);
+    change_free(&history->pending);
+    history_init(history);
+}
+
+void history_record(
+    History *const history,
+    const Buffer *const buffer,
+    const uint32_t index,
+    const uint32_t removed_len,
+    const char *const inserted,
+    const uint32_t inserted_len,
+    const uint32_t cursor,
+    const uint32_t offset
+) {
+    if (is_noop_edit(buffer, index, removed_len, inserted, inserted_len)) {
+        return;
+    }
+
+    Change *const change = &history->pending;
+    if (change->size == 0) {
+        change->cursor_before = cursor;
+        change->offset_before = offset;
+    }
+
+    if (coalesce_edit(
+            change, buffer, index, removed_len, inserted, inserted_len
+        ))
+    {
+        return;
+    }
+
+    const EditHeader header = {
+        .index = index,
+        .removed_len = removed_len,
+        .inserted_len = inserted_len,
+        .prev = change->last_edit,
+    };
+    change_reserve(change, sizeof(EditHeader) + removed_len + inserted_len);
+    const uint32_t at = change->size;
+    write_header(change, at, &header);
+    char *const payload = &change->data[at + sizeof(EditHeader)];
+    buffer_copy(buffer, index, removed_len, payload);
+    if (inserted_len > 0) {
+        memcpy(&payload[removed_len], inserted, inserted_len);
+    }
+    change->size += sizeof(EditHeader) + removed_len + inserted_len;
+    change->last_edit = at;
+}
+
+void history_commit(
+    History *const history,
+    const uint32_t cursor,
+    const uint32_t offset
+) {
+    Change change = history->pending;
+    if (change.size == 0) {
+        return;
+    }
+    change_init(&history->pending);
+
+    change.cursor_after = cursor;
+    change.offset_after = offset;
+    // Release unused capacity, as it counts towards memory limit
+    change.data = allocate(change.data, change.size);
+    change.capacity = change.size;
+
+    // Delete all future history to be overwritten
+    while (history->len > history->index) {
+        Change *const redo = change_at(history, history->len - 1);
+        history->bytes -= change_bytes(redo);
+        change_free(redo);
+        --history->len;
+    }
+
+    if (history->len >= history->capacity) {
+        grow_ring(history);
+    }
+    *change_at(history, history->len) = change;
+    ++history->len;
+    ++history->index;
+    history->bytes += change_bytes(&change);
+
+    // Discard oldest changes, always keeping the newest
+    while (history->bytes > HISTORY_MAX_BYTES && history->len > 1) {
+        Change *const oldest = change_at(history, 0);
+        history->bytes -= change_bytes(oldest);
+        change_free(oldest);
+        history->head = (history->head + 1) & (history->capacity - 1);
+        --history->len;
+        --history->index;
+    }
+}
+
+bool history_undo(
+    History *const history,
+    Buffer *const buffer,
+    uint32_t *const cursor,
+    uint32_t *const offset
+) {
+    history_commit(history, *cursor, *offset);
+    if (history->index == 0) {
+        return false;
+    }
+    --history->index;
+    const Change *const change = change_at(history, history->index);
+
+    // Apply inverse edits, newest first
+    for (uint32_t at = change->last_edit; at != EDIT_NONE;) {
+        const EditHeader header = read_header(change, at);
+        const char *const removed = &change->data[at + sizeof(EditHeader)];
+        buffer_delete(buffer, header.index, header.inserted_len);
+        buffer_insert(buffer, header.index, removed, header.removed_len);
+        at = header.prev;
+    }
+
+    *cursor = change->cursor_before;
+    *offset = change->offset_before;
+    return true;
+}
+
+bool history_redo(
+    History *const history,
+    Buffer *const buffer,
+    uint32_t *const cursor,
+    uint32_t *const offset
+) {
+    history_commit(history, *cursor, *offset);
+    if (history->index >= history->len) {
+        return false;
+    }
+    const Change *const change = change_at(history, history->index);
+    ++history->index;
+
+    for (uint32_t at = 0; at < change->size;) {
+        const EditHeader header = read_header(change, at);
+        const char *const removed = &change->data[at + sizeof(EditHeader)];
+        buffer_delete(buffer, header.index, header.removed_len);
+        buffer_insert(
+            buffer,
+            header.index,
+            &removed[header.removed_len],
+            header.inserted_len
+        );
+        at += sizeof(EditHeader) + header.removed_len + header.inserted_len;
+    }
+
+    *cursor = change->cursor_after;
+    *offset = change->offset_after;
+    return true;
+}
@@ -0,0 +1,75 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include "buffer.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Oldest changes are discarded once history uses more memory than this
+#define HISTORY_MAX_BYTES (4 * 1024 * 1024)
+
+// A group of edits, undone and redone together
+// `data` holds packed edits: header, removed bytes, inserted bytes
+typedef struct Change {
+    char *data;
+    uint32_t size;
+    uint32_t capacity;
+    uint32_t last_edit;  // Offset of last edit header in `data`
+    uint32_t cursor_before;
+    uint32_t offset_before;
+    uint32_t cursor_after;
+    uint32_t offset_after;
+} Change;
+
+// Cyclic array of changes
+typedef struct History {
+    Change *changes;
+    uint32_t capacity;  // Power of 2
+    uint32_t head;      // Index of oldest change
+    uint32_t len;
+    uint32_t index;  // Number of changes currently applied
+    size_t bytes;
+    Change pending;  // Edits since last commit
+} History;
+
+void history_init(History *const history);
+
+void history_free(History *const history);
+
+// Record replacing `removed_len` bytes at `index` with `inserted`
+// Must be called before the buffer is modified
+void history_record(
+    History *const history,
+    const Buffer *const buffer,
+    const uint32_t index,
+    const uint32_t removed_len,
+    const char *const inserted,
+    const uint32_t inserted_len,
+    const uint32_t cursor,
+    const uint32_t offset
+);
+
+// Close pending edits as a single change, discarding any redo entries
+void history_commit(
+    History *const history,
+    const uint32_t cursor,
+    const uint32_t offset
+);
+
+bool history_undo(
+    History *const history,
+    Buffer *const buffer,
+    uint32_t *const cursor,
+    uint32_t *const offset
+);
+
+bool history_redo(
+    History *const history,
+    Buffer *const buffer,
+    uint32_t *const cursor,
+    uint32_t *const offset
+);
+
+#endif
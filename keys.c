@@ -0,0 +1,69 @@
+#include "keys.h"
+
+#include "editor.h"
+
+#include <string.h>
+
+typedef struct Sequence {
+    const char *bytes;
+    int key;
+} Sequence;
+
+static const Sequence SEQUENCES[] = {
+    {"\033[A", K_UP},
+    {"\033OA", K_UP},
+    {"\033[B", K_DOWN},
+    {"\033OB", K_DOWN},
+    {"\033[D", K_LEFT},
+    {"\033OD", K_LEFT},
+    {"\033[C", K_RIGHT},
+    {"\033OC", K_RIGHT},
+    {"\033[200~", K_PASTE_START},
+    {"\033[201~", K_PASTE_END},
+};
+
+size_t decode_key(const char *const bytes, const size_t len, int *const key) {
+    if (len == 0) {
+        return 0;
+    }
+
+    const unsigned char ch = bytes[0];
+    switch (ch) {
+        case K_ESCAPE:
+            for (size_t i = 0; i < sizeof(SEQUENCES) / sizeof(Sequence); ++i) {
+                const size_t seq_len = strlen(SEQUENCES[i].bytes);
+                if (seq_len <= len
+                    && !memcmp(bytes, SEQUENCES[i].bytes, seq_len))
+                {
+                    *key = SEQUENCES[i].key;
+                    return seq_len;
+                }
+            }
+            *key = K_ESCAPE;
+            return 1;
+        case '\r':
+            *key = K_RETURN;
+            return 1;
+        case 0x7f:
+        case 0x08:
+            *key = K_BACKSPACE;
+            return 1;
+        default:
+            *key = ch;
+            return 1;
+    }
+}
+
+bool partial_key(const char *const bytes, const size_t len) {
+    if (len < 2 || bytes[0] != K_ESCAPE) {
+        return false;
+    }
+    for (size_t i = 0; i < sizeof(SEQUENCES) / sizeof(Sequence); ++i) {
+        if (strlen(SEQUENCES[i].bytes) > len
+            && !memcmp(bytes, SEQUENCES[i].bytes, len))
+        {
+            return true;
+        }
+    }
+    return false;
+}
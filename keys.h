@@ -0,0 +1,15 @@
+#ifndef KEYS_H
+#define KEYS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Decode one key from raw terminal input
+// Returns number of bytes used, which is 0 only if `len` is 0
+size_t decode_key(const char *const bytes, const size_t len, int *const key);
+
+// Whether `bytes` start a key sequence but end before it does
+// A lone Escape is always the Escape key
+bool partial_key(const char *const bytes, const size_t len);
+
+#endif
@@ -0,0 +1,127 @@
+#include "loop.h"
+
+#include <errno.h>
+#include <sys/signalfd.h>
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static uint64_t now(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (uint64_t) time.tv_sec * 1000000000 + time.tv_nsec;
+}
+
+void loop_init(Loop *const loop) {
+    loop->watch_count = 0;
+    loop->timer_count = 0;
+}
+
+void loop_watch(
+    Loop *const loop,
+    const int fd,
+    const LoopHandler handler,
+    void *const data
+) {
+    if (loop->watch_count >= LOOP_MAX_WATCHES) {
+        fprintf(stderr, "Too many event sources.\n");
+        exit(1);
+    }
+    const uint32_t index = loop->watch_count++;
+    loop->fds[index] = (struct pollfd) {.fd = fd, .events = POLLIN};
+    loop->handlers[index] = handler;
+    loop->data[index] = data;
+}
+
+uint32_t loop_timer(Loop *const loop, const LoopHandler handler, void *data) {
+    if (loop->timer_count >= LOOP_MAX_TIMERS) {
+        fprintf(stderr, "Too many timers.\n");
+        exit(1);
+    }
+    const uint32_t index = loop->timer_count++;
+    loop->timers[index] = (Timer) {
+        .armed = false,
+        .deadline = 0,
+        .handler = handler,
+        .data = data,
+    };
+    return index;
+}
+
+void loop_arm(Loop *const loop, const uint32_t timer, const uint64_t delay_ms) {
+    Timer *const armed = &loop->timers[timer];
+    const uint64_t deadline = now() + delay_ms * 1000000;
+    if (!armed->armed || deadline < armed->deadline) {
+        armed->deadline = deadline;
+        armed->armed = true;
+    }
+}
+
+// Call handlers of timers which are due
+static void run_timers(Loop *const loop) {
+    const uint64_t time = now();
+    for (uint32_t i = 0; i < loop->timer_count; ++i) {
+        Timer *const timer = &loop->timers[i];
+        if (timer->armed && timer->deadline <= time) {
+            timer->armed = false;
+            timer->handler(timer->data, 0);
+        }
+    }
+}
+
+// Returns ms until next timer is due, rounded up, or -1 if none is armed
+static int next_timeout(const Loop *const loop) {
+    uint64_t next = UINT64_MAX;
+    for (uint32_t i = 0; i < loop->timer_count; ++i) {
+        const Timer *const timer = &loop->timers[i];
+        if (timer->armed && timer->deadline < next) {
+            next = timer->deadline;
+        }
+    }
+    if (next == UINT64_MAX) {
+        return -1;
+    }
+    const uint64_t time = now();
+    if (next <= time) {
+        return 0;
+    }
+    const uint64_t wait_ms = (next - time + 999999) / 1000000;
+    return wait_ms < INT32_MAX ? (int) wait_ms : INT32_MAX;
+}
+
+void loop_run(Loop *const loop, const LoopHandler prepare, void *const data) {
+    while (true) {
+        run_timers(loop);
+        prepare(data, 0);
+        const int count =
+            poll(loop->fds, loop->watch_count, next_timeout(loop));
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("Failed to wait for events");
+            exit(1);
+        }
+        for (uint32_t i = 0; i < loop->watch_count && count > 0; ++i) {
+            if (loop->fds[i].revents != 0) {
+                loop->handlers[i](loop->data[i], loop->fds[i].revents);
+            }
+        }
+    }
+}
+
+int loop_signals(const int *const signals, const uint32_t count) {
+    sigset_t set;
+    sigemptyset(&set);
+    for (uint32_t i = 0; i < count; ++i) {
+        sigaddset(&set, signals[i]);
+    }
+    const int fd = signalfd(-1, &set, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (fd < 0 || sigprocmask(SIG_BLOCK, &set, NULL) != 0) {
+        perror("Failed to handle signals");
+        exit(1);
+    }
+    return fd;
+}
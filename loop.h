@@ -0,0 +1,59 @@
+#ifndef LOOP_H
+#define LOOP_H
+
+#include <poll.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define LOOP_MAX_WATCHES (8)
+#define LOOP_MAX_TIMERS (8)
+
+// Called with `poll` events of a watched descriptor, or 0 for a timer
+typedef void (*LoopHandler)(void *const data, const short events);
+
+typedef struct Timer {
+    bool armed;
+    uint64_t deadline;  // Monotonic ns
+    LoopHandler handler;
+    void *data;
+} Timer;
+
+// Waits in `poll` for watched descriptors and the next timer, so uses no
+// CPU until something happens
+typedef struct Loop {
+    struct pollfd fds[LOOP_MAX_WATCHES];
+    LoopHandler handlers[LOOP_MAX_WATCHES];
+    void *data[LOOP_MAX_WATCHES];
+    uint32_t watch_count;
+    Timer timers[LOOP_MAX_TIMERS];
+    uint32_t timer_count;
+} Loop;
+
+void loop_init(Loop *const loop);
+
+// Call `handler` whenever `fd` is readable
+void loop_watch(
+    Loop *const loop,
+    const int fd,
+    const LoopHandler handler,
+    void *const data
+);
+
+// Add timer, which is not armed
+// Returns timer to arm
+uint32_t loop_timer(Loop *const loop, const LoopHandler handler, void *data);
+
+// Call timer's handler once after `delay_ms`, unless already armed to
+// fire sooner
+void loop_arm(Loop *const loop, const uint32_t timer, const uint64_t delay_ms);
+
+// Handle events forever, calling `prepare` before each wait
+void loop_run(Loop *const loop, const LoopHandler prepare, void *const data);
+
+// Block `signals` in every thread, and return a descriptor to read them
+// from instead
+// Must be called before any threads are started
+int loop_signals(const int *const signals, const uint32_t count);
+
+#endif
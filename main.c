@@ -1,7 +1,32 @@
-#include <ncurses.h>
+#include "backend.h"
+#include "buffer.h"
+#include "editor.h"
+#include "keys.h"
+#include "loop.h"
+#include "completions.h"
+#include "output.h"
+#include "form.h"
+#include "fuzzy.h"
+#include "highlight.h"
+#include "picker.h"
+#include "recall.h"
+#include "regex.h"
+#include "render.h"
+#include "serve.h"
+#include "session.h"
+#include "stats.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/signalfd.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include <ctype.h>
+#include <limits.h>
+#include <locale.h>
 #include <signal.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -9,60 +34,16 @@
 #define PROGRAM_VERSION "v0.1.0"
 #define PROGRAM_AUTHOR "darcy (https://github.com/dxrcy)"
 
-#define CTRL(key) ((key) - 0x60)
-#define K_ESCAPE (0x1b)
-#define K_LEFT (0x104)
-#define K_RIGHT (0x105)
-#define K_BACKSPACE (0x107)
-#define K_RETURN (0x0a)
-
-#define MAX_INPUT (200)
-#define MAX_HISTORY (100)
-
-const uint32_t CURSOR_LEFT = 5;         // Min left padding
-const uint32_t CURSOR_RIGHT_FULL = 3;   // Min right padding
-const uint32_t CURSOR_RIGHT_EMPTY = 1;  // (^) when cursor is at end of input
 const uint32_t MAX_INPUT_WIDTH = 70;
 const uint32_t BOX_MARGIN = 2;
-
-const int PAIR_BOX = 1;
-const int PAIR_DETAILS = 2;
-const int PAIR_VISUAL = 3;
-const int ATTR_BOX = COLOR_PAIR(PAIR_BOX) | A_DIM;
-const int ATTR_DETAILS = COLOR_PAIR(PAIR_DETAILS) | A_DIM;
-const int ATTR_VISUAL = COLOR_PAIR(PAIR_VISUAL);
-const int ATTR_PLACEHOLDER = A_DIM;
-
-enum VimMode {
-    MODE_NORMAL,
-    MODE_INSERT,
-    MODE_REPLACE,
-    MODE_VISUAL,
-};
-
-typedef struct Snap {
-    // Not null-terminated
-    char input[MAX_INPUT];
-    uint32_t input_len;
-    uint32_t cursor;
-    uint32_t offset;
-} Snap;
-
-// TODO: Use cyclic array or heap allocate
-typedef struct History {
-    Snap snaps[MAX_HISTORY];
-    uint32_t len;
-    uint32_t index;
-} History;
-
-typedef struct State {
-    enum VimMode mode;
-    Snap snap;
-    uint32_t visual_start;
-    History history;
-    const char *placeholder;
-    const char *filename;
-} State;
+// Label row and box of each field of a form
+const uint32_t FORM_FIELD_ROWS = 4;
+// How often to redraw while candidates are read or scored
+const int PICKER_POLL_MS = 30;
+// Exit status when `--timeout` quits, as for `timeout(1)`
+const int TIMEOUT_STATUS = 124;
+// Handled as events instead of interrupting
+const int LOOP_SIGNALS[] = {SIGWINCH, SIGINT, SIGTERM};
 
 static struct {
     uint32_t x;
@@ -70,710 +51,884 @@ static struct {
     uint32_t width;
 } input_box = {.x = 0, .y = 0, .width = 20};
 
-uint32_t subsat(const uint32_t lhs, const uint32_t rhs) {
-    if (rhs >= lhs) {
-        return 0;
-    }
-    return lhs - rhs;
-}
-
-uint32_t min(const uint32_t lhs, const uint32_t rhs) {
-    if (rhs >= lhs) {
-        return lhs;
-    }
-    return rhs;
-}
-
-uint32_t difference(const uint32_t lhs, const uint32_t rhs) {
-    if (lhs >= rhs) {
-        return lhs - rhs;
-    }
-    return rhs - lhs;
-}
-
-const char *mode_name(enum VimMode mode) {
-    switch (mode) {
-        case MODE_NORMAL:
-            return "NORMAL";
-        case MODE_INSERT:
-            return "INSERT";
-        case MODE_REPLACE:
-            return "REPLACE";
-        case MODE_VISUAL:
-            return "VISUAL";
-        default:
-            return "?";
-    }
-}
+static const Backend *backend = &CURSES_BACKEND;
+static Renderer renderer;
+// When first key since last frame was read, for timings
+static uint64_t key_time = 0;
+// Where input is printed if there is no output file
+static int print_fd = STDOUT_FILENO;
+
+static Loop loop;
+// Signals read as events, or -1 without a terminal
+static int signal_fd = -1;
+static uint32_t picker_timer;
+static bool submit_on_timeout = false;
+// Last key handled, shown in details
+static int last_key = 0;
+
+// Word list, kept loaded across prompts when serving
+static Completions completions;
+static const char *completions_filename = NULL;
+
+// Pattern accepted lines must match, kept compiled across prompts when
+// serving
+static Regex regex;
+static const char *regex_pattern = NULL;
+// Whether a pattern is used by this prompt
+static bool validating = false;
+
+// Whether line is coloured as shell syntax
+static bool highlighting = false;
+static const Style TOKEN_STYLES[TOKEN_KIND_COUNT] = {
+    [TOKEN_WORD] = STYLE_NORMAL,
+    [TOKEN_NUMBER] = STYLE_NUMBER,
+    [TOKEN_STRING] = STYLE_STRING,
+    [TOKEN_VARIABLE] = STYLE_VARIABLE,
+    [TOKEN_OPERATOR] = STYLE_OPERATOR,
+    [TOKEN_COMMENT] = STYLE_COMMENT,
+};
 
-void set_cursor(enum VimMode mode) {
-    if (mode == MODE_INSERT) {
-        printf("\033[5 q");
-    } else {
-        printf("\033[1 q");
-    }
-    fflush(stdout);
-}
+// Line being edited, and what is cached about it
+typedef struct Field {
+    const char *label;  // Shown above box in a form, or NULL
+    State state;
+    Recall recall;
+    Validator validator;
+    Highlighter highlighter;
+} Field;
+
+// One field, or each field of a form
+static Field *fields = NULL;
+static uint32_t field_count = 0;
+// Field edited by keys
+static uint32_t current = 0;
+// Fields shown, when not all of a form fit
+static uint32_t first_field = 0;
+static uint32_t visible_fields = 1;
+
+// Fields of form, if count is not 0
+static Form form = {.fields = NULL, .count = 0};
+// Where all values of a form are written, as for one line
+static const char *form_filename = NULL;
+static int form_output_fd = -1;
+static bool form_json = false;
+
+// Candidates to pick from, or NULL
+static Picker *picker = NULL;
+// Row of selected candidate
+static uint32_t picked = 0;
+
+// Session whose keys are handled instead of the terminal's, until it ends
+static Replay replay;
+static bool replaying = false;
+// Events are handled one per frame, without waiting
+static bool replay_fast = false;
+static uint32_t replay_timer;
+static uint64_t replay_start;
+// Next event, not yet due
+static SessionEvent replay_event;
+// Size of the recorded terminal, which layout keeps within, or 0
+static int replay_rows = 0;
+static int replay_cols = 0;
 
 void update_input_box(const int max_rows, const int max_cols) {
     input_box.width = min(max_cols - BOX_MARGIN * 2 - 2, MAX_INPUT_WIDTH);
     input_box.x = (max_cols - input_box.width) / 2 - 1;
     input_box.y = max_rows / 2 - 1;
+    if (form.count > 0) {
+        // As many fields as fit above details, centred together
+        const uint32_t fit = subsat(max_rows, 1) / FORM_FIELD_ROWS;
+        visible_fields = min(form.count, fit > 0 ? fit : 1);
+        input_box.y =
+            subsat(max_rows / 2, visible_fields * FORM_FIELD_ROWS / 2) + 1;
+    }
 }
 
-void draw_box_outline(
-    const uint32_t x,
-    const uint32_t y,
-    const uint32_t w,
-    const bool left_open,
-    const bool right_open
+// Write text with one `write`, to output file descriptor, file, or where
+// input is printed
+// Returns false after reporting an error if it could not be written
+bool write_output(
+    const char *const filename,
+    const int output_fd,
+    const char *const text,
+    const uint32_t len
 ) {
-    // Top
-    move(y, x);
-    addch(ACS_ULCORNER);
-    for (uint32_t i = 0; i < w - 2; ++i) {
-        addch(ACS_HLINE);
+    bool saved;
+    if (output_fd >= 0) {
+        saved = write_all(output_fd, text, len);
+    } else if (filename != NULL) {
+        saved = write_file_atomic(filename, text, len);
+    } else {
+        saved = write_all(print_fd, text, len);
     }
-    addch(ACS_URCORNER);
-
-    // Sides
-    move(y + 1, x);
-    addch(left_open ? ':' : ACS_VLINE);
-    move(y + 1, x + w - 1);
-    addch(right_open ? ':' : ACS_VLINE);
-
-    // Bottom
-    move(y + 2, x);
-    addch(ACS_LLCORNER);
-    for (uint32_t i = 0; i < w - 2; ++i) {
-        addch(ACS_HLINE);
+    if (!saved) {
+        perror(filename != NULL ? "Failed to write file"
+                                : "Failed to write output");
     }
-    addch(ACS_LRCORNER);
+    return saved;
 }
 
-int find_word_start(Snap *const snap, const bool full_word) {
-    // Empty line
-    if (snap->input_len < 1) {
-        return 0;
-    }
-    // At end of line
-    if (snap->cursor + 1 >= snap->input_len) {
-        return snap->input_len - 1;
-    }
-    // On a space
-    // Look for first non-space character
-    if (isspace(snap->input[snap->cursor])) {
-        while (snap->cursor + 1 < snap->input_len) {
-            ++snap->cursor;
-            if (!isspace(snap->input[snap->cursor])) {
-                return snap->cursor;
-            }
-        }
+// Write input to output file descriptor or file, or print it
+// Returns false after reporting an error if it could not be written
+bool save_input(const State *const state) {
+    const Buffer *const input = &state->snap.input;
+    const uint32_t len = buffer_len(input);
+    // Room for newline when printed
+    char *const text = malloc(len + 1);
+    if (text == NULL) {
+        perror("Failed to allocate output");
+        exit(1);
     }
-    // On non-space
-    int alnum = isalnum(snap->input[snap->cursor]);
-    while (snap->cursor < snap->input_len - 1) {
-        ++snap->cursor;
-        // Space found
-        // Look for first non-space character
-        if (isspace(snap->input[snap->cursor])) {
-            while (snap->cursor + 1 < snap->input_len) {
-                ++snap->cursor;
-                if (!isspace(snap->input[snap->cursor])) {
-                    return snap->cursor;
-                }
-            }
-            break;
-        }
-        // First punctuation after word
-        // OR first word after punctuation
-        // (If distinguishing words and punctuation)
-        if (!full_word && isalnum(snap->input[snap->cursor]) != alnum) {
-            return snap->cursor;
-        }
+    buffer_copy(input, 0, len, text);
+
+    uint32_t text_len = len;
+    if (state->output_fd < 0 && state->filename == NULL) {
+        // If no output file is specified, print instead
+        text[text_len++] = '\n';
     }
-    // No next word found
-    // Go to end of line
-    return snap->input_len - 1;
+    const bool saved =
+        write_output(state->filename, state->output_fd, text, text_len);
+    free(text);
+    return saved;
 }
 
-int find_word_end(Snap *const snap, const bool full_word) {
-    // Empty line
-    if (snap->input_len < 1) {
-        return 0;
-    }
-    // At end of line
-    if (snap->cursor + 1 >= snap->input_len) {
-        return snap->input_len - 1;
+// Write values of all fields of form with one `write`, then write each
+// field with its own output file
+// Returns false after reporting an error if any could not be written
+bool save_form(void) {
+    const Buffer *values[field_count];
+    for (uint32_t i = 0; i < field_count; ++i) {
+        values[i] = &fields[i].state.snap.input;
     }
-    ++snap->cursor;  // Always move at least one character
-    // On a sequence of spaces (>=1)
-    // Look for start of next word, start from there instead
-    while (snap->cursor + 1 < snap->input_len
-           && isspace(snap->input[snap->cursor]))
-    {
-        ++snap->cursor;
-    }
-    // On non-space
-    int alnum = isalnum(snap->input[snap->cursor]);
-    while (snap->cursor < snap->input_len) {
-        ++snap->cursor;
-        // Space found
-        // Word ends at previous index
-        // OR first punctuation after word
-        // OR first word after punctuation
-        // (If distinguishing words and punctuation)
-        if (isspace(snap->input[snap->cursor])
-            || (!full_word && isalnum(snap->input[snap->cursor]) != alnum))
-        {
-            return snap->cursor - 1;
-        }
-    }
-    // No next word found
-    // Go to end of line
-    return snap->input_len - 1;
-}
-
-int find_word_back(Snap *const snap, const bool full_word) {
-    // At start of line
-    if (snap->cursor <= 1) {
-        return 0;
-    }
-    // Start at previous character
-    --snap->cursor;
-    // On a sequence of spaces (>=1)
-    // Look for end of previous word, start from there instead
-    while (snap->cursor > 0 && isspace(snap->input[snap->cursor])) {
-        --snap->cursor;
-    }
-    // Now on a non-space
-    int alnum = isalnum(snap->input[snap->cursor]);
-    while (snap->cursor > 0) {
-        snap->cursor--;
-        // Space found
-        // OR first punctuation before word
-        // OR first word before punctuation
-        // Word starts at next index
-        // (If distinguishing words and punctuation)
-        if (isspace(snap->input[snap->cursor])
-            || (!full_word && isalnum(snap->input[snap->cursor]) != alnum))
-        {
-            return snap->cursor + 1;
+    uint32_t len;
+    char *const text = form_output(&form, values, form_json, &len);
+    bool saved = write_output(form_filename, form_output_fd, text, len);
+    free(text);
+    for (uint32_t i = 0; i < field_count; ++i) {
+        if (fields[i].state.filename != NULL) {
+            saved = save_input(&fields[i].state) && saved;
         }
     }
-    // No previous word found
-    // Go to start of line
-    return 0;
+    return saved;
+}
+
+// Returns false if any line could not be saved
+bool save(void) {
+    return form.count > 0 ? save_form() : save_input(&fields[0].state);
 }
 
-bool equals_snap_input(const Snap *const a, const Snap *const b) {
-    if (a->input_len != b->input_len) {
+// Save accepted lines, and add them to recalled lines
+// Returns false if they could not be saved
+bool submit(void) {
+    if (!save()) {
         return false;
     }
-    for (uint32_t i = 0; i < a->input_len; ++i) {
-        if (a->input[i] != b->input[i]) {
-            return false;
+    for (uint32_t i = 0; i < field_count; ++i) {
+        const State *const state = &fields[i].state;
+        if (state->recall != NULL) {
+            recall_append(state->recall, &state->snap.input);
         }
     }
     return true;
 }
 
-void copy_snap(const Snap *const src, Snap *const dest) {
-    memcpy(dest, src, sizeof(Snap));
+void close_screen() {
+    backend->close();
 }
 
-void push_history(State *const state) {
-    // Delete all future history to be overwritten
-    if (state->history.index <= state->history.len) {
-        state->history.len = state->history.index;
+void terminate() {
+    close_screen();
+    exit(0);
+}
+
+// Set cell, and the right half of a wide character
+// Unprintable bytes are shown as `?`
+void set_cell(Cell *const cells, Cell cell, const uint32_t width) {
+    if (cell.len == 1 && !isprint((unsigned char) cell.text[0])) {
+        cell.text[0] = '?';
     }
-    // Ignore if same as last entry
-    if (state->history.len > 0
-        && equals_snap_input(
-            &state->snap, &state->history.snaps[state->history.len - 1]
-        ))
-    {
-        return;
+    cells[0] = cell;
+    if (width > 1) {
+        cells[1] = (Cell) {.len = 0, .style = cell.style};
     }
-    if (state->history.len >= MAX_HISTORY) {
-        for (uint32_t i = 1; i < state->history.len; ++i) {
-            copy_snap(&state->history.snaps[i], &state->history.snaps[i - 1]);
+}
+
+// Score candidates against whole input
+void update_picker(const State *const state) {
+    static char *query = NULL;
+    static uint32_t capacity = 0;
+    const uint32_t len = buffer_len(&state->snap.input);
+    if (len > capacity) {
+        capacity = len;
+        query = realloc(query, capacity);
+        if (query == NULL) {
+            perror("Failed to allocate query");
+            exit(1);
         }
-    } else {
-        ++state->history.len;
-        ++state->history.index;
     }
-
-    copy_snap(&state->snap, &state->history.snaps[state->history.index - 1]);
+    buffer_copy(&state->snap.input, 0, len, query);
+    picker_update(picker, query, len);
 }
 
-void undo_history(State *const state) {
-    if (state->history.len == 0 || state->history.index <= 0) {
-        return;
+// Tell what is cached about the line where it was last edited
+void take_edits(Field *const field) {
+    const uint32_t edited = buffer_take_edited(&field->state.snap.input);
+    if (validating) {
+        validator_edited(&field->validator, edited);
+    }
+    if (highlighting) {
+        highlight_edited(&field->highlighter, edited);
     }
-    --state->history.index;
-    copy_snap(&state->history.snaps[state->history.index], &state->snap);
 }
 
-void redo_history(State *const state) {
-    if (state->history.index + 1 >= state->history.len) {
-        return;
-    }
-    ++state->history.index;
-    copy_snap(&state->history.snaps[state->history.index], &state->snap);
+// Whether line may be accepted
+// Only the part edited since last checked is matched again
+bool line_matches(Field *const field) {
+    take_edits(field);
+    return !validating
+        || validator_matches(&field->validator, &field->state.snap.input);
 }
 
-void save_input(const State *const state) {
-    // If no output file is specified, print instead
-    if (state->filename == NULL) {
-        for (uint32_t i = 0; i < state->snap.input_len; ++i) {
-            printf("%c", state->snap.input[i]);
+// Whether every field may be accepted, else go to the first which may not
+bool fields_match(void) {
+    for (uint32_t i = 0; i < field_count; ++i) {
+        if (!line_matches(&fields[i])) {
+            current = i;
+            return false;
         }
-        printf("\n");
-        return;
     }
+    return true;
+}
 
-    FILE *file = fopen(state->filename, "w");
-    if (file == NULL) {
-        perror("Failed to open file");
-        exit(1);
+// Go to next field on <CR>, or check all fields on the last one
+// Returns whether every field is accepted
+bool next_field(void) {
+    // Refused, and box shows line does not match
+    if (!line_matches(&fields[current])) {
+        return false;
     }
-
-    for (uint32_t i = 0; i < state->snap.input_len; ++i) {
-        if (fprintf(file, "%c", state->snap.input[i]) < 1) {
-            perror("Failed to write file");
-            exit(1);
-        }
+    if (current + 1 < field_count) {
+        ++current;
+        return false;
     }
+    return fields_match();
+}
 
-    if (fclose(file) != 0) {
-        perror("Failed to close file");
+// Best matches, in rows below input box, with matched bytes highlighted
+void draw_picker(
+    const State *const state,
+    const Match *const top,
+    const uint32_t count,
+    const int max_rows
+) {
+    const Buffer *const input = &state->snap.input;
+    const uint32_t query_len = buffer_len(input);
+    char *const query = malloc(query_len + 1);
+    uint32_t *const positions = malloc((query_len + 1) * sizeof(uint32_t));
+    if (query == NULL || positions == NULL) {
+        perror("Failed to allocate query");
         exit(1);
     }
+    buffer_copy(input, 0, query_len, query);
+    const bool fold = fuzzy_fold(query, query_len);
+
+    const uint32_t width = input_box.width + 2;
+    const uint32_t first_row = input_box.y + 3;
+    for (uint32_t row = 0;
+         row < PICKER_TOP && first_row + row + 1 < (uint32_t) max_rows;
+         ++row)
+    {
+        Cell cells[width];
+        for (uint32_t i = 0; i < width; ++i) {
+            cells[i] = (Cell) {.text = {' '}, .len = 1, .style = STYLE_NORMAL};
+        }
+        if (row < count) {
+            if (row == picked) {
+                cells[0] = (Cell) {
+                    .text = {'>'},
+                    .len = 1,
+                    .style = STYLE_MATCH,
+                };
+            }
+            uint32_t len;
+            const char *const text =
+                picker_candidate(picker, top[row].id, &len);
+            // Results may be for an older query, so may not match
+            uint32_t matched = query_len;
+            if (fuzzy_score(text, len, query, query_len, fold, positions)
+                != FUZZY_NONE)
+            {
+                matched = 0;
+            }
+            uint32_t i = 2;
+            uint32_t index = 0;
+            while (index < len) {
+                Cell cell = {.style = STYLE_NORMAL};
+                uint32_t char_width;
+                const uint32_t char_len =
+                    utf8_decode(&text[index], len - index, &char_width);
+                memcpy(cell.text, &text[index], char_len);
+                cell.len = char_len;
+                while (matched < query_len && positions[matched] < index) {
+                    ++matched;
+                }
+                if (matched < query_len
+                    && positions[matched] < index + char_len)
+                {
+                    cell.style = STYLE_MATCH;
+                }
+                index += char_len;
+                if (i + char_width > width) {
+                    break;
+                }
+                set_cell(&cells[i], cell, char_width);
+                i += char_width;
+            }
+        }
+        render_line(&renderer, input_box.x, first_row + row, cells, width);
+    }
+    free(query);
+    free(positions);
 }
 
-void terminate() {
-    endwin();
-    exit(0);
+// Fit input box to terminal, at startup and after resizing
+void resize(void) {
+    int max_rows;
+    int max_cols;
+    backend->size(&max_rows, &max_cols);
+    session_record_size(max_rows, max_cols);
+    if (replay_rows > 0 && replay_rows < max_rows) {
+        max_rows = replay_rows;
+    }
+    if (replay_cols > 0 && replay_cols < max_cols) {
+        max_cols = replay_cols;
+    }
+    render_begin(&renderer, max_rows, max_cols);
+    update_input_box(max_rows, max_cols);
+    for (uint32_t i = 0; i < field_count; ++i) {
+        fields[i].state.width = input_box.width;
+    }
 }
 
-void update_offset_left(Snap *const snap) {
-    if (snap->cursor < snap->offset + CURSOR_LEFT) {
-        snap->offset = subsat(snap->cursor, CURSOR_LEFT);
+// Style cell at `index` by its token, starting from token `token`
+// Returns the token, so the next cell does not search again
+uint32_t token_style(
+    const Highlighter *const highlighter,
+    uint32_t token,
+    const uint32_t index,
+    Cell *const cell
+) {
+    const Token *const tokens = highlighter->tokens;
+    while (token < highlighter->count
+           && tokens[token].start + tokens[token].len <= index)
+    {
+        ++token;
     }
+    if (token < highlighter->count && tokens[token].start <= index) {
+        cell->style = TOKEN_STYLES[tokens[token].kind];
+    }
+    return token;
 }
 
-void update_offset_right(Snap *const snap, const uint32_t width) {
-    const uint32_t cursor_right = (snap->cursor + 1 >= snap->input_len)
-        ? CURSOR_RIGHT_EMPTY
-        : CURSOR_RIGHT_FULL;
-    if (snap->cursor + cursor_right > snap->offset + width) {
-        snap->offset = subsat(snap->cursor + cursor_right, width);
+// Set cells to text in one style, cut off after `width` columns
+void set_text(
+    Cell *const cells,
+    const uint32_t width,
+    const char *const text,
+    const Style style
+) {
+    const uint32_t len = strlen(text);
+    uint32_t i = 0;
+    uint32_t index = 0;
+    while (index < len) {
+        Cell cell = {.style = style};
+        uint32_t char_width;
+        const uint32_t char_len =
+            utf8_decode(&text[index], len - index, &char_width);
+        memcpy(cell.text, &text[index], char_len);
+        cell.len = char_len;
+        index += char_len;
+        if (i + char_width > width) {
+            break;
+        }
+        set_cell(&cells[i], cell, char_width);
+        i += char_width;
     }
 }
 
-bool in_visual_select(const State *const state, const uint32_t index) {
-    if (state->snap.cursor == state->visual_start) {
-        return index == state->visual_start;
+// Top row of box of field
+uint32_t field_y(const uint32_t field) {
+    return input_box.y + (field - first_field) * FORM_FIELD_ROWS;
+}
+
+// Show current field of form, clearing fields which are scrolled away
+void scroll_form(void) {
+    uint32_t first = min(first_field, form.count - visible_fields);
+    if (current < first) {
+        first = current;
+    } else if (current >= first + visible_fields) {
+        first = current + 1 - visible_fields;
     }
-    if (state->snap.cursor < state->visual_start) {
-        return index >= state->snap.cursor && index <= state->visual_start;
+    if (first != first_field) {
+        first_field = first;
+        render_clear(&renderer);
     }
-    return index >= state->visual_start && index <= state->snap.cursor;
 }
 
-void frame(State *const state, int *const key) {
-    clear();
-
-    int max_rows = getmaxy(stdscr);
-    int max_cols = getmaxx(stdscr);
-    update_input_box(max_rows, max_cols);
+// Label, box and visible part of line, with box at row `y`
+void draw_field(Field *const field, const uint32_t y, const bool active) {
+    const State *const state = &field->state;
+    take_edits(field);
+    const Buffer *const input = &state->snap.input;
+
+    if (field->label != NULL) {
+        const uint32_t width = input_box.width + 2;
+        Cell cells[width];
+        for (uint32_t i = 0; i < width; ++i) {
+            cells[i] = (Cell) {.text = {' '}, .len = 1, .style = STYLE_NORMAL};
+        }
+        set_text(
+            &cells[1],
+            width - 1,
+            field->label,
+            active ? STYLE_LABEL : STYLE_PLACEHOLDER
+        );
+        render_line(&renderer, input_box.x, y - 1, cells, width);
+    }
 
-    attron(ATTR_BOX);
-    draw_box_outline(
+    render_box(
+        &renderer,
         input_box.x,
-        input_box.y,
+        y,
         input_box.width + 2,
         state->snap.offset > 0,
-        state->snap.offset + input_box.width < state->snap.input_len
+        state->snap.offset + input_box.width < total_columns(input),
+        !line_matches(field)
     );
-    attroff(ATTR_BOX);
 
-    move(input_box.y + 1, input_box.x + 1);
-    if (state->snap.input_len > 0) {
-        for (uint32_t i = 0; i < input_box.width; ++i) {
-            uint32_t index = i + state->snap.offset;
-            if (index >= state->snap.input_len) {
-                break;
+    Cell cells[input_box.width];
+    for (uint32_t i = 0; i < input_box.width; ++i) {
+        cells[i] = (Cell) {.text = {' '}, .len = 1, .style = STYLE_NORMAL};
+    }
+    if (buffer_len(input) > 0) {
+        uint32_t column;
+        uint32_t index = column_index(input, state->snap.offset, &column);
+        // Only visible tokens are found
+        uint32_t token = 0;
+        if (highlighting) {
+            uint32_t end_column;
+            const uint32_t end = column_index(
+                input, state->snap.offset + input_box.width, &end_column
+            );
+            token = highlight_range(&field->highlighter, input, index, end);
+        }
+        while (index < buffer_len(input)) {
+            Cell cell = {.style = STYLE_NORMAL};
+            uint32_t width;
+            const uint32_t len = char_at(input, index, cell.text, &width);
+            cell.len = len;
+            if (highlighting) {
+                token = token_style(&field->highlighter, token, index, &cell);
             }
             if (state->mode == MODE_VISUAL && in_visual_select(state, index)) {
-                attron(ATTR_VISUAL);
+                cell.style = STYLE_VISUAL;
             }
-            printw("%c", state->snap.input[index]);
-            attroff(ATTR_VISUAL);
-        }
-    } else if (state->placeholder != NULL) {
-        attron(ATTR_PLACEHOLDER);
-        for (uint32_t i = 0; i < input_box.width; ++i) {
-            if (state->placeholder[i] == '\0') {
+            index += len;
+            // Wide character cut off by left edge
+            if (column < state->snap.offset) {
+                column += width;
+                continue;
+            }
+            const uint32_t i = column - state->snap.offset;
+            if (i + width > input_box.width) {
                 break;
             }
-            printw("%c", state->placeholder[i]);
+            set_cell(&cells[i], cell, width);
+            column += width;
         }
-        attroff(ATTR_PLACEHOLDER);
+    } else if (state->placeholder != NULL) {
+        set_text(cells, input_box.width, state->placeholder, STYLE_PLACEHOLDER);
+    }
+    render_line(&renderer, input_box.x + 1, y + 1, cells, input_box.width);
+}
+
+void draw(const int key) {
+    const uint64_t render_start = stats_start();
+    const State *const state = &fields[current].state;
+    const Buffer *const input = &state->snap.input;
+    const int max_rows = renderer.rows;
+
+    if (form.count > 0) {
+        scroll_form();
+    }
+    for (uint32_t i = first_field; i < first_field + visible_fields; ++i) {
+        draw_field(&fields[i], field_y(i), i == current);
     }
 
-    move(max_rows - 1, 0);
-    attron(ATTR_DETAILS);
-    printw("%8s", mode_name(state->mode));
-    printw(" [%3d /%3d]", state->snap.cursor, state->snap.input_len);
-    printw(" [%3d /%3d]", state->history.index, state->history.len);
-    printw(" 0x%02x", *key);
-    attroff(ATTR_DETAILS);
+    Match top[PICKER_TOP];
+    uint32_t top_count = 0;
+    uint32_t matched = 0;
+    uint32_t total = 0;
+    if (picker != NULL) {
+        top_count = picker_results(picker, top, &matched, &total);
+        draw_picker(state, top, top_count, max_rows);
+    }
 
-    set_cursor(state->mode);
-    move(
-        input_box.y + 1,
-        input_box.x + subsat(state->snap.cursor, state->snap.offset) + 1
+    char details[DETAILS_MAX];
+    if (state->mode == MODE_SEARCH) {
+        snprintf(
+            details,
+            DETAILS_MAX,
+            "%8s `%.*s`%s",
+            mode_name(state->mode),
+            (int) state->search.query_len,
+            state->search.query,
+            state->search.failing ? " (not found)" : ""
+        );
+    } else if (picker != NULL) {
+        snprintf(
+            details,
+            DETAILS_MAX,
+            "%8s [%u / %u]",
+            mode_name(state->mode),
+            matched,
+            total
+        );
+    } else {
+        snprintf(
+            details,
+            DETAILS_MAX,
+            "%8s [%3d /%3d] [%3d /%3d] 0x%02x%s%c",
+            mode_name(state->mode),
+            state->snap.cursor,
+            buffer_len(input),
+            state->history.index,
+            state->history.len,
+            key,
+            state->recording != REGISTER_NONE ? " recording @" : "",
+            state->recording != REGISTER_NONE ? 'a' + state->recording : ' '
+        );
+    }
+    stats_summary(details, DETAILS_MAX);
+    render_details(&renderer, max_rows - 1, details);
+
+    const uint32_t cursor_column = index_column(input, state->snap.cursor);
+    render_cursor(
+        &renderer,
+        input_box.x + subsat(cursor_column, state->snap.offset) + 1,
+        field_y(current) + 1,
+        state->mode == MODE_INSERT || state->mode == MODE_SEARCH
     );
+    stats_end(PHASE_RENDER, render_start);
 
-    refresh();
+    const uint64_t flush_start = stats_start();
+    const ssize_t frame_bytes = backend->flush();
+    stats_end(PHASE_FLUSH, flush_start);
+    if (stats_enabled && frame_bytes >= 0) {
+        stats_record_frame(frame_bytes);
+    }
+    if (key_time != 0) {
+        stats_end(PHASE_LATENCY, key_time);
+        key_time = 0;
+    }
+}
 
-    *key = getch();
+// Key of a paste from the terminal, waiting for it if need be
+int next_paste_key(void) {
+    const int key = backend->read_key(-1);
+    if (key != K_NONE) {
+        session_record_key(key);
+    }
+    return key;
+}
 
-    switch (state->mode) {
-        case MODE_NORMAL:
-            switch (*key) {
-                case 'q':
-                    endwin();
-                    exit(0);
-                    break;
-                case K_RETURN:
-                    endwin();
-                    save_input(state);
-                    exit(0);
-                    break;
-                case 'r':
-                    state->mode = MODE_REPLACE;
-                    break;
-                case 'v':
-                    state->mode = MODE_VISUAL;
-                    state->visual_start = state->snap.cursor;
-                    break;
-                case 'V':
-                    state->mode = MODE_VISUAL;
-                    state->visual_start = 0;
-                    state->snap.cursor = state->snap.input_len - 1;
-                    break;
-                case 'i':
-                    state->mode = MODE_INSERT;
-                    break;
-                case 'a':
-                    state->mode = MODE_INSERT;
-                    if (state->snap.cursor < state->snap.input_len) {
-                        ++state->snap.cursor;
-                    }
-                    break;
-                case 'I':
-                    state->mode = MODE_INSERT;
-                    state->snap.cursor = 0;
-                    state->snap.offset = 0;
-                    break;
-                case 'A':
-                    state->mode = MODE_INSERT;
-                    state->snap.cursor = state->snap.input_len;
-                    state->snap.offset =
-                        subsat(state->snap.cursor + 1, input_box.width);
-                    break;
-                case 'h':
-                case KEY_LEFT:
-                    if (state->snap.cursor > 0) {
-                        --state->snap.cursor;
-                        update_offset_left(&state->snap);
-                    }
-                    break;
-                case 'l':
-                case KEY_RIGHT:
-                    if (state->snap.cursor < MAX_INPUT - 1
-                        && state->snap.cursor < state->snap.input_len - 1)
-                    {
-                        ++state->snap.cursor;
-                        update_offset_right(&state->snap, input_box.width);
-                    }
-                    break;
-                case 'w':
-                    state->snap.cursor = find_word_start(&state->snap, FALSE);
-                    update_offset_right(&state->snap, input_box.width);
-                    break;
-                case 'e':
-                    state->snap.cursor = find_word_end(&state->snap, FALSE);
-                    update_offset_right(&state->snap, input_box.width);
-                    break;
-                case 'b':
-                    state->snap.cursor = find_word_back(&state->snap, FALSE);
-                    update_offset_left(&state->snap);
-                    break;
-                case 'W':
-                    state->snap.cursor = find_word_start(&state->snap, TRUE);
-                    update_offset_right(&state->snap, input_box.width);
-                    break;
-                case 'E':
-                    state->snap.cursor = find_word_end(&state->snap, TRUE);
-                    update_offset_right(&state->snap, input_box.width);
-                    break;
-                case 'B':
-                    state->snap.cursor = find_word_back(&state->snap, TRUE);
-                    update_offset_left(&state->snap);
-                    break;
-                case '^':
-                case '_':
-                    for (state->snap.cursor = 0;
-                         state->snap.cursor < state->snap.input_len;
-                         ++state->snap.cursor)
-                    {
-                        if (!isspace(state->snap.input[state->snap.cursor])) {
-                            break;
-                        }
-                    }
-                    update_offset_left(&state->snap);
-                    break;
-                case '0':
-                    state->snap.cursor = 0;
-                    state->snap.offset = 0;
-                    break;
-                case '$':
-                    state->snap.cursor = state->snap.input_len - 1;
-                    state->snap.offset =
-                        subsat(state->snap.cursor + 2, input_box.width);
-                    break;
-                case 'D':
-                    state->snap.input_len = state->snap.cursor;
-                    push_history(state);
-                    break;
-                case 'x':
-                    if (state->snap.input_len > 0) {
-                        for (uint32_t i = state->snap.cursor + 1;
-                             i < state->snap.input_len;
-                             ++i)
-                        {
-                            state->snap.input[i - 1] = state->snap.input[i];
-                        }
-                        --state->snap.input_len;
-                        if (state->snap.cursor >= state->snap.input_len
-                            && state->snap.input_len > 0)
-                        {
-                            state->snap.cursor = state->snap.input_len - 1;
-                        }
-                        update_offset_left(&state->snap);
-                        push_history(state);
-                    }
-                    break;
-                case 'u':
-                    undo_history(state);
-                    break;
-                case CTRL('r'):
-                    redo_history(state);
-                    break;
-                default:
-                    break;
+// Key of a paste being replayed, or the end of it if the session ends
+int next_replay_key(void) {
+    SessionEvent event;
+    while (replay_next(&replay, &event)) {
+        if (!event.resize) {
+            return event.key;
+        }
+    }
+    return K_PASTE_END;
+}
+
+// Read bracketed paste, keeping only printable characters and UTF-8 bytes
+// Ends early if no key can be read while waiting, as when the terminal is
+// gone, which is then found by the loop
+char *read_paste(int (*const next_key)(void), uint32_t *const len) {
+    char *text = NULL;
+    uint32_t capacity = 0;
+    *len = 0;
+    int key;
+    while ((key = next_key()) != K_PASTE_END && key != K_NONE) {
+        if (key > 0xff || (key < 0x80 && !isprint(key))) {
+            continue;
+        }
+        if (*len >= capacity) {
+            capacity = capacity > 0 ? capacity * 2 : 256;
+            text = realloc(text, capacity);
+            if (text == NULL) {
+                perror("Failed to allocate paste");
+                exit(1);
             }
-            break;
+        }
+        text[(*len)++] = key;
+    }
+    return text;
+}
 
-        case MODE_INSERT:
-            switch (*key) {
-                case K_ESCAPE:
-                    state->mode = MODE_NORMAL;
-                    if (state->snap.cursor > 0) {
-                        --state->snap.cursor;
-                    }
-                    push_history(state);
-                    break;
-                case K_RETURN:
-                    endwin();
-                    save_input(state);
-                    exit(0);
-                    break;
-                case K_LEFT:
-                    if (state->snap.cursor > 0) {
-                        --state->snap.cursor;
-                        update_offset_left(&state->snap);
-                    }
-                    break;
-                case K_RIGHT:
-                    if (state->snap.cursor < MAX_INPUT
-                        && state->snap.cursor < state->snap.input_len)
-                    {
-                        ++state->snap.cursor;
-                        update_offset_right(&state->snap, input_box.width);
-                    }
-                    break;
-                case K_BACKSPACE:
-                    if (state->snap.cursor > 0 && state->snap.input_len > 0) {
-                        for (uint32_t i = state->snap.cursor;
-                             i < state->snap.input_len;
-                             ++i)
-                        {
-                            state->snap.input[i - 1] = state->snap.input[i];
-                        }
-                        for (uint32_t i = state->snap.input_len; i < MAX_INPUT;
-                             ++i)
-                        {
-                            state->snap.input[i] = '.';
-                        }
-                        --state->snap.input_len;
-                        --state->snap.cursor;
-                        update_offset_left(&state->snap);
-                    }
-                    break;
-                default:
-                    if (isprint(*key) && state->snap.input_len < MAX_INPUT) {
-                        for (uint32_t i = state->snap.input_len;
-                             i >= state->snap.cursor + 1;
-                             --i)
-                        {
-                            state->snap.input[i] = state->snap.input[i - 1];
-                        }
-                        state->snap.input[state->snap.cursor] = *key;
-                        ++state->snap.cursor;
-                        ++state->snap.input_len;
-                        update_offset_right(&state->snap, input_box.width);
-                    }
-                    break;
-            };
-            break;
+// Whether key moves picker selection, or chooses a candidate
+bool is_pick_key(const State *const state, const int key) {
+    if (picker == NULL
+        || (state->mode != MODE_NORMAL && state->mode != MODE_INSERT))
+    {
+        return false;
+    }
+    switch (key) {
+        case K_UP:
+        case K_DOWN:
+        case CTRL('p'):
+        case CTRL('n'):
+        case K_RETURN:
+            return true;
+        default:
+            return false;
+    }
+}
 
-        case MODE_REPLACE:
-            switch (*key) {
-                case K_ESCAPE:
-                    state->mode = MODE_NORMAL;
-                    break;
-                default:
-                    if (isprint(*key)) {
-                        state->snap.input[state->snap.cursor] = *key;
-                        state->mode = MODE_NORMAL;
-                        push_history(state);
-                    }
-                    break;
+// Move picker selection, or replace input with selected candidate on <CR>
+// Returns whether key was used
+bool pick_key(State *const state, const int key) {
+    if (!is_pick_key(state, key)) {
+        if (picker != NULL) {
+            picked = 0;
+        }
+        return false;
+    }
+    Match top[PICKER_TOP];
+    uint32_t matched;
+    uint32_t total;
+    const uint32_t count = picker_results(picker, top, &matched, &total);
+    switch (key) {
+        case K_UP:
+        case CTRL('p'):
+            if (picked > 0) {
+                --picked;
             }
-            break;
+            return true;
+        case K_DOWN:
+        case CTRL('n'):
+            if (picked + 1 < count) {
+                ++picked;
+            }
+            return true;
+        default:
+            // Then submitted as usual
+            if (picked < count) {
+                uint32_t len;
+                const char *const text =
+                    picker_candidate(picker, top[picked].id, &len);
+                splice_input(
+                    state, 0, buffer_len(&state->snap.input), text, len
+                );
+            }
+            return false;
+    }
+}
 
-        case MODE_VISUAL: {
-            uint32_t start = min(state->snap.cursor, state->visual_start);
-            uint32_t size =
-                difference(state->snap.cursor, state->visual_start) + 1;
-            switch (*key) {
-                case K_ESCAPE:
-                    state->mode = MODE_NORMAL;
-                    break;
-                case 'h':
-                case KEY_LEFT:
-                    if (state->snap.cursor > 0) {
-                        --state->snap.cursor;
-                        update_offset_left(&state->snap);
-                    }
-                    break;
-                case 'l':
-                case KEY_RIGHT:
-                    if (state->snap.cursor < MAX_INPUT - 1
-                        && state->snap.cursor < state->snap.input_len - 1)
-                    {
-                        ++state->snap.cursor;
-                        update_offset_right(&state->snap, input_box.width);
-                    }
-                    break;
-                case 'w':
-                    state->snap.cursor = find_word_start(&state->snap, FALSE);
-                    update_offset_right(&state->snap, input_box.width);
-                    break;
-                case 'e':
-                    state->snap.cursor = find_word_end(&state->snap, FALSE);
-                    update_offset_right(&state->snap, input_box.width);
-                    break;
-                case 'b':
-                    state->snap.cursor = find_word_back(&state->snap, FALSE);
-                    update_offset_left(&state->snap);
-                    break;
-                case 'W':
-                    state->snap.cursor = find_word_start(&state->snap, TRUE);
-                    update_offset_right(&state->snap, input_box.width);
-                    break;
-                case 'E':
-                    state->snap.cursor = find_word_end(&state->snap, TRUE);
-                    update_offset_right(&state->snap, input_box.width);
-                    break;
-                case 'B':
-                    state->snap.cursor = find_word_back(&state->snap, TRUE);
-                    update_offset_left(&state->snap);
-                    break;
-                case '^':
-                case '_':
-                    for (state->snap.cursor = 0;
-                         state->snap.cursor < state->snap.input_len;
-                         ++state->snap.cursor)
-                    {
-                        if (!isspace(state->snap.input[state->snap.cursor])) {
-                            break;
-                        }
-                    }
-                    update_offset_left(&state->snap);
-                    break;
-                case '0':
-                    state->snap.cursor = 0;
-                    state->snap.offset = 0;
-                    break;
-                case '$':
-                    state->snap.cursor = state->snap.input_len - 1;
-                    state->snap.offset =
-                        subsat(state->snap.cursor + 2, input_box.width);
-                    break;
-                case 'd':
-                case 'x': {
-                    for (uint32_t i = start; i <= state->snap.input_len - size;
-                         ++i)
-                    {
-                        uint32_t new = i + size;
-                        if (new >= state->snap.input_len) {
-                            break;
-                        }
-                        state->snap.input[i] = state->snap.input[new];
-                    }
-                    state->snap.input_len -= size;
-                    if (state->snap.cursor > state->visual_start) {
-                        state->snap.cursor -= size - 1;
-                    }
-                    if (state->snap.cursor + 1 >= state->snap.input_len) {
-                        state->snap.cursor = subsat(state->snap.input_len, 1);
-                    }
-                    state->mode = MODE_NORMAL;
-                    push_history(state);
-                } break;
-                case 'u': {
-                    for (uint32_t i = 0; i < size; ++i) {
-                        state->snap.input[start + i] =
-                            tolower(state->snap.input[start + i]);
-                    }
-                    if (state->snap.cursor > state->visual_start) {
-                        state->snap.cursor -= size - 1;
-                    }
-                    state->mode = MODE_NORMAL;
-                    push_history(state);
-                }; break;
-                case 'U': {
-                    for (uint32_t i = 0; i < size; ++i) {
-                        state->snap.input[start + i] =
-                            toupper(state->snap.input[start + i]);
-                    }
-                    if (state->snap.cursor > state->visual_start) {
-                        state->snap.cursor -= size - 1;
-                    }
-                    state->mode = MODE_NORMAL;
-                    push_history(state);
-                }; break;
-                default:
-                    break;
+// Move between fields of a form with <C-n>/<C-p>
+// Returns whether key was used
+bool form_key(const State *const state, const int key) {
+    if (form.count == 0
+        || (state->mode != MODE_NORMAL && state->mode != MODE_INSERT))
+    {
+        return false;
+    }
+    switch (key) {
+        case CTRL('n'):
+            if (current + 1 < field_count) {
+                ++current;
+            }
+            return true;
+        case CTRL('p'):
+            if (current > 0) {
+                --current;
             }
-        } break;
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Handle key in current field
+// Returns `ACTION_SUBMIT` only once every field is accepted
+enum Action field_key(const int key) {
+    State *const state = &fields[current].state;
+    const enum VimMode mode = state->mode;
+    const uint64_t start = stats_start();
+    enum Action action = ACTION_NONE;
+    if (!form_key(state, key) && !pick_key(state, key)) {
+        action = handle_key(state, key);
+    }
+    if (stats_enabled) {
+        stats_record_key(mode, key, stats_since(start));
+    }
+    if (action == ACTION_SUBMIT && !next_field()) {
+        action = ACTION_NONE;
+    }
+    return action;
+}
+
+// Handle key without drawing
+// Macros and repeats run all their keys here, so are drawn once
+void dispatch_key(const int key) {
+    switch (field_key(key)) {
+        case ACTION_SUBMIT:
+            close_screen();
+            exit(submit() ? 0 : 1);
+        case ACTION_QUIT:
+            close_screen();
+            exit(0);
+        default:
+            break;
+    }
+}
+
+// Read key already waiting, or `K_NONE`
+int read_waiting_key(void) {
+    const uint64_t start = stats_start();
+    const int key = backend->read_key(0);
+    stats_end(PHASE_READ, start);
+    if (key != K_NONE) {
+        session_record_key(key);
+    }
+    return key;
+}
+
+// Handle all keys waiting on terminal, before drawing again
+void on_input(void *const data, const short events) {
+    (void) data;
+    int next = read_waiting_key();
+    if (next == K_NONE && (events & (POLLHUP | POLLERR))) {
+        close_screen();
+        fprintf(stderr, "Terminal was closed.\n");
+        exit(1);
+    }
+    // Typing would change what the session does
+    if (replaying) {
+        while (next != K_NONE) {
+            next = read_waiting_key();
+        }
+        return;
+    }
+    if (next != K_NONE) {
+        key_time = stats_start();
+    }
+    while (next != K_NONE) {
+        if (next == K_PASTE_START) {
+            uint32_t len;
+            // Wait for end of paste, even if it arrives in pieces
+            char *const text = read_paste(next_paste_key, &len);
+            paste_input(&fields[current].state, text, len);
+            free(text);
+        } else {
+            dispatch_key(next);
+        }
+        last_key = next;
+        next = read_waiting_key();
+    }
+}
+
+// Resize once for any number of resize signals, and stop on others
+void on_signal(void *const data, const short events) {
+    (void) data;
+    (void) events;
+    bool resized = false;
+    struct signalfd_siginfo info;
+    while (read(signal_fd, &info, sizeof(info)) == sizeof(info)) {
+        if (info.ssi_signo == SIGWINCH) {
+            resized = true;
+        } else {
+            terminate();
+        }
+    }
+    if (resized) {
+        backend->resize();
+        resize();
+    }
+}
+
+// Only wakes loop, so picker results are drawn
+void on_picker_timer(void *const data, const short events) {
+    (void) data;
+    (void) events;
+}
+
+void on_timeout(void *const data, const short events) {
+    (void) data;
+    (void) events;
+    close_screen();
+    if (submit_on_timeout && fields_match()) {
+        exit(submit() ? 0 : 1);
+    }
+    exit(TIMEOUT_STATUS);
+}
+
+void replay_handle(const SessionEvent *const event) {
+    if (event->resize) {
+        replay_rows = event->rows;
+        replay_cols = event->cols;
+        resize();
+        return;
+    }
+    key_time = stats_start();
+    if (event->key == K_PASTE_START) {
+        uint32_t len;
+        char *const text = read_paste(next_replay_key, &len);
+        paste_input(&fields[current].state, text, len);
+        free(text);
+    } else {
+        dispatch_key(event->key);
+    }
+    last_key = event->key;
+}
+
+// Handle events of session once they are due, as they were recorded
+void on_replay(void *const data, const short events) {
+    (void) data;
+    (void) events;
+    const uint64_t elapsed = session_now() - replay_start;
+    while (replaying && (replay_fast || replay_event.time <= elapsed)) {
+        replay_handle(&replay_event);
+        replaying = replay_next(&replay, &replay_event);
+        // Drawn after each event, as if typed as fast as possible
+        if (replay_fast) {
+            break;
+        }
+    }
+    if (!replaying) {
+        return;
     }
+    // Rounded up, so the timer never fires before the event is due
+    const uint64_t now = session_now() - replay_start;
+    const uint64_t delay_ms = !replay_fast && replay_event.time > now
+        ? (replay_event.time - now + 999999) / 1000000
+        : 0;
+    loop_arm(&loop, replay_timer, delay_ms);
+}
+
+void frame(void *const data, const short events) {
+    (void) data;
+    (void) events;
+    if (picker != NULL) {
+        update_picker(&fields[0].state);
+        // Keep drawing while results are coming in
+        if (picker_busy(picker)) {
+            loop_arm(&loop, picker_timer, PICKER_POLL_MS);
+        }
+    }
+    draw(last_key);
 }
 
 #define cli_panic(...)                \
@@ -784,15 +939,49 @@ void frame(State *const state, int *const key) {
 
 typedef struct Arguments {
     const char *filename;
+    int output_fd;
     const char *value;
+    const char *input_filename;
     const char *placeholder;
+    const char *keys_filename;
+    const char *history_filename;
+    const char *completions_filename;
+    const char *list_filename;
+    const char *backend_name;
+    const char *socket_filename;
+    const char *pattern;
+    const char *syntax;
+    const char *form_filename;
+    bool json;
+    uint64_t timeout_ms;  // 0 if none
+    bool submit_on_timeout;
+    const char *record_filename;
+    const char *replay_filename;
+    bool replay_fast;
 } Arguments;
 
 enum ArgOption {
     OPT_HELP,
     OPT_FILENAME,
+    OPT_OUTPUT_FD,
     OPT_VALUE,
+    OPT_INPUT_FILENAME,
     OPT_PLACEHOLDER,
+    OPT_KEYS,
+    OPT_HISTORY,
+    OPT_COMPLETIONS,
+    OPT_LIST,
+    OPT_BACKEND,
+    OPT_SERVE,
+    OPT_TIMEOUT,
+    OPT_TIMEOUT_SUBMIT,
+    OPT_REGEX,
+    OPT_SYNTAX,
+    OPT_FORM,
+    OPT_JSON,
+    OPT_RECORD,
+    OPT_REPLAY,
+    OPT_REPLAY_FAST,
 };
 
 enum ArgOption parse_argument_option(const char *const arg) {
@@ -807,8 +996,20 @@ enum ArgOption parse_argument_option(const char *const arg) {
             return OPT_FILENAME;
         case 'v':
             return OPT_VALUE;
+        case 'i':
+            return OPT_INPUT_FILENAME;
         case 'p':
             return OPT_PLACEHOLDER;
+        case 'k':
+            return OPT_KEYS;
+        case 'c':
+            return OPT_COMPLETIONS;
+        case 'l':
+            return OPT_LIST;
+        case 'b':
+            return OPT_BACKEND;
+        case 'r':
+            return OPT_REGEX;
         case '-': {
             const char *const name = &arg[2];
             if (!strcmp(name, "help")) {
@@ -817,27 +1018,144 @@ enum ArgOption parse_argument_option(const char *const arg) {
             if (!strcmp(name, "output")) {
                 return OPT_FILENAME;
             }
+            if (!strcmp(name, "output-fd")) {
+                return OPT_OUTPUT_FD;
+            }
             if (!strcmp(name, "value")) {
-                return OPT_PLACEHOLDER;
+                return OPT_VALUE;
+            }
+            if (!strcmp(name, "input-file")) {
+                return OPT_INPUT_FILENAME;
             }
             if (!strcmp(name, "placeholder")) {
                 return OPT_PLACEHOLDER;
             }
+            if (!strcmp(name, "keys")) {
+                return OPT_KEYS;
+            }
+            if (!strcmp(name, "history")) {
+                return OPT_HISTORY;
+            }
+            if (!strcmp(name, "completions")) {
+                return OPT_COMPLETIONS;
+            }
+            if (!strcmp(name, "list")) {
+                return OPT_LIST;
+            }
+            if (!strcmp(name, "backend")) {
+                return OPT_BACKEND;
+            }
+            if (!strcmp(name, "serve")) {
+                return OPT_SERVE;
+            }
+            if (!strcmp(name, "timeout")) {
+                return OPT_TIMEOUT;
+            }
+            if (!strcmp(name, "timeout-submit")) {
+                return OPT_TIMEOUT_SUBMIT;
+            }
+            if (!strcmp(name, "regex")) {
+                return OPT_REGEX;
+            }
+            if (!strcmp(name, "syntax")) {
+                return OPT_SYNTAX;
+            }
+            if (!strcmp(name, "form")) {
+                return OPT_FORM;
+            }
+            if (!strcmp(name, "json")) {
+                return OPT_JSON;
+            }
+            if (!strcmp(name, "record")) {
+                return OPT_RECORD;
+            }
+            if (!strcmp(name, "replay")) {
+                return OPT_REPLAY;
+            }
+            if (!strcmp(name, "replay-fast")) {
+                return OPT_REPLAY_FAST;
+            }
         };
     }
 
     cli_panic("Invalid option `%s`.\n", arg);
 }
 
+// Map file read-only, so startup time does not depend on file size
+const char *map_input_file(const char *const filename, uint32_t *const len) {
+    const int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        perror("Failed to open input file");
+        exit(1);
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        perror("Failed to read input file");
+        exit(1);
+    }
+    if (info.st_size > UINT32_MAX) {
+        cli_panic("Input file is too large.\n");
+    }
+
+    *len = info.st_size;
+    if (*len == 0) {
+        close(fd);
+        return NULL;
+    }
+
+    const char *const text = mmap(NULL, *len, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (text == MAP_FAILED) {
+        perror("Failed to map input file");
+        exit(1);
+    }
+    close(fd);
+
+    // Ignore trailing newline
+    if (text[*len - 1] == '\n') {
+        --*len;
+    }
+    return text;
+}
+
 Arguments parse_arguments(const int argc, const char *const *const argv) {
     Arguments arguments = {
         .filename = NULL,
+        .output_fd = -1,
         .value = NULL,
+        .input_filename = NULL,
         .placeholder = NULL,
+        .keys_filename = NULL,
+        .history_filename = NULL,
+        .completions_filename = NULL,
+        .list_filename = NULL,
+        .backend_name = NULL,
+        .socket_filename = NULL,
+        .pattern = NULL,
+        .syntax = NULL,
+        .form_filename = NULL,
+        .json = false,
+        .timeout_ms = 0,
+        .submit_on_timeout = false,
+        .record_filename = NULL,
+        .replay_filename = NULL,
+        .replay_fast = false,
     };
     bool given_filename = false;
     bool given_value = false;
     bool given_placeholder = false;
+    bool given_keys = false;
+    bool given_history = false;
+    bool given_completions = false;
+    bool given_list = false;
+    bool given_backend = false;
+    bool given_socket = false;
+    bool given_timeout = false;
+    bool given_pattern = false;
+    bool given_syntax = false;
+    bool given_form = false;
+    bool given_record = false;
+    bool given_replay = false;
 
     for (int i = 1; i < argc; ++i) {
         switch (parse_argument_option(argv[i])) {
@@ -854,12 +1172,100 @@ Arguments parse_arguments(const int argc, const char *const *const argv) {
                     "    -h, --help\n"
                     "        Output usage information.\n"
                     "    -o, --output FILENAME\n"
-                    "        Write inputted text to this file on <CR>.\n"
+                    "        Write inputted text to this file on <CR>, "
+                    "replacing it at once.\n"
+                    "    --output-fd FD\n"
+                    "        Write inputted text to this open file "
+                    "descriptor on <CR>, such as a\n"
+                    "        pipe to the parent process.\n"
                     "    -v, --value TEXT\n"
                     "        Set input to this string initially.\n"
+                    "    -i, --input-file FILENAME\n"
+                    "        Set input to contents of this file initially.\n"
                     "    -p, --placeholder TEXT\n"
                     "        Show this text as a placeholder when input is "
                     "empty.\n"
+                    "    -k, --keys FILENAME\n"
+                    "        Handle keys from this file (or `-` for stdin) "
+                    "without a terminal,\n"
+                    "        then write inputted text.\n"
+                    "    --history FILENAME\n"
+                    "        Recall lines from this file with <Up>/<Down> "
+                    "or search them with\n"
+                    "        <C-r> (`/` in normal mode), and add inputted "
+                    "text to it.\n"
+                    "    -c, --completions FILENAME\n"
+                    "        Complete words with <Tab> in insert mode, from "
+                    "this file of one word\n"
+                    "        per line.\n"
+                    "    -l, --list FILENAME\n"
+                    "        Pick from lines of this file (or `-` for stdin) "
+                    "as they are read,\n"
+                    "        matching input fuzzily. <Up>/<Down> select, and "
+                    "<CR> chooses.\n"
+                    "    -b, --backend NAME\n"
+                    "        Draw with `curses` (default), or `term` for raw "
+                    "terminal input and\n"
+                    "        output, which starts faster.\n"
+                    "    --serve SOCKET\n"
+                    "        Listen on this Unix socket, and run a prompt for "
+                    "each `vimline-client`\n"
+                    "        on its terminal. Options given here are used "
+                    "unless the client gives\n"
+                    "        them, and completions are loaded once.\n"
+                    "    --timeout SECONDS\n"
+                    "        Quit with status 124 if no line is accepted in "
+                    "this time.\n"
+                    "    --timeout-submit SECONDS\n"
+                    "        Accept the line as it is after this time.\n"
+                    "    -r, --regex PATTERN\n"
+                    "        Only accept a line which this regular expression "
+                    "matches in full. The\n"
+                    "        box is red while it does not. Patterns may use "
+                    "`|`, `()`, `.`, `*`,\n"
+                    "        `+`, `?`, `{m,n}`, `\\d`, `\\w`, `\\s`, and "
+                    "`[]` classes with ranges\n"
+                    "        and POSIX names like `[:alpha:]`, which match "
+                    "ASCII only.\n"
+                    "    --syntax shell\n"
+                    "        Colour strings, numbers, variables, operators "
+                    "and comments of a shell\n"
+                    "        command.\n"
+                    "    --form SPEC\n"
+                    "        Edit each field of this file in one prompt, "
+                    "moving between them with\n"
+                    "        <C-n>/<C-p>, or <CR> to go to the next or "
+                    "accept all on the last.\n"
+                    "        Each `[Label]` line starts a field, and may be "
+                    "followed by `value`,\n"
+                    "        `placeholder`, `history` and `output` lines "
+                    "like `key = text`.\n"
+                    "        Values are written in order, one per line, "
+                    "as well as to the output\n"
+                    "        file of each field.\n"
+                    "    --json\n"
+                    "        Write values of a form as one JSON object by "
+                    "label.\n"
+                    "    --record FILENAME\n"
+                    "        Write each key read from the terminal, when it "
+                    "was read, and the\n"
+                    "        terminal size, to this file to replay.\n"
+                    "    --replay FILENAME\n"
+                    "        Handle the keys of a recorded session as they "
+                    "were typed, instead of\n"
+                    "        the terminal's, until it ends.\n"
+                    "    --replay-fast FILENAME\n"
+                    "        Replay a session without waiting between keys, "
+                    "drawing after each.\n"
+                    "\n"
+                    "ENVIRONMENT:\n"
+                    "    VIMLINE_STATS=FILENAME\n"
+                    "        Time reading, handling and drawing keys, count "
+                    "bytes sent for each\n"
+                    "        frame, and write them to this file as JSON on "
+                    "exit.\n"
+                    "    VIMLINE_STATS_LIVE=1\n"
+                    "        Show key to frame latency in the status line.\n"
                 );
                 exit(0);
             }
@@ -876,6 +1282,25 @@ Arguments parse_arguments(const int argc, const char *const *const argv) {
                 given_filename = true;
             }; break;
 
+            case OPT_OUTPUT_FD: {
+                if (given_filename) {
+                    cli_panic("Cannot specify filename twice.\n");
+                }
+                ++i;
+                if (i >= argc) {
+                    cli_panic("Expected file descriptor.\n");
+                }
+                char *end;
+                const long fd = strtol(argv[i], &end, 10);
+                if (end == argv[i] || *end != '\0' || fd < 0 || fd > INT_MAX
+                    || fcntl(fd, F_GETFD) < 0)
+                {
+                    cli_panic("Invalid file descriptor `%s`.\n", argv[i]);
+                }
+                arguments.output_fd = fd;
+                given_filename = true;
+            }; break;
+
             case OPT_VALUE: {
                 if (given_value) {
                     cli_panic("Cannot specify initial value twice.\n");
@@ -888,6 +1313,18 @@ Arguments parse_arguments(const int argc, const char *const *const argv) {
                 given_value = true;
             }; break;
 
+            case OPT_INPUT_FILENAME: {
+                if (given_value) {
+                    cli_panic("Cannot specify initial value twice.\n");
+                }
+                ++i;
+                if (i >= argc) {
+                    cli_panic("Expected input filename.\n");
+                }
+                arguments.input_filename = argv[i];
+                given_value = true;
+            }; break;
+
             case OPT_PLACEHOLDER: {
                 if (given_placeholder) {
                     cli_panic("Cannot specify placeholder text twice.\n");
@@ -899,77 +1336,601 @@ Arguments parse_arguments(const int argc, const char *const *const argv) {
                 arguments.placeholder = argv[i];
                 given_placeholder = true;
             }; break;
+
+            case OPT_KEYS: {
+                if (given_keys) {
+                    cli_panic("Cannot specify keys file twice.\n");
+                }
+                ++i;
+                if (i >= argc) {
+                    cli_panic("Expected keys filename.\n");
+                }
+                arguments.keys_filename = argv[i];
+                given_keys = true;
+            }; break;
+
+            case OPT_HISTORY: {
+                if (given_history) {
+                    cli_panic("Cannot specify history file twice.\n");
+                }
+                ++i;
+                if (i >= argc) {
+                    cli_panic("Expected history filename.\n");
+                }
+                arguments.history_filename = argv[i];
+                given_history = true;
+            }; break;
+
+            case OPT_COMPLETIONS: {
+                if (given_completions) {
+                    cli_panic("Cannot specify completions file twice.\n");
+                }
+                ++i;
+                if (i >= argc) {
+                    cli_panic("Expected completions filename.\n");
+                }
+                arguments.completions_filename = argv[i];
+                given_completions = true;
+            }; break;
+
+            case OPT_LIST: {
+                if (given_list) {
+                    cli_panic("Cannot specify list file twice.\n");
+                }
+                ++i;
+                if (i >= argc) {
+                    cli_panic("Expected list filename.\n");
+                }
+                arguments.list_filename = argv[i];
+                given_list = true;
+            }; break;
+
+            case OPT_BACKEND: {
+                if (given_backend) {
+                    cli_panic("Cannot specify backend twice.\n");
+                }
+                ++i;
+                if (i >= argc) {
+                    cli_panic("Expected backend name.\n");
+                }
+                arguments.backend_name = argv[i];
+                given_backend = true;
+            }; break;
+
+            case OPT_SERVE: {
+                if (given_socket) {
+                    cli_panic("Cannot specify socket twice.\n");
+                }
+                ++i;
+                if (i >= argc) {
+                    cli_panic("Expected socket filename.\n");
+                }
+                arguments.socket_filename = argv[i];
+                given_socket = true;
+            }; break;
+
+            case OPT_REGEX: {
+                if (given_pattern) {
+                    cli_panic("Cannot specify pattern twice.\n");
+                }
+                ++i;
+                if (i >= argc) {
+                    cli_panic("Expected pattern.\n");
+                }
+                arguments.pattern = argv[i];
+                given_pattern = true;
+            }; break;
+
+            case OPT_SYNTAX: {
+                if (given_syntax) {
+                    cli_panic("Cannot specify syntax twice.\n");
+                }
+                ++i;
+                if (i >= argc) {
+                    cli_panic("Expected syntax name.\n");
+                }
+                if (strcmp(argv[i], "shell")) {
+                    cli_panic("Invalid syntax `%s`.\n", argv[i]);
+                }
+                arguments.syntax = argv[i];
+                given_syntax = true;
+            }; break;
+
+            case OPT_FORM: {
+                if (given_form) {
+                    cli_panic("Cannot specify form twice.\n");
+                }
+                ++i;
+                if (i >= argc) {
+                    cli_panic("Expected form spec filename.\n");
+                }
+                arguments.form_filename = argv[i];
+                given_form = true;
+            }; break;
+
+            case OPT_JSON: {
+                arguments.json = true;
+            }; break;
+
+            case OPT_RECORD: {
+                if (given_record) {
+                    cli_panic("Cannot specify session to record twice.\n");
+                }
+                ++i;
+                if (i >= argc) {
+                    cli_panic("Expected session filename.\n");
+                }
+                arguments.record_filename = argv[i];
+                given_record = true;
+            }; break;
+
+            case OPT_REPLAY:
+            case OPT_REPLAY_FAST: {
+                if (given_replay) {
+                    cli_panic("Cannot specify session to replay twice.\n");
+                }
+                ++i;
+                if (i >= argc) {
+                    cli_panic("Expected session filename.\n");
+                }
+                arguments.replay_filename = argv[i];
+                arguments.replay_fast =
+                    parse_argument_option(argv[i - 1]) == OPT_REPLAY_FAST;
+                given_replay = true;
+            }; break;
+
+            case OPT_TIMEOUT:
+            case OPT_TIMEOUT_SUBMIT: {
+                if (given_timeout) {
+                    cli_panic("Cannot specify timeout twice.\n");
+                }
+                ++i;
+                if (i >= argc) {
+                    cli_panic("Expected timeout in seconds.\n");
+                }
+                char *end;
+                const double seconds = strtod(argv[i], &end);
+                if (end == argv[i] || *end != '\0' || !(seconds > 0)
+                    || seconds > UINT32_MAX)
+                {
+                    cli_panic("Invalid timeout `%s`.\n", argv[i]);
+                }
+                // At least 1ms, as 0 is no timeout
+                arguments.timeout_ms = seconds * 1000 + 0.5;
+                if (arguments.timeout_ms == 0) {
+                    arguments.timeout_ms = 1;
+                }
+                arguments.submit_on_timeout =
+                    parse_argument_option(argv[i - 1]) == OPT_TIMEOUT_SUBMIT;
+                given_timeout = true;
+            }; break;
         }
     }
 
     return arguments;
 }
 
-int main(const int argc, const char *const *const argv) {
-    const Arguments arguments = parse_arguments(argc, argv);
+// Read whole file, or stdin if filename is `-`
+char *read_keys_file(const char *const filename, size_t *const len) {
+    int fd = STDIN_FILENO;
+    if (strcmp(filename, "-")) {
+        fd = open(filename, O_RDONLY);
+        if (fd < 0) {
+            perror("Failed to open keys file");
+            exit(1);
+        }
+    }
 
-    State state = {
-        .mode = MODE_NORMAL,
-        .snap =
-            {
-                .input = "",
-                .input_len = 0,
-                .cursor = 0,
-                .offset = 0,
-            },
-        .visual_start = 0,
-        .history =
-            {
-                .snaps = {{{0}}},
-                .len = 0,
-                .index = 0,
-            },
-        .placeholder = arguments.placeholder,
-        .filename = arguments.filename,
-    };
+    char *keys = NULL;
+    size_t capacity = 0;
+    *len = 0;
+    while (true) {
+        if (*len >= capacity) {
+            capacity = capacity > 0 ? capacity * 2 : 4096;
+            keys = realloc(keys, capacity);
+            if (keys == NULL) {
+                perror("Failed to allocate keys");
+                exit(1);
+            }
+        }
+        const ssize_t count = read(fd, &keys[*len], capacity - *len);
+        if (count < 0) {
+            perror("Failed to read keys file");
+            exit(1);
+        }
+        if (count == 0) {
+            break;
+        }
+        *len += count;
+    }
 
-    if (arguments.value != NULL) {
-        // Copy string to non-null terminated string, and find length
-        size_t i = 0;
-        for (; i < MAX_INPUT; ++i) {
-            const char ch = arguments.value[i];
-            if (ch == '\0') {
-                break;
+    if (fd != STDIN_FILENO) {
+        close(fd);
+    }
+    return keys;
+}
+
+// Handle keys without a terminal, then save input unless quit
+// Returns false if input could not be saved
+bool run_keys(const char *const filename) {
+    size_t len;
+    char *const keys = read_keys_file(filename, &len);
+
+    size_t i = 0;
+    while (i < len) {
+        int key;
+        i += decode_key(&keys[i], len - i, &key);
+
+        if (key == K_PASTE_START) {
+            // Paste is never longer than rest of keys
+            char *const text = malloc(len - i);
+            if (text == NULL) {
+                perror("Failed to allocate paste");
+                exit(1);
+            }
+            uint32_t text_len = 0;
+            while (i < len) {
+                i += decode_key(&keys[i], len - i, &key);
+                if (key == K_PASTE_END) {
+                    break;
+                }
+                if (key <= 0xff && (key >= 0x80 || isprint(key))) {
+                    text[text_len++] = key;
+                }
             }
-            state.snap.input[i] = ch;
+            paste_input(&fields[current].state, text, text_len);
+            free(text);
+            continue;
+        }
+
+        // Without a terminal, picking waits for all candidates to be scored
+        if (is_pick_key(&fields[current].state, key)) {
+            update_picker(&fields[current].state);
+            picker_wait(picker);
+        }
+        switch (field_key(key)) {
+            case ACTION_SUBMIT:
+                free(keys);
+                return submit();
+            case ACTION_QUIT:
+                free(keys);
+                return true;
+            default:
+                break;
         }
-        state.snap.input_len = i;
-        state.snap.cursor = subsat(i, 1);
     }
 
-    push_history(&state);
+    free(keys);
+    if (!fields_match()) {
+        fprintf(stderr, "Line does not match pattern.\n");
+        return false;
+    }
+    // Same as <CR>
+    return submit();
+}
 
-    // TODO(fix): Push snap on insert
+// Open word list, unless already loaded
+Completions *load_completions(const char *const filename) {
+    // Loaded in the background, so the first frame is not delayed
+    if (completions_filename == NULL || strcmp(completions_filename, filename))
+    {
+        completions_open(&completions, filename);
+        completions_filename = filename;
+    }
+    return &completions;
+}
 
-    initscr();
-    noecho();              // Disable echoing
-    cbreak();              // Disable line buffering
-    keypad(stdscr, TRUE);  // Enable raw key input
-    set_escdelay(0);       // Disable Escape key delay
+// Compile pattern, unless already compiled
+void load_regex(const char *const pattern) {
+    if (regex_pattern != NULL && !strcmp(regex_pattern, pattern)) {
+        return;
+    }
+    if (regex_pattern != NULL) {
+        regex_free(&regex);
+    }
+    const char *error;
+    if (!regex_compile(&regex, pattern, &error)) {
+        cli_panic("Invalid pattern `%s`: %s.\n", pattern, error);
+    }
+    regex_pattern = pattern;
+}
 
-    signal(SIGINT, terminate);  // Clean up on SIGINT
+// Set up field with its own line and history
+// `value` is used in place, never copied
+void init_field(
+    Field *const field,
+    const char *const label,
+    const char *const value,
+    const uint32_t value_len,
+    const char *const placeholder,
+    const char *const history_filename
+) {
+    field->label = label;
+    State *const state = &field->state;
+    if (!editor_init(state, value, value_len, MAX_INPUT_WIDTH)) {
+        perror("Failed to allocate input");
+        exit(1);
+    }
+    state->placeholder = placeholder;
+    if (history_filename != NULL) {
+        recall_open(&field->recall, history_filename);
+        state->recall = &field->recall;
+    }
+}
 
-    start_color();         // Enable color
-    use_default_colors();  // Don't change the background color
+// Edit one line, or each field of a form, as given by arguments
+// Returns exit status, unless editing on a terminal, which exits instead
+int run(const Arguments *const arguments) {
+    // Before any threads start, so none of them take signals
+    if (arguments->keys_filename == NULL) {
+        signal_fd = loop_signals(
+            LOOP_SIGNALS, sizeof(LOOP_SIGNALS) / sizeof(LOOP_SIGNALS[0])
+        );
+    }
 
-    init_pair(PAIR_BOX, COLOR_BLUE, -1);
-    init_pair(PAIR_DETAILS, COLOR_WHITE, -1);
-    init_pair(PAIR_VISUAL, -1, COLOR_BLUE);
+    // Given for each field instead
+    if (arguments->form_filename != NULL
+        && (arguments->value != NULL || arguments->input_filename != NULL
+            || arguments->placeholder != NULL
+            || arguments->history_filename != NULL
+            || arguments->list_filename != NULL))
+    {
+        cli_panic(
+            "Cannot specify value, placeholder, history or list with form.\n"
+        );
+    }
+    if (arguments->json && arguments->form_filename == NULL) {
+        cli_panic("Cannot write JSON without form.\n");
+    }
+    if (arguments->record_filename != NULL
+        && arguments->replay_filename != NULL)
+    {
+        cli_panic("Cannot record and replay at once.\n");
+    }
+    if (arguments->keys_filename != NULL
+        && (arguments->record_filename != NULL
+            || arguments->replay_filename != NULL))
+    {
+        cli_panic("Cannot record or replay with keys file.\n");
+    }
+    if (arguments->replay_filename != NULL) {
+        replay_open(&replay, arguments->replay_filename);
+        replay_fast = arguments->replay_fast;
+    }
+    if (arguments->form_filename != NULL) {
+        form_read(&form, arguments->form_filename);
+        form_filename = arguments->filename;
+        form_output_fd = arguments->output_fd;
+        form_json = arguments->json;
+    }
+    field_count = form.count > 0 ? form.count : 1;
+    fields = malloc(field_count * sizeof(Field));
+    if (fields == NULL) {
+        perror("Failed to allocate fields");
+        exit(1);
+    }
+
+    if (form.count > 0) {
+        for (uint32_t i = 0; i < form.count; ++i) {
+            const FormField *const spec = &form.fields[i];
+            init_field(
+                &fields[i],
+                spec->label,
+                spec->value,
+                spec->value != NULL ? strlen(spec->value) : 0,
+                spec->placeholder,
+                spec->history
+            );
+            fields[i].state.filename = spec->output;
+        }
+    } else {
+        const char *value = arguments->value;
+        uint32_t value_len = value != NULL ? strlen(value) : 0;
+        if (arguments->input_filename != NULL) {
+            value = map_input_file(arguments->input_filename, &value_len);
+        }
+        init_field(
+            &fields[0],
+            NULL,
+            value,
+            value_len,
+            arguments->placeholder,
+            arguments->history_filename
+        );
+        fields[0].state.filename = arguments->filename;
+        fields[0].state.output_fd = arguments->output_fd;
+    }
+
+    if (arguments->pattern != NULL) {
+        load_regex(arguments->pattern);
+        validating = true;
+    }
+    highlighting = arguments->syntax != NULL;
+    for (uint32_t i = 0; i < field_count; ++i) {
+        if (arguments->completions_filename != NULL) {
+            fields[i].state.completions =
+                load_completions(arguments->completions_filename);
+        }
+        if (validating) {
+            validator_init(&fields[i].validator, &regex);
+        }
+        if (highlighting) {
+            highlight_init(&fields[i].highlighter);
+        }
+    }
 
-    update_input_box(getmaxy(stdscr), getmaxx(stdscr));
-    state.snap.offset =
-        subsat(state.snap.cursor + CURSOR_RIGHT_EMPTY + 1, input_box.width);
+    if (arguments->backend_name != NULL) {
+        backend = find_backend(arguments->backend_name);
+        if (backend == NULL) {
+            cli_panic("Invalid backend `%s`.\n", arguments->backend_name);
+        }
+    }
 
-    int key = 0;
-    while (TRUE) {
-        frame(&state, &key);
+    const bool list_stdin = arguments->list_filename != NULL
+        && !strcmp(arguments->list_filename, "-");
+    if (list_stdin && arguments->keys_filename != NULL
+        && !strcmp(arguments->keys_filename, "-"))
+    {
+        cli_panic("Cannot read both keys and list from stdin.\n");
+    }
+    static Picker list;
+    if (arguments->list_filename != NULL) {
+        picker_open(&list, arguments->list_filename);
+        picker = &list;
     }
 
-    endwin();
+    if (arguments->keys_filename != NULL) {
+        // Without a terminal, wait so completion does not depend on timing
+        if (arguments->completions_filename != NULL) {
+            completions_wait(&completions);
+        }
+        return run_keys(arguments->keys_filename) ? 0 : 1;
+    }
+
+    // TODO(fix): Push snap on insert
+
+    // Keys are read from the terminal when stdin is the list
+    int input_fd = STDIN_FILENO;
+    if (list_stdin) {
+        input_fd = open("/dev/tty", O_RDONLY);
+        if (input_fd < 0) {
+            perror("Failed to open terminal");
+            exit(1);
+        }
+    }
+    // Before the first resize, so the session starts with the size
+    if (arguments->record_filename != NULL) {
+        session_record(arguments->record_filename);
+    }
+    backend->open(input_fd);
+
+    render_init(&renderer, backend);
+    resize();
+    for (uint32_t i = 0; i < field_count; ++i) {
+        State *const state = &fields[i].state;
+        state->snap.offset = subsat(
+            index_column(&state->snap.input, state->snap.cursor)
+                + CURSOR_RIGHT_EMPTY + 1,
+            input_box.width
+        );
+    }
+
+    loop_init(&loop);
+    loop_watch(&loop, input_fd, on_input, NULL);
+    loop_watch(&loop, signal_fd, on_signal, NULL);
+    picker_timer = loop_timer(&loop, on_picker_timer, NULL);
+    if (arguments->timeout_ms > 0) {
+        submit_on_timeout = arguments->submit_on_timeout;
+        loop_arm(
+            &loop,
+            loop_timer(&loop, on_timeout, NULL),
+            arguments->timeout_ms
+        );
+    }
+    if (arguments->replay_filename != NULL) {
+        replay_timer = loop_timer(&loop, on_replay, NULL);
+        replaying = replay_next(&replay, &replay_event);
+        replay_start = session_now();
+        if (replaying) {
+            loop_arm(&loop, replay_timer, 0);
+        }
+    }
+    loop_run(&loop, frame, NULL);
     return 0;
 }
+
+// Options not given by client are taken from server
+static Arguments server_arguments;
+
+// Run prompt for a client of `--serve`, in its own process
+void serve_prompt(const int conn) {
+    Request request;
+    serve_receive(conn, &request);
+    Arguments arguments = parse_arguments(request.argc, request.argv);
+    if (arguments.keys_filename != NULL || arguments.output_fd >= 0
+        || arguments.socket_filename != NULL
+        || arguments.record_filename != NULL
+        || arguments.replay_filename != NULL)
+    {
+        cli_panic("Option cannot be used by a client.\n");
+    }
+
+    if (arguments.filename == NULL) {
+        arguments.filename = server_arguments.filename;
+    }
+    if (arguments.form_filename == NULL) {
+        arguments.form_filename = server_arguments.form_filename;
+        arguments.json = arguments.json || server_arguments.json;
+    }
+    // Given by each field of a form instead
+    if (arguments.form_filename == NULL) {
+        if (arguments.value == NULL && arguments.input_filename == NULL) {
+            arguments.value = server_arguments.value;
+            arguments.input_filename = server_arguments.input_filename;
+        }
+        if (arguments.placeholder == NULL) {
+            arguments.placeholder = server_arguments.placeholder;
+        }
+        if (arguments.history_filename == NULL) {
+            arguments.history_filename = server_arguments.history_filename;
+        }
+    }
+    if (arguments.completions_filename == NULL) {
+        arguments.completions_filename =
+            server_arguments.completions_filename;
+    }
+    if (arguments.list_filename == NULL && arguments.form_filename == NULL) {
+        arguments.list_filename = server_arguments.list_filename;
+    }
+    if (arguments.backend_name == NULL) {
+        arguments.backend_name = server_arguments.backend_name;
+    }
+    if (arguments.pattern == NULL) {
+        arguments.pattern = server_arguments.pattern;
+    }
+    if (arguments.syntax == NULL) {
+        arguments.syntax = server_arguments.syntax;
+    }
+    if (arguments.timeout_ms == 0) {
+        arguments.timeout_ms = server_arguments.timeout_ms;
+        arguments.submit_on_timeout = server_arguments.submit_on_timeout;
+    }
+
+    // Printed input is the reply
+    print_fd = conn;
+    exit(run(&arguments));
+}
+
+int main(const int argc, const char *const *const argv) {
+    setlocale(LC_CTYPE, "");  // Use terminal encoding and character widths
+
+    const Arguments arguments = parse_arguments(argc, argv);
+    stats_init();
+
+    // Report closed output as a write error instead
+    signal(SIGPIPE, SIG_IGN);
+
+    if (arguments.socket_filename != NULL) {
+        if (arguments.keys_filename != NULL || arguments.output_fd >= 0) {
+            cli_panic("Cannot serve with keys file or output fd.\n");
+        }
+        if (arguments.record_filename != NULL
+            || arguments.replay_filename != NULL)
+        {
+            cli_panic("Cannot serve while recording or replaying.\n");
+        }
+        // Loaded before any prompt, as threads are not kept across fork
+        if (arguments.completions_filename != NULL) {
+            completions_wait(
+                load_completions(arguments.completions_filename)
+            );
+        }
+        if (arguments.pattern != NULL) {
+            load_regex(arguments.pattern);
+        }
+        server_arguments = arguments;
+        serve(arguments.socket_filename, serve_prompt);
+    }
+
+    return run(&arguments);
+}
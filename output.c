@@ -0,0 +1,70 @@
+#include "output.h"
+
+#include <errno.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TEMP_SUFFIX ".XXXXXX"
+
+bool write_all(const int fd, const char *bytes, size_t len) {
+    while (len > 0) {
+        const ssize_t count = write(fd, bytes, len);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        bytes += count;
+        len -= count;
+    }
+    return true;
+}
+
+// Mode of file at `path`, or mode a new file would be created with
+static mode_t file_mode(const char *const path) {
+    struct stat info;
+    if (stat(path, &info) == 0) {
+        return info.st_mode & 07777;
+    }
+    const mode_t mask = umask(0);
+    umask(mask);
+    return 0666 & ~mask;
+}
+
+bool write_file_atomic(
+    const char *const filename,
+    const char *const bytes,
+    const size_t len
+) {
+    char *const resolved = realpath(filename, NULL);
+    const char *const target = resolved != NULL ? resolved : filename;
+
+    // Beside target, so it can be renamed over it
+    const size_t target_len = strlen(target);
+    char temp[target_len + sizeof(TEMP_SUFFIX)];
+    memcpy(temp, target, target_len);
+    memcpy(&temp[target_len], TEMP_SUFFIX, sizeof(TEMP_SUFFIX));
+    const int fd = mkstemp(temp);
+    if (fd < 0) {
+        free(resolved);
+        return false;
+    }
+
+    bool written = fchmod(fd, file_mode(target)) == 0
+        && write_all(fd, bytes, len);
+    // Errors may only be reported on close
+    written = close(fd) == 0 && written;
+    written = written && rename(temp, target) == 0;
+    if (!written) {
+        const int error = errno;
+        unlink(temp);
+        errno = error;
+    }
+    free(resolved);
+    return written;
+}
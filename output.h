@@ -0,0 +1,21 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Write all of `bytes`, continuing after short or interrupted writes
+// Returns false with `errno` set if writing fails
+bool write_all(const int fd, const char *bytes, size_t len);
+
+// Replace file with `bytes` by renaming a temporary file over it, so
+// readers see either the old or the new contents, never part of them
+// A symlink is followed, and the mode of an existing file is kept
+// Returns false with `errno` set, leaving the file unchanged, on failure
+bool write_file_atomic(
+    const char *const filename,
+    const char *const bytes,
+    const size_t len
+);
+
+#endif
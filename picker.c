@@ -0,0 +1,522 @@
+#include "picker.h"
+
+#include "fuzzy.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define READ_SIZE (64 * 1024)
+#define BATCH_BYTES (4 * 1024 * 1024)
+// Candidates scored between checks for a newer query
+#define UNIT_SIZE (16 * 1024)
+#define MAX_WORKERS (16)
+#define IDS_MIN_CAPACITY (1024)
+
+static void *allocate(void *const ptr, const size_t size) {
+    void *const result = realloc(ptr, size);
+    if (result == NULL) {
+        perror("Failed to allocate picker");
+        exit(1);
+    }
+    return result;
+}
+
+static void add_ids(
+    uint32_t **const ids,
+    uint32_t *const count,
+    uint32_t *const capacity,
+    const uint32_t *const added,
+    const uint32_t added_count
+) {
+    if (added_count == 0) {
+        return;
+    }
+    if (*count + added_count > *capacity) {
+        if (*capacity == 0) {
+            *capacity = IDS_MIN_CAPACITY;
+        }
+        while (*count + added_count > *capacity) {
+            *capacity *= 2;
+        }
+        *ids = allocate(*ids, *capacity * sizeof(uint32_t));
+    }
+    memcpy(&(*ids)[*count], added, added_count * sizeof(uint32_t));
+    *count += added_count;
+}
+
+static bool better(const Match lhs, const Match rhs) {
+    return lhs.score > rhs.score || (lhs.score == rhs.score && lhs.id < rhs.id);
+}
+
+// Insert into best matches, sorted best first
+static void add_top(
+    Match *const top,
+    uint32_t *const count,
+    const Match match
+) {
+    if (*count == PICKER_TOP && !better(match, top[*count - 1])) {
+        return;
+    }
+    uint32_t i = *count < PICKER_TOP ? (*count)++ : PICKER_TOP - 1;
+    for (; i > 0 && better(match, top[i - 1]); --i) {
+        top[i] = top[i - 1];
+    }
+    top[i] = match;
+}
+
+// Reading
+
+// Lines of current batch, which is published after each read
+typedef struct Reader {
+    Picker *picker;
+    Batch *batch;
+    uint32_t lines;
+} Reader;
+
+static void publish(Reader *const reader) {
+    Picker *const picker = reader->picker;
+    const uint32_t published = atomic_load(&reader->batch->count);
+    atomic_fetch_add_explicit(
+        &picker->total, reader->lines - published, memory_order_relaxed
+    );
+    atomic_store_explicit(
+        &reader->batch->count, reader->lines, memory_order_release
+    );
+}
+
+// Start batch with room for `len` more bytes, moving the incomplete line
+// Returns false if there are too many batches
+static bool next_batch(Reader *const reader, const uint32_t len) {
+    Picker *const picker = reader->picker;
+    const uint32_t index = atomic_load(&picker->batch_count);
+    if (index >= PICKER_MAX_BATCHES) {
+        return false;
+    }
+    Batch *const batch = allocate(NULL, sizeof(Batch));
+    const Batch *const old = reader->batch;
+    const uint32_t partial =
+        old != NULL ? old->len - old->starts[reader->lines] : 0;
+    batch->capacity = BATCH_BYTES;
+    while (batch->capacity < partial + len) {
+        batch->capacity *= 2;
+    }
+    batch->text = allocate(NULL, batch->capacity);
+    if (partial > 0) {
+        memcpy(batch->text, &old->text[old->starts[reader->lines]], partial);
+    }
+    batch->len = partial;
+    batch->starts[0] = 0;
+    atomic_init(&batch->count, 0);
+
+    if (old != NULL) {
+        publish(reader);
+    }
+    picker->batches[index] = batch;
+    atomic_store_explicit(
+        &picker->batch_count, index + 1, memory_order_release
+    );
+    reader->batch = batch;
+    reader->lines = 0;
+    return true;
+}
+
+static bool add_bytes(
+    Reader *const reader,
+    const char *const bytes,
+    const uint32_t len
+) {
+    if (reader->batch->len + len > reader->batch->capacity
+        && !next_batch(reader, len))
+    {
+        return false;
+    }
+    Batch *const batch = reader->batch;
+    memcpy(&batch->text[batch->len], bytes, len);
+    batch->len += len;
+    return true;
+}
+
+// Empty lines are skipped
+static bool end_line(Reader *const reader) {
+    if (reader->lines >= PICKER_BATCH_LINES && !next_batch(reader, 0)) {
+        return false;
+    }
+    Batch *const batch = reader->batch;
+    const uint32_t start = batch->starts[reader->lines];
+    if (batch->len > start && batch->text[batch->len - 1] == '\r') {
+        --batch->len;
+    }
+    if (batch->len > start) {
+        batch->starts[++reader->lines] = batch->len;
+    }
+    return true;
+}
+
+static void *read_candidates(void *const arg) {
+    Picker *const picker = arg;
+    Reader reader = {.picker = picker, .batch = NULL, .lines = 0};
+    char *const chunk = allocate(NULL, READ_SIZE);
+    bool reading = next_batch(&reader, 0);
+    while (reading) {
+        const ssize_t count = read(picker->fd, chunk, READ_SIZE);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        // Stop at any error, keeping what was read
+        if (count <= 0) {
+            if (reader.batch->len > reader.batch->starts[reader.lines]) {
+                end_line(&reader);
+            }
+            break;
+        }
+        const char *bytes = chunk;
+        const char *const end = &chunk[count];
+        while (reading && bytes < end) {
+            const char *newline = memchr(bytes, '\n', end - bytes);
+            const uint32_t len = (newline != NULL ? newline : end) - bytes;
+            reading = add_bytes(&reader, bytes, len);
+            if (newline == NULL) {
+                break;
+            }
+            reading = reading && end_line(&reader);
+            bytes = newline + 1;
+        }
+        publish(&reader);
+    }
+    publish(&reader);
+    free(chunk);
+
+    pthread_mutex_lock(&picker->lock);
+    atomic_store(&picker->read_done, true);
+    pthread_cond_broadcast(&picker->finished);
+    pthread_mutex_unlock(&picker->lock);
+    return NULL;
+}
+
+// Number of ids in use, for candidates published so far
+static uint32_t id_limit(const Picker *const picker) {
+    const uint32_t count =
+        atomic_load_explicit(&picker->batch_count, memory_order_acquire);
+    if (count == 0) {
+        return 0;
+    }
+    const Batch *const last = picker->batches[count - 1];
+    return (count - 1) * PICKER_BATCH_LINES
+        + atomic_load_explicit(&last->count, memory_order_acquire);
+}
+
+const char *picker_candidate(
+    const Picker *const picker,
+    const uint32_t id,
+    uint32_t *const len
+) {
+    const Batch *const batch = picker->batches[id / PICKER_BATCH_LINES];
+    const uint32_t line = id % PICKER_BATCH_LINES;
+    *len = batch->starts[line + 1] - batch->starts[line];
+    return &batch->text[batch->starts[line]];
+}
+
+// Scoring
+
+static void score_candidate(
+    Worker *const worker,
+    const Job *const job,
+    const uint32_t id
+) {
+    uint32_t len;
+    const char *const text = picker_candidate(worker->picker, id, &len);
+    const int32_t score =
+        fuzzy_score(text, len, job->query, job->query_len, job->fold, NULL);
+    if (score != FUZZY_NONE) {
+        add_ids(&worker->ids, &worker->count, &worker->capacity, &id, 1);
+        add_top(worker->top, &worker->top_count, (Match) {id, score});
+    }
+}
+
+static void run_unit(
+    Worker *const worker,
+    const Job *const job,
+    const uint32_t unit
+) {
+    const Picker *const picker = worker->picker;
+    if (unit < job->base_units) {
+        // Previous matches, which are not changed while a job runs
+        const uint32_t start = unit * UNIT_SIZE;
+        const uint32_t end = start + UNIT_SIZE < picker->matched
+            ? start + UNIT_SIZE
+            : picker->matched;
+        for (uint32_t i = start; i < end; ++i) {
+            score_candidate(worker, job, picker->matches[i]);
+        }
+        return;
+    }
+    // Units are aligned, so they never cross batches
+    const uint32_t unit_start =
+        (job->from / UNIT_SIZE + unit - job->base_units) * UNIT_SIZE;
+    const uint32_t start = unit_start > job->from ? unit_start : job->from;
+    const Batch *const batch =
+        picker->batches[unit_start / PICKER_BATCH_LINES];
+    uint32_t end = unit_start - unit_start % PICKER_BATCH_LINES
+        + atomic_load_explicit(&batch->count, memory_order_acquire);
+    if (end > unit_start + UNIT_SIZE) {
+        end = unit_start + UNIT_SIZE;
+    }
+    if (end > job->to) {
+        end = job->to;
+    }
+    for (uint32_t id = start; id < end; ++id) {
+        score_candidate(worker, job, id);
+    }
+}
+
+// Start job for newest query, reusing previous matches if it extends the
+// query they were scored for
+static void start_job(Picker *const picker) {
+    Job *const job = picker->pending;
+    picker->pending = NULL;
+
+    const bool reuse = picker->query != NULL
+        && job->query_len >= picker->query_len
+        && !memcmp(job->query, picker->query, picker->query_len);
+    job->from = reuse ? picker->scanned : 0;
+    job->base_units =
+        reuse ? (picker->matched + UNIT_SIZE - 1) / UNIT_SIZE : 0;
+    const uint32_t first_unit = job->from / UNIT_SIZE;
+    const uint32_t last_unit = (job->to + UNIT_SIZE - 1) / UNIT_SIZE;
+    job->unit_count = job->base_units
+        + (last_unit > first_unit ? last_unit - first_unit : 0);
+    atomic_init(&job->next_unit, 0);
+    job->remaining = picker->worker_count;
+
+    picker->job = job;
+    pthread_cond_broadcast(&picker->started);
+}
+
+static void free_job(Job *const job) {
+    free(job->query);
+    free(job->ids);
+    free(job);
+}
+
+// Called with lock held, by the last worker to finish
+static void finish_job(Picker *const picker, Job *const job) {
+    picker->job = NULL;
+    if (job->generation == atomic_load(&picker->generation)) {
+        free(picker->query);
+        free(picker->matches);
+        picker->query = job->query;
+        picker->query_len = job->query_len;
+        picker->scanned = job->to;
+        picker->matches = job->ids;
+        picker->matched = job->count;
+        memcpy(picker->top, job->top, sizeof(job->top));
+        picker->top_count = job->top_count;
+        free(job);
+    } else {
+        free_job(job);
+    }
+    if (picker->pending != NULL) {
+        start_job(picker);
+    }
+    pthread_cond_broadcast(&picker->finished);
+}
+
+static void *work(void *const arg) {
+    Worker *const worker = arg;
+    Picker *const picker = worker->picker;
+    pthread_mutex_lock(&picker->lock);
+    while (true) {
+        while (picker->job == NULL || picker->job->generation == worker->seen) {
+            pthread_cond_wait(&picker->started, &picker->lock);
+        }
+        Job *const job = picker->job;
+        worker->seen = job->generation;
+        pthread_mutex_unlock(&picker->lock);
+
+        worker->count = 0;
+        worker->top_count = 0;
+        uint32_t unit;
+        bool cancelled = false;
+        while ((unit = atomic_fetch_add(&job->next_unit, 1)) < job->unit_count)
+        {
+            if (atomic_load_explicit(&picker->generation, memory_order_relaxed)
+                != job->generation)
+            {
+                cancelled = true;
+                break;
+            }
+            run_unit(worker, job, unit);
+        }
+
+        pthread_mutex_lock(&picker->lock);
+        if (!cancelled) {
+            add_ids(
+                &job->ids,
+                &job->count,
+                &job->capacity,
+                worker->ids,
+                worker->count
+            );
+            for (uint32_t i = 0; i < worker->top_count; ++i) {
+                add_top(job->top, &job->top_count, worker->top[i]);
+            }
+        }
+        if (--job->remaining == 0) {
+            finish_job(picker, job);
+        }
+    }
+    return NULL;
+}
+
+void picker_open(Picker *const picker, const char *const filename) {
+    picker->fd = STDIN_FILENO;
+    if (strcmp(filename, "-")) {
+        picker->fd = open(filename, O_RDONLY);
+        if (picker->fd < 0) {
+            perror("Failed to open list file");
+            exit(1);
+        }
+    }
+    picker->batches = allocate(NULL, PICKER_MAX_BATCHES * sizeof(Batch *));
+    atomic_init(&picker->batch_count, 0);
+    atomic_init(&picker->total, 0);
+    atomic_init(&picker->read_done, false);
+
+    pthread_mutex_init(&picker->lock, NULL);
+    pthread_cond_init(&picker->started, NULL);
+    pthread_cond_init(&picker->finished, NULL);
+    atomic_init(&picker->generation, 0);
+    picker->job = NULL;
+    picker->pending = NULL;
+    picker->requested = NULL;
+    picker->requested_len = 0;
+    picker->requested_to = 0;
+    picker->query = NULL;
+    picker->query_len = 0;
+    picker->scanned = 0;
+    picker->matches = NULL;
+    picker->matched = 0;
+    picker->top_count = 0;
+
+    // Leave one processor for reading and drawing
+    const long processors = sysconf(_SC_NPROCESSORS_ONLN);
+    picker->worker_count = processors > 2 ? processors - 1 : 1;
+    if (picker->worker_count > MAX_WORKERS) {
+        picker->worker_count = MAX_WORKERS;
+    }
+    picker->workers = allocate(NULL, picker->worker_count * sizeof(Worker));
+    for (uint32_t i = 0; i < picker->worker_count; ++i) {
+        Worker *const worker = &picker->workers[i];
+        *worker = (Worker) {
+            .picker = picker,
+            .seen = 0,
+            .ids = NULL,
+            .count = 0,
+            .capacity = 0,
+            .top_count = 0,
+        };
+        if (pthread_create(&worker->thread, NULL, work, worker) != 0) {
+            fprintf(stderr, "Failed to start picker.\n");
+            exit(1);
+        }
+    }
+    if (pthread_create(&picker->reader, NULL, read_candidates, picker) != 0) {
+        fprintf(stderr, "Failed to start reading list.\n");
+        exit(1);
+    }
+}
+
+void picker_update(
+    Picker *const picker,
+    const char *const query,
+    const uint32_t query_len
+) {
+    const uint32_t to = id_limit(picker);
+    pthread_mutex_lock(&picker->lock);
+    if (picker->requested != NULL && picker->requested_len == query_len
+        && !memcmp(picker->requested, query, query_len)
+        && picker->requested_to == to)
+    {
+        pthread_mutex_unlock(&picker->lock);
+        return;
+    }
+    picker->requested = allocate(picker->requested, query_len + 1);
+    memcpy(picker->requested, query, query_len);
+    picker->requested_len = query_len;
+    picker->requested_to = to;
+
+    Job *const job = allocate(NULL, sizeof(Job));
+    *job = (Job) {
+        .generation = atomic_load(&picker->generation) + 1,
+        .query = allocate(NULL, query_len + 1),
+        .query_len = query_len,
+        .fold = fuzzy_fold(query, query_len),
+        .to = to,
+        .ids = NULL,
+        .count = 0,
+        .capacity = 0,
+        .top_count = 0,
+    };
+    memcpy(job->query, query, query_len);
+    // Running job stops after its current unit
+    atomic_store(&picker->generation, job->generation);
+    if (picker->pending != NULL) {
+        free_job(picker->pending);
+    }
+    picker->pending = job;
+    if (picker->job == NULL) {
+        start_job(picker);
+    }
+    pthread_mutex_unlock(&picker->lock);
+}
+
+bool picker_busy(Picker *const picker) {
+    pthread_mutex_lock(&picker->lock);
+    const bool busy = !atomic_load(&picker->read_done) || picker->job != NULL
+        || picker->pending != NULL;
+    pthread_mutex_unlock(&picker->lock);
+    return busy;
+}
+
+void picker_wait(Picker *const picker) {
+    pthread_mutex_lock(&picker->lock);
+    while (!atomic_load(&picker->read_done)) {
+        pthread_cond_wait(&picker->finished, &picker->lock);
+    }
+    const uint32_t query_len = picker->requested_len;
+    char *const query = allocate(NULL, query_len + 1);
+    if (query_len > 0) {
+        memcpy(query, picker->requested, query_len);
+    }
+    pthread_mutex_unlock(&picker->lock);
+
+    // Include candidates read since last requested
+    picker_update(picker, query, query_len);
+    free(query);
+
+    pthread_mutex_lock(&picker->lock);
+    while (picker->job != NULL || picker->pending != NULL) {
+        pthread_cond_wait(&picker->finished, &picker->lock);
+    }
+    pthread_mutex_unlock(&picker->lock);
+}
+
+uint32_t picker_results(
+    Picker *const picker,
+    Match *const top,
+    uint32_t *const matched,
+    uint32_t *const total
+) {
+    pthread_mutex_lock(&picker->lock);
+    memcpy(top, picker->top, picker->top_count * sizeof(Match));
+    const uint32_t count = picker->top_count;
+    *matched = picker->matched;
+    pthread_mutex_unlock(&picker->lock);
+    *total = atomic_load_explicit(&picker->total, memory_order_relaxed);
+    return count;
+}
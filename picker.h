@@ -0,0 +1,132 @@
+#ifndef PICKER_H
+#define PICKER_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Best matches kept for each query
+#define PICKER_TOP (10)
+#define PICKER_BATCH_LINES (64 * 1024)
+#define PICKER_MAX_BATCHES (64 * 1024)
+
+// Candidates are numbered by batch, then line within batch, so some ids in
+// a batch may be unused
+
+// Candidate lines stored together
+// Lines are published by `count`, so they can be read while more are added
+typedef struct Batch {
+    char *text;
+    uint32_t len;
+    uint32_t capacity;
+    uint32_t starts[PICKER_BATCH_LINES + 1];
+    atomic_uint count;
+} Batch;
+
+typedef struct Match {
+    uint32_t id;
+    int32_t score;
+} Match;
+
+// Scoring of candidates for one query, split into units taken by workers
+// Only one job runs at a time
+typedef struct Job {
+    uint32_t generation;
+    char *query;
+    uint32_t query_len;
+    bool fold;
+    uint32_t base_units;  // Units of previous matches, before new candidates
+    uint32_t from;        // Candidate ids scanned after previous matches
+    uint32_t to;
+    uint32_t unit_count;
+    atomic_uint next_unit;
+    uint32_t remaining;  // Workers still running
+    // Merged from workers
+    uint32_t *ids;
+    uint32_t count;
+    uint32_t capacity;
+    Match top[PICKER_TOP];
+    uint32_t top_count;
+} Job;
+
+typedef struct Worker {
+    struct Picker *picker;
+    pthread_t thread;
+    uint32_t seen;  // Generation of last job
+    uint32_t *ids;
+    uint32_t count;
+    uint32_t capacity;
+    Match top[PICKER_TOP];
+    uint32_t top_count;
+} Worker;
+
+// Fuzzy picker over lines streamed from a file, scored on worker threads
+// A new query cancels the running job, and when it only adds to the last
+// scored query, only that query's matches and newer candidates are scored
+typedef struct Picker {
+    int fd;
+    pthread_t reader;
+    Batch **batches;
+    atomic_uint batch_count;
+    atomic_uint total;
+    atomic_bool read_done;
+
+    Worker *workers;
+    uint32_t worker_count;
+    pthread_mutex_t lock;
+    pthread_cond_t started;
+    pthread_cond_t finished;
+    // Generation of newest query, so older jobs stop
+    atomic_uint generation;
+    Job *job;
+    Job *pending;  // Started once running job stops
+    // Newest query requested, and candidates it covers
+    char *requested;
+    uint32_t requested_len;
+    uint32_t requested_to;
+
+    // Results of last finished job
+    char *query;
+    uint32_t query_len;
+    uint32_t scanned;  // Ids below this were scored
+    uint32_t *matches;
+    uint32_t matched;
+    Match top[PICKER_TOP];
+    uint32_t top_count;
+} Picker;
+
+// Read candidates from file, or stdin if filename is `-`
+void picker_open(Picker *const picker, const char *const filename);
+
+// Score candidates for `query`, unless already done or in progress
+// Also scores candidates read since the last call
+void picker_update(
+    Picker *const picker,
+    const char *const query,
+    const uint32_t query_len
+);
+
+// Whether candidates are still being read or scored
+bool picker_busy(Picker *const picker);
+
+// Wait until all candidates are read and scored for the last query
+void picker_wait(Picker *const picker);
+
+// Copy best matches of last finished job into `top`
+// `matched` is set to the number of matches, and `total` to the number of
+// candidates
+uint32_t picker_results(
+    Picker *const picker,
+    Match *const top,
+    uint32_t *const matched,
+    uint32_t *const total
+);
+
+const char *picker_candidate(
+    const Picker *const picker,
+    const uint32_t id,
+    uint32_t *const len
+);
+
+#endif
@@ -0,0 +1,313 @@
+#define _GNU_SOURCE  // memmem
+
+#include "recall.h"
+
+#include "alloc.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ENTRIES_MIN_CAPACITY (256)
+// Search scans this many bytes at a time, from newest to oldest
+#define SEARCH_BLOCK (64 * 1024)
+
+static void *allocate(void *const ptr, const size_t size) {
+    void *const result = mem_realloc(ptr, size);
+    if (result == NULL) {
+        perror("Failed to allocate history");
+        exit(1);
+    }
+    return result;
+}
+
+static void lock(const Recall *const recall, const int operation) {
+    while (flock(recall->fd, operation) != 0) {
+        if (errno != EINTR) {
+            perror("Failed to lock history file");
+            exit(1);
+        }
+    }
+}
+
+static size_t file_size(const Recall *const recall) {
+    struct stat info;
+    if (fstat(recall->fd, &info) != 0) {
+        perror("Failed to read history file");
+        exit(1);
+    }
+    return info.st_size;
+}
+
+// End of entry, excluding newline
+static size_t entry_end(const Recall *const recall, const uint32_t index) {
+    if (index + 1 < recall->count) {
+        return recall->entries[index + 1] - 1;
+    }
+    return recall->indexed - 1;
+}
+
+// Length of escaped text once unescaped
+static uint32_t unescaped_len(const char *const text, const size_t len) {
+    uint32_t result = 0;
+    for (size_t i = 0; i < len; ++i) {
+        if (text[i] == '\\' && i + 1 < len) {
+            ++i;
+        }
+        ++result;
+    }
+    return result;
+}
+
+// Escape `len` bytes into `dest`, which must have room for `len * 2` bytes
+// Returns escaped length
+static size_t escape(const char *const text, const size_t len, char *dest) {
+    size_t result = 0;
+    for (size_t i = 0; i < len; ++i) {
+        switch (text[i]) {
+            case '\\':
+                dest[result++] = '\\';
+                dest[result++] = '\\';
+                break;
+            case '\n':
+                dest[result++] = '\\';
+                dest[result++] = 'n';
+                break;
+            default:
+                dest[result++] = text[i];
+                break;
+        }
+    }
+    return result;
+}
+
+// Whether byte at `offset` is the second of an escape pair, as it follows an
+// odd number of backslashes
+// Lines are separated by unescaped newlines, so this stays within a line
+static bool in_escape(const char *const data, const size_t offset) {
+    size_t backslashes = 0;
+    while (backslashes < offset && data[offset - backslashes - 1] == '\\') {
+        ++backslashes;
+    }
+    return backslashes % 2 == 1;
+}
+
+// Index of entry containing byte at `offset`
+static uint32_t find_entry(const Recall *const recall, const size_t offset) {
+    uint32_t low = 0;
+    uint32_t high = recall->count;
+    while (high - low > 1) {
+        const uint32_t middle = low + (high - low) / 2;
+        if (recall->entries[middle] <= offset) {
+            low = middle;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+void recall_open(Recall *const recall, const char *const filename) {
+    recall->fd = open(filename, O_RDWR | O_CREAT | O_APPEND, 0600);
+    if (recall->fd < 0) {
+        perror("Failed to open history file");
+        exit(1);
+    }
+    recall->data = NULL;
+    recall->size = 0;
+    recall->indexed = 0;
+    recall->entries = NULL;
+    recall->count = 0;
+    recall->capacity = 0;
+    recall_refresh(recall);
+}
+
+void recall_close(Recall *const recall) {
+    if (recall->data != NULL) {
+        munmap((void *) recall->data, recall->size);
+    }
+    mem_free(recall->entries);
+    close(recall->fd);
+}
+
+// Map file at its new size, and index any new complete lines
+// A writer may have died mid-line, so the last line may be incomplete
+static void update(Recall *const recall, const size_t size) {
+    if (size == recall->size) {
+        return;
+    }
+
+    if (recall->data != NULL) {
+        munmap((void *) recall->data, recall->size);
+        recall->data = NULL;
+    }
+    recall->size = size;
+    // File was truncated, so index it again
+    if (size < recall->indexed) {
+        recall->indexed = 0;
+        recall->count = 0;
+    }
+    if (size == 0) {
+        return;
+    }
+    const char *const data =
+        mmap(NULL, size, PROT_READ, MAP_SHARED, recall->fd, 0);
+    if (data == MAP_FAILED) {
+        perror("Failed to map history file");
+        exit(1);
+    }
+    recall->data = data;
+
+    const char *line = &data[recall->indexed];
+    const char *newline;
+    while ((newline = memchr(line, '\n', &data[size] - line)) != NULL) {
+        if (recall->count >= recall->capacity) {
+            recall->capacity = recall->capacity > 0
+                ? recall->capacity * 2
+                : ENTRIES_MIN_CAPACITY;
+            recall->entries = allocate(
+                recall->entries, recall->capacity * sizeof(size_t)
+            );
+        }
+        recall->entries[recall->count++] = line - data;
+        line = newline + 1;
+    }
+    recall->indexed = line - data;
+}
+
+void recall_refresh(Recall *const recall) {
+    lock(recall, LOCK_SH);
+    const size_t size = file_size(recall);
+    lock(recall, LOCK_UN);
+    update(recall, size);
+}
+
+char *recall_entry(
+    const Recall *const recall,
+    const uint32_t index,
+    uint32_t *const len
+) {
+    const char *const text = &recall->data[recall->entries[index]];
+    const size_t text_len = entry_end(recall, index) - recall->entries[index];
+    char *const entry = allocate(NULL, text_len + 1);
+    *len = 0;
+    for (size_t i = 0; i < text_len; ++i) {
+        if (text[i] == '\\' && i + 1 < text_len) {
+            ++i;
+            entry[(*len)++] = text[i] == 'n' ? '\n' : text[i];
+        } else {
+            entry[(*len)++] = text[i];
+        }
+    }
+    return entry;
+}
+
+uint32_t recall_search(
+    const Recall *const recall,
+    const uint32_t from,
+    const char *const query,
+    const uint32_t query_len,
+    uint32_t *const position
+) {
+    if (recall->count == 0 || query_len == 0) {
+        return RECALL_NONE;
+    }
+    char *const pattern = allocate(NULL, query_len * 2);
+    const size_t pattern_len = escape(query, query_len, pattern);
+    // Blocks overlap, so matches across a block boundary are found
+    size_t block = SEARCH_BLOCK;
+    while (block < pattern_len * 2) {
+        block *= 2;
+    }
+
+    const char *const data = recall->data;
+    size_t end =
+        entry_end(recall, from < recall->count ? from : recall->count - 1);
+    uint32_t result = RECALL_NONE;
+    while (end >= pattern_len) {
+        const size_t start = end > block ? end - block : 0;
+        // Find last match in block
+        // Matches must start on a whole character, not inside an escape
+        const char *last = NULL;
+        const char *text = &data[start];
+        const char *match;
+        while ((match = memmem(text, &data[end] - text, pattern, pattern_len))
+               != NULL)
+        {
+            if (!in_escape(data, match - data)) {
+                last = match;
+            }
+            text = match + 1;
+        }
+        if (last != NULL) {
+            const size_t offset = last - data;
+            result = find_entry(recall, offset);
+            const size_t entry = recall->entries[result];
+            *position = unescaped_len(&data[entry], offset - entry);
+            break;
+        }
+        if (start == 0) {
+            break;
+        }
+        end = start + pattern_len - 1;
+    }
+    mem_free(pattern);
+    return result;
+}
+
+void recall_append(Recall *const recall, const Buffer *const line) {
+    const uint32_t len = buffer_len(line);
+    if (len == 0) {
+        return;
+    }
+    // Leading newline, escaped text, trailing newline
+    char *const record = allocate(NULL, len * 2 + 2);
+    size_t record_len = 1;
+    for (uint32_t index = 0; index < len;) {
+        uint32_t span_len;
+        const char *const span = buffer_span(line, index, &span_len);
+        record_len += escape(span, span_len, &record[record_len]);
+        index += span_len;
+    }
+    record[record_len++] = '\n';
+
+    lock(recall, LOCK_EX);
+    update(recall, file_size(recall));
+    const char *text = &record[1];
+    size_t text_len = record_len - 1;
+    bool duplicate = false;
+    if (recall->count > 0) {
+        const uint32_t newest = recall->count - 1;
+        const size_t start = recall->entries[newest];
+        duplicate = entry_end(recall, newest) - start == text_len - 1
+            && !memcmp(&recall->data[start], text, text_len - 1);
+    }
+    // Finish line left by a writer which died
+    if (recall->size > recall->indexed) {
+        record[0] = '\n';
+        text = record;
+        ++text_len;
+    }
+    while (!duplicate && text_len > 0) {
+        const ssize_t count = write(recall->fd, text, text_len);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("Failed to write history file");
+            exit(1);
+        }
+        text += count;
+        text_len -= count;
+    }
+    lock(recall, LOCK_UN);
+    mem_free(record);
+}
@@ -0,0 +1,52 @@
+#ifndef RECALL_H
+#define RECALL_H
+
+#include "buffer.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define RECALL_NONE (UINT32_MAX)
+
+// Lines accepted in previous sessions, oldest first
+// The file is an append-only log of lines, with `\` and newlines escaped
+// It is mapped read-only, with an index of where each line starts
+// Appends hold an exclusive lock, so several processes may share a file
+typedef struct Recall {
+    int fd;
+    const char *data;
+    size_t size;     // Bytes mapped
+    size_t indexed;  // Bytes up to end of last complete line
+    size_t *entries;
+    uint32_t count;
+    uint32_t capacity;
+} Recall;
+
+void recall_open(Recall *const recall, const char *const filename);
+
+void recall_close(Recall *const recall);
+
+// Index lines appended since last refresh, including by other processes
+void recall_refresh(Recall *const recall);
+
+// Allocate unescaped copy of entry
+char *recall_entry(
+    const Recall *const recall,
+    const uint32_t index,
+    uint32_t *const len
+);
+
+// Newest entry at or before `from` containing `query`, or `RECALL_NONE`
+// `position` is set to the byte index of the match in the unescaped entry
+uint32_t recall_search(
+    const Recall *const recall,
+    const uint32_t from,
+    const char *const query,
+    const uint32_t query_len,
+    uint32_t *const position
+);
+
+// Append line, unless empty or the same as the newest entry
+void recall_append(Recall *const recall, const Buffer *const line);
+
+#endif
@@ -0,0 +1,994 @@
+#include "regex.h"
+
+#include "alloc.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Limits keep compiling fast, and the DFA table small
+#define NODES_MAX (1 << 16)
+#define STATES_MAX (1 << 12)
+#define REPEAT_MAX (255)
+#define CLASS_RANGES_MAX (256)
+#define REPEAT_UNBOUNDED (UINT32_MAX)
+#define NODE_NONE (UINT32_MAX)
+#define CODE_MAX (0x10ffff)
+#define SURROGATE_MIN (0xd800)
+#define SURROGATE_MAX (0xdfff)
+
+// Thompson NFA node
+// Split nodes follow `out` and `out2` without reading a byte, and either
+// may be `NODE_NONE`
+typedef enum NodeKind {
+    NODE_SPLIT,
+    NODE_BYTES,
+    NODE_MATCH,
+} NodeKind;
+
+typedef struct Node {
+    NodeKind kind;
+    uint8_t low;
+    uint8_t high;
+    uint32_t out;
+    uint32_t out2;
+} Node;
+
+// Part of NFA, whose `end` is a split node not yet joined to anything
+typedef struct Fragment {
+    uint32_t start;
+    uint32_t end;
+} Fragment;
+
+typedef struct Range {
+    uint32_t low;
+    uint32_t high;
+} Range;
+
+// Set of code points, as sorted ranges which do not touch
+typedef struct Class {
+    Range ranges[CLASS_RANGES_MAX];
+    uint32_t count;
+} Class;
+
+typedef struct Parser {
+    const char *pattern;
+    size_t len;
+    size_t pos;
+    Node *nodes;
+    uint32_t node_count;
+    uint32_t node_capacity;
+    const char *error;
+} Parser;
+
+static void *allocate(void *const ptr, const size_t size) {
+    void *const result = mem_realloc(ptr, size);
+    if (result == NULL) {
+        perror("Failed to allocate pattern");
+        exit(1);
+    }
+    return result;
+}
+
+// Node 0 is used in place of nodes which did not fit
+static uint32_t add_node(
+    Parser *const parser,
+    const NodeKind kind,
+    const uint8_t low,
+    const uint8_t high
+) {
+    if (parser->node_count >= NODES_MAX) {
+        parser->error = "pattern is too large";
+        return 0;
+    }
+    if (parser->node_count >= parser->node_capacity) {
+        parser->node_capacity = parser->node_capacity > 0
+            ? parser->node_capacity * 2
+            : 64;
+        parser->nodes =
+            allocate(parser->nodes, parser->node_capacity * sizeof(Node));
+    }
+    parser->nodes[parser->node_count] = (Node) {
+        .kind = kind,
+        .low = low,
+        .high = high,
+        .out = NODE_NONE,
+        .out2 = NODE_NONE,
+    };
+    return parser->node_count++;
+}
+
+static Fragment empty(Parser *const parser) {
+    const uint32_t node = add_node(parser, NODE_SPLIT, 0, 0);
+    return (Fragment) {node, node};
+}
+
+static Fragment byte_range(
+    Parser *const parser,
+    const uint8_t low,
+    const uint8_t high
+) {
+    const uint32_t node = add_node(parser, NODE_BYTES, low, high);
+    const uint32_t end = add_node(parser, NODE_SPLIT, 0, 0);
+    parser->nodes[node].out = end;
+    return (Fragment) {node, end};
+}
+
+static Fragment sequence(
+    Parser *const parser,
+    const Fragment first,
+    const Fragment second
+) {
+    parser->nodes[first.end].out = second.start;
+    return (Fragment) {first.start, second.end};
+}
+
+static Fragment either(
+    Parser *const parser,
+    const Fragment first,
+    const Fragment second
+) {
+    const uint32_t start = add_node(parser, NODE_SPLIT, 0, 0);
+    const uint32_t end = add_node(parser, NODE_SPLIT, 0, 0);
+    parser->nodes[start].out = first.start;
+    parser->nodes[start].out2 = second.start;
+    parser->nodes[first.end].out = end;
+    parser->nodes[second.end].out = end;
+    return (Fragment) {start, end};
+}
+
+static Fragment star(Parser *const parser, const Fragment fragment) {
+    const uint32_t start = add_node(parser, NODE_SPLIT, 0, 0);
+    const uint32_t end = add_node(parser, NODE_SPLIT, 0, 0);
+    parser->nodes[start].out = fragment.start;
+    parser->nodes[start].out2 = end;
+    parser->nodes[fragment.end].out = start;
+    return (Fragment) {start, end};
+}
+
+static Fragment optional(Parser *const parser, const Fragment fragment) {
+    const uint32_t start = add_node(parser, NODE_SPLIT, 0, 0);
+    parser->nodes[start].out = fragment.start;
+    parser->nodes[start].out2 = fragment.end;
+    return (Fragment) {start, fragment.end};
+}
+
+static uint32_t encode(const uint32_t code, uint8_t *const bytes) {
+    if (code < 0x80) {
+        bytes[0] = code;
+        return 1;
+    }
+    if (code < 0x800) {
+        bytes[0] = 0xc0 | (code >> 6);
+        bytes[1] = 0x80 | (code & 0x3f);
+        return 2;
+    }
+    if (code < 0x10000) {
+        bytes[0] = 0xe0 | (code >> 12);
+        bytes[1] = 0x80 | ((code >> 6) & 0x3f);
+        bytes[2] = 0x80 | (code & 0x3f);
+        return 3;
+    }
+    bytes[0] = 0xf0 | (code >> 18);
+    bytes[1] = 0x80 | ((code >> 12) & 0x3f);
+    bytes[2] = 0x80 | ((code >> 6) & 0x3f);
+    bytes[3] = 0x80 | (code & 0x3f);
+    return 4;
+}
+
+// Fragment matching UTF-8 encodings of code points in `[low, high]`
+// Split until both ends have the same length, and each byte but the last
+// one which differs covers all its continuation bytes
+static Fragment code_range(
+    Parser *const parser,
+    const uint32_t low,
+    const uint32_t high
+) {
+    static const uint32_t LENGTH_MAX[] = {0x7f, 0x7ff, 0xffff};
+    for (uint32_t i = 0; i < 3; ++i) {
+        if (low <= LENGTH_MAX[i] && high > LENGTH_MAX[i]) {
+            return either(
+                parser,
+                code_range(parser, low, LENGTH_MAX[i]),
+                code_range(parser, LENGTH_MAX[i] + 1, high)
+            );
+        }
+    }
+    uint8_t low_bytes[4];
+    uint8_t high_bytes[4];
+    const uint32_t len = encode(low, low_bytes);
+    encode(high, high_bytes);
+    for (uint32_t i = 1; i < len; ++i) {
+        const uint32_t mask = (1 << (6 * i)) - 1;
+        if ((low & ~mask) == (high & ~mask)) {
+            continue;
+        }
+        if ((low & mask) != 0) {
+            return either(
+                parser,
+                code_range(parser, low, low | mask),
+                code_range(parser, (low | mask) + 1, high)
+            );
+        }
+        if ((high & mask) != mask) {
+            return either(
+                parser,
+                code_range(parser, low, (high & ~mask) - 1),
+                code_range(parser, high & ~mask, high)
+            );
+        }
+    }
+    Fragment fragment = byte_range(parser, low_bytes[0], high_bytes[0]);
+    for (uint32_t i = 1; i < len; ++i) {
+        fragment = sequence(
+            parser, fragment, byte_range(parser, low_bytes[i], high_bytes[i])
+        );
+    }
+    return fragment;
+}
+
+static void class_add(
+    Parser *const parser,
+    Class *const class,
+    uint32_t low,
+    uint32_t high
+) {
+    if (low > high) {
+        parser->error = "range is out of order";
+        return;
+    }
+    // Surrogates are not characters
+    if (low < SURROGATE_MIN && high > SURROGATE_MAX) {
+        class_add(parser, class, low, SURROGATE_MIN - 1);
+        low = SURROGATE_MAX + 1;
+    } else if (low >= SURROGATE_MIN && low <= SURROGATE_MAX) {
+        low = SURROGATE_MAX + 1;
+    } else if (high >= SURROGATE_MIN && high <= SURROGATE_MAX) {
+        high = SURROGATE_MIN - 1;
+    }
+    if (low > high) {
+        return;
+    }
+
+    // Merge with ranges it overlaps or touches
+    uint32_t first = 0;
+    while (first < class->count && class->ranges[first].high + 1 < low) {
+        ++first;
+    }
+    uint32_t end = first;
+    while (end < class->count && class->ranges[end].low <= high + 1) {
+        if (class->ranges[end].low < low) {
+            low = class->ranges[end].low;
+        }
+        if (class->ranges[end].high > high) {
+            high = class->ranges[end].high;
+        }
+        ++end;
+    }
+    if (first == end && class->count >= CLASS_RANGES_MAX) {
+        parser->error = "class is too large";
+        return;
+    }
+    const uint32_t count = class->count - (end - first) + 1;
+    memmove(
+        &class->ranges[first + 1],
+        &class->ranges[end],
+        (class->count - end) * sizeof(Range)
+    );
+    class->ranges[first] = (Range) {low, high};
+    class->count = count;
+}
+
+static void class_negate(Parser *const parser, Class *const class) {
+    Class negated = {.count = 0};
+    uint32_t next = 0;
+    for (uint32_t i = 0; i < class->count; ++i) {
+        if (class->ranges[i].low > next) {
+            class_add(parser, &negated, next, class->ranges[i].low - 1);
+        }
+        next = class->ranges[i].high + 1;
+    }
+    if (next <= CODE_MAX) {
+        class_add(parser, &negated, next, CODE_MAX);
+    }
+    *class = negated;
+}
+
+// Add `\d`, `\w` or `\s` class, or their negation if `letter` is uppercase
+// Returns false if `letter` is none of these
+static bool class_escape(
+    Parser *const parser,
+    Class *const class,
+    const char letter
+) {
+    Class escaped = {.count = 0};
+    switch (letter | 0x20) {
+        case 'd':
+            class_add(parser, &escaped, '0', '9');
+            break;
+        case 'w':
+            class_add(parser, &escaped, '0', '9');
+            class_add(parser, &escaped, 'A', 'Z');
+            class_add(parser, &escaped, '_', '_');
+            class_add(parser, &escaped, 'a', 'z');
+            break;
+        case 's':
+            class_add(parser, &escaped, '\t', '\r');
+            class_add(parser, &escaped, ' ', ' ');
+            break;
+        default:
+            return false;
+    }
+    if (letter >= 'A' && letter <= 'Z') {
+        class_negate(parser, &escaped);
+    }
+    for (uint32_t i = 0; i < escaped.count; ++i) {
+        class_add(parser, class, escaped.ranges[i].low, escaped.ranges[i].high);
+    }
+    return true;
+}
+
+typedef struct NamedClass {
+    const char *name;
+    Range ranges[4];
+    uint32_t count;
+} NamedClass;
+
+// POSIX classes of ASCII characters, for `[:name:]` in a bracket class
+static const NamedClass NAMED_CLASSES[] = {
+    {"alnum", {{'0', '9'}, {'A', 'Z'}, {'a', 'z'}}, 3},
+    {"alpha", {{'A', 'Z'}, {'a', 'z'}}, 2},
+    {"blank", {{'\t', '\t'}, {' ', ' '}}, 2},
+    {"cntrl", {{0x00, 0x1f}, {0x7f, 0x7f}}, 2},
+    {"digit", {{'0', '9'}}, 1},
+    {"graph", {{'!', '~'}}, 1},
+    {"lower", {{'a', 'z'}}, 1},
+    {"print", {{' ', '~'}}, 1},
+    {"punct", {{'!', '/'}, {':', '@'}, {'[', '`'}, {'{', '~'}}, 4},
+    {"space", {{'\t', '\r'}, {' ', ' '}}, 2},
+    {"upper", {{'A', 'Z'}}, 1},
+    {"xdigit", {{'0', '9'}, {'A', 'F'}, {'a', 'f'}}, 3},
+};
+
+static Fragment class_fragment(Parser *const parser, const Class *const class) {
+    if (class->count == 0) {
+        if (parser->error == NULL) {
+            parser->error = "class matches nothing";
+        }
+        return empty(parser);
+    }
+    Fragment fragment =
+        code_range(parser, class->ranges[0].low, class->ranges[0].high);
+    for (uint32_t i = 1; i < class->count; ++i) {
+        fragment = either(
+            parser,
+            fragment,
+            code_range(parser, class->ranges[i].low, class->ranges[i].high)
+        );
+    }
+    return fragment;
+}
+
+static bool at_end(const Parser *const parser) {
+    return parser->pos >= parser->len;
+}
+
+static char peek(const Parser *const parser) {
+    return at_end(parser) ? '\0' : parser->pattern[parser->pos];
+}
+
+// Read one UTF-8 character of pattern
+static uint32_t read_char(Parser *const parser) {
+    const unsigned char *const text =
+        (const unsigned char *) &parser->pattern[parser->pos];
+    const size_t left = parser->len - parser->pos;
+    uint32_t len = 1;
+    uint32_t code = text[0];
+    if (code >= 0x80) {
+        len = code >= 0xf0 ? 4 : code >= 0xe0 ? 3 : 2;
+        code &= 0x7f >> len;
+        bool valid = text[0] >= 0xc2 && text[0] <= 0xf4 && len <= left;
+        for (uint32_t i = 1; valid && i < len; ++i) {
+            valid = (text[i] & 0xc0) == 0x80;
+            code = (code << 6) | (text[i] & 0x3f);
+        }
+        static const uint32_t LENGTH_MIN[] = {0, 0, 0x80, 0x800, 0x10000};
+        if (!valid || code < LENGTH_MIN[len] || code > CODE_MAX
+            || (code >= SURROGATE_MIN && code <= SURROGATE_MAX))
+        {
+            parser->error = "pattern is not valid UTF-8";
+            len = 1;
+        }
+    }
+    parser->pos += len;
+    return code;
+}
+
+// Read escaped character, after `\`, that is not a class
+static uint32_t read_escape(Parser *const parser) {
+    if (at_end(parser)) {
+        parser->error = "pattern ends with `\\`";
+        return 0;
+    }
+    const char letter = peek(parser);
+    if (letter == 't') {
+        ++parser->pos;
+        return '\t';
+    }
+    if ((letter >= '0' && letter <= '9') || (letter >= 'A' && letter <= 'Z')
+        || (letter >= 'a' && letter <= 'z'))
+    {
+        parser->error = "unknown escape";
+        return 0;
+    }
+    return read_char(parser);
+}
+
+// Add class of `[:name:]`, after `[:`
+static void class_named(Parser *const parser, Class *const class) {
+    const char *const name = &parser->pattern[parser->pos];
+    const char *const end = strstr(name, ":]");
+    if (end == NULL) {
+        parser->error = "class name is not closed";
+        return;
+    }
+    const size_t len = end - name;
+    parser->pos += len + 2;
+    const uint32_t count = sizeof(NAMED_CLASSES) / sizeof(NAMED_CLASSES[0]);
+    for (uint32_t i = 0; i < count; ++i) {
+        const NamedClass *const named = &NAMED_CLASSES[i];
+        if (strlen(named->name) == len && !memcmp(named->name, name, len)) {
+            for (uint32_t j = 0; j < named->count; ++j) {
+                class_add(
+                    parser,
+                    class,
+                    named->ranges[j].low,
+                    named->ranges[j].high
+                );
+            }
+            return;
+        }
+    }
+    parser->error = "unknown class name";
+}
+
+// Bracket class, after `[`
+static Fragment parse_class(Parser *const parser) {
+    Class class = {.count = 0};
+    const bool negated = peek(parser) == '^';
+    if (negated) {
+        ++parser->pos;
+    }
+    // `]` first is part of class
+    bool first = true;
+    while (parser->error == NULL && (first || peek(parser) != ']')) {
+        first = false;
+        if (at_end(parser)) {
+            parser->error = "class is not closed";
+            break;
+        }
+        if (peek(parser) == '[' && parser->pos + 1 < parser->len
+            && parser->pattern[parser->pos + 1] == ':')
+        {
+            parser->pos += 2;
+            class_named(parser, &class);
+            continue;
+        }
+        uint32_t low;
+        if (peek(parser) == '\\') {
+            ++parser->pos;
+            if (class_escape(parser, &class, peek(parser))) {
+                ++parser->pos;
+                continue;
+            }
+            low = read_escape(parser);
+        } else {
+            low = read_char(parser);
+        }
+        uint32_t high = low;
+        // `-` last is part of class
+        if (peek(parser) == '-' && parser->pos + 1 < parser->len
+            && parser->pattern[parser->pos + 1] != ']')
+        {
+            ++parser->pos;
+            if (peek(parser) == '\\') {
+                ++parser->pos;
+                high = read_escape(parser);
+            } else {
+                high = read_char(parser);
+            }
+        }
+        class_add(parser, &class, low, high);
+    }
+    ++parser->pos;
+    if (negated) {
+        class_negate(parser, &class);
+    }
+    return class_fragment(parser, &class);
+}
+
+static Fragment parse_alternation(Parser *const parser);
+
+static bool quantifier_next(const Parser *const parser) {
+    const char next = peek(parser);
+    return next == '*' || next == '+' || next == '?' || next == '{';
+}
+
+static Fragment parse_atom(Parser *const parser) {
+    const char next = peek(parser);
+    // Whole line is matched, so anchors at the ends change nothing
+    if ((next == '^' && parser->pos == 0)
+        || (next == '$' && parser->pos + 1 == parser->len))
+    {
+        ++parser->pos;
+        return empty(parser);
+    }
+    switch (next) {
+        case '(': {
+            ++parser->pos;
+            const Fragment group = parse_alternation(parser);
+            if (parser->error == NULL && peek(parser) != ')') {
+                parser->error = "group is not closed";
+            }
+            ++parser->pos;
+            return group;
+        }
+        case '[':
+            ++parser->pos;
+            return parse_class(parser);
+        case '.': {
+            ++parser->pos;
+            Class class = {.count = 0};
+            class_add(parser, &class, 0, CODE_MAX);
+            return class_fragment(parser, &class);
+        }
+        case '\\': {
+            ++parser->pos;
+            Class class = {.count = 0};
+            if (class_escape(parser, &class, peek(parser))) {
+                ++parser->pos;
+                return class_fragment(parser, &class);
+            }
+            const uint32_t code = read_escape(parser);
+            return code_range(parser, code, code);
+        }
+        case '^':
+        case '$':
+            parser->error = "`^` and `$` are only allowed at the ends";
+            return empty(parser);
+        case '*':
+        case '+':
+        case '?':
+        case '{':
+            parser->error = "nothing to repeat";
+            return empty(parser);
+        default: {
+            const uint32_t code = read_char(parser);
+            return code_range(parser, code, code);
+        }
+    }
+}
+
+static uint32_t parse_count(Parser *const parser) {
+    const char next = peek(parser);
+    if (next < '0' || next > '9') {
+        parser->error = "expected repeat count";
+        return 0;
+    }
+    uint32_t count = 0;
+    while (peek(parser) >= '0' && peek(parser) <= '9') {
+        count = count * 10 + (peek(parser) - '0');
+        if (count > REPEAT_MAX) {
+            parser->error = "repeat count is too large";
+            return 0;
+        }
+        ++parser->pos;
+    }
+    return count;
+}
+
+static void parse_quantifier(
+    Parser *const parser,
+    uint32_t *const min_count,
+    uint32_t *const max_count
+) {
+    const char next = peek(parser);
+    ++parser->pos;
+    switch (next) {
+        case '*':
+            *min_count = 0;
+            *max_count = REPEAT_UNBOUNDED;
+            return;
+        case '+':
+            *min_count = 1;
+            *max_count = REPEAT_UNBOUNDED;
+            return;
+        case '?':
+            *min_count = 0;
+            *max_count = 1;
+            return;
+        default:
+            break;
+    }
+    *min_count = parse_count(parser);
+    *max_count = *min_count;
+    if (parser->error == NULL && peek(parser) == ',') {
+        ++parser->pos;
+        *max_count = peek(parser) == '}' ? REPEAT_UNBOUNDED
+                                          : parse_count(parser);
+    }
+    if (parser->error == NULL && peek(parser) != '}') {
+        parser->error = "repeat is not closed";
+    }
+    if (parser->error == NULL && *max_count < *min_count) {
+        parser->error = "repeat counts are out of order";
+    }
+    ++parser->pos;
+}
+
+// Atom, and its quantifiers which start before `end`
+// Each copy of an atom after the first is parsed again
+static Fragment parse_repeat(Parser *const parser, const size_t end) {
+    const size_t start = parser->pos;
+    Fragment fragment = parse_atom(parser);
+    while (parser->error == NULL && parser->pos < end
+           && quantifier_next(parser))
+    {
+        const size_t quantifier = parser->pos;
+        uint32_t min_count;
+        uint32_t max_count;
+        parse_quantifier(parser, &min_count, &max_count);
+        const size_t after = parser->pos;
+        const uint32_t copies = max_count == REPEAT_UNBOUNDED
+            ? min_count + 1
+            : max_count;
+
+        Fragment result = empty(parser);
+        for (uint32_t i = 0; i < copies && parser->error == NULL; ++i) {
+            Fragment copy = fragment;
+            if (i > 0) {
+                parser->pos = start;
+                copy = parse_repeat(parser, quantifier);
+            }
+            if (i < min_count) {
+                result = sequence(parser, result, copy);
+            } else if (max_count == REPEAT_UNBOUNDED) {
+                result = sequence(parser, result, star(parser, copy));
+            } else {
+                result = sequence(parser, result, optional(parser, copy));
+            }
+        }
+        parser->pos = after;
+        fragment = result;
+    }
+    return fragment;
+}
+
+static Fragment parse_sequence(Parser *const parser) {
+    Fragment fragment = empty(parser);
+    while (parser->error == NULL && !at_end(parser) && peek(parser) != '|'
+           && peek(parser) != ')')
+    {
+        fragment = sequence(parser, fragment, parse_repeat(parser, SIZE_MAX));
+    }
+    return fragment;
+}
+
+static Fragment parse_alternation(Parser *const parser) {
+    Fragment fragment = parse_sequence(parser);
+    while (parser->error == NULL && peek(parser) == '|') {
+        ++parser->pos;
+        fragment = either(parser, fragment, parse_sequence(parser));
+    }
+    return fragment;
+}
+
+// Sorted byte and match nodes reachable from a set of nodes without reading
+// a byte, and the DFA state for them
+typedef struct Builder {
+    const Node *nodes;
+    uint32_t node_count;
+    // Nodes of each state, as ranges of `items`
+    uint32_t *items;
+    uint32_t item_count;
+    uint32_t item_capacity;
+    uint32_t *set_starts;
+    uint32_t *set_lens;
+    // Open addressing table of states, by their nodes
+    uint32_t *table;
+    uint32_t table_size;
+    // Nodes visited by current closure
+    uint32_t *marks;
+    uint32_t mark;
+    uint32_t *stack;
+    uint32_t *set;
+    uint32_t set_len;
+} Builder;
+
+static int compare_nodes(const void *const lhs, const void *const rhs) {
+    const uint32_t left = *(const uint32_t *) lhs;
+    const uint32_t right = *(const uint32_t *) rhs;
+    return (left > right) - (left < right);
+}
+
+// Add nodes reachable from `node` to `set`
+static void closure(Builder *const builder, const uint32_t node) {
+    uint32_t depth = 0;
+    builder->stack[depth++] = node;
+    while (depth > 0) {
+        const uint32_t current = builder->stack[--depth];
+        if (current == NODE_NONE || builder->marks[current] == builder->mark) {
+            continue;
+        }
+        builder->marks[current] = builder->mark;
+        const Node *const visited = &builder->nodes[current];
+        if (visited->kind == NODE_SPLIT) {
+            builder->stack[depth++] = visited->out;
+            builder->stack[depth++] = visited->out2;
+        } else {
+            builder->set[builder->set_len++] = current;
+        }
+    }
+}
+
+static uint32_t hash_set(const uint32_t *const set, const uint32_t len) {
+    uint32_t hash = 2166136261u;
+    for (uint32_t i = 0; i < len; ++i) {
+        hash = (hash ^ set[i]) * 16777619u;
+    }
+    return hash;
+}
+
+// State for nodes in `set`, added if new
+// Returns `STATES_MAX` if there are too many states
+static uint32_t find_state(Builder *const builder, uint32_t *const count) {
+    qsort(builder->set, builder->set_len, sizeof(uint32_t), compare_nodes);
+    const uint32_t len = builder->set_len;
+    uint32_t slot = hash_set(builder->set, len) & (builder->table_size - 1);
+    while (builder->table[slot] != NODE_NONE) {
+        const uint32_t state = builder->table[slot];
+        if (builder->set_lens[state] == len
+            && !memcmp(
+                &builder->items[builder->set_starts[state]],
+                builder->set,
+                len * sizeof(uint32_t)
+            ))
+        {
+            return state;
+        }
+        slot = (slot + 1) & (builder->table_size - 1);
+    }
+    if (*count >= STATES_MAX) {
+        return STATES_MAX;
+    }
+
+    if (builder->item_count + len > builder->item_capacity) {
+        uint32_t capacity = builder->item_capacity;
+        while (capacity < builder->item_count + len) {
+            capacity *= 2;
+        }
+        builder->items =
+            allocate(builder->items, capacity * sizeof(uint32_t));
+        builder->item_capacity = capacity;
+    }
+    const uint32_t state = (*count)++;
+    memcpy(
+        &builder->items[builder->item_count],
+        builder->set,
+        len * sizeof(uint32_t)
+    );
+    builder->set_starts[state] = builder->item_count;
+    builder->set_lens[state] = len;
+    builder->item_count += len;
+    builder->table[slot] = state;
+    return state;
+}
+
+// Subset construction, with one transition for each byte class
+static bool build_dfa(
+    Regex *const regex,
+    const Node *const nodes,
+    const uint32_t node_count,
+    const uint32_t start
+) {
+    // Classes change wherever a byte range starts or ends
+    bool splits[257] = {false};
+    for (uint32_t i = 0; i < node_count; ++i) {
+        if (nodes[i].kind == NODE_BYTES) {
+            splits[nodes[i].low] = true;
+            splits[nodes[i].high + 1] = true;
+        }
+    }
+    uint8_t representatives[256];
+    regex->class_count = 0;
+    for (uint32_t byte = 0; byte < 256; ++byte) {
+        if (byte == 0 || splits[byte]) {
+            representatives[regex->class_count++] = byte;
+        }
+        regex->classes[byte] = regex->class_count - 1;
+    }
+
+    Builder builder = {
+        .nodes = nodes,
+        .node_count = node_count,
+        .items = allocate(NULL, 256 * sizeof(uint32_t)),
+        .item_count = 0,
+        .item_capacity = 256,
+        .set_starts = allocate(NULL, STATES_MAX * sizeof(uint32_t)),
+        .set_lens = allocate(NULL, STATES_MAX * sizeof(uint32_t)),
+        .table = allocate(NULL, STATES_MAX * 2 * sizeof(uint32_t)),
+        .table_size = STATES_MAX * 2,
+        .marks = allocate(NULL, node_count * sizeof(uint32_t)),
+        .mark = 0,
+        .stack = allocate(NULL, (node_count * 2 + 1) * sizeof(uint32_t)),
+        .set = allocate(NULL, node_count * sizeof(uint32_t)),
+        .set_len = 0,
+    };
+    memset(builder.marks, 0, node_count * sizeof(uint32_t));
+    memset(builder.table, 0xff, builder.table_size * sizeof(uint32_t));
+    regex->transitions = allocate(
+        NULL, (size_t) STATES_MAX * regex->class_count * sizeof(uint32_t)
+    );
+    regex->accepting = allocate(NULL, STATES_MAX * sizeof(bool));
+
+    // Dead state has no nodes
+    uint32_t count = 0;
+    builder.set_len = 0;
+    find_state(&builder, &count);
+    ++builder.mark;
+    builder.set_len = 0;
+    closure(&builder, start);
+    regex->start = find_state(&builder, &count) * regex->class_count;
+
+    bool fits = true;
+    for (uint32_t state = 0; state < count && fits; ++state) {
+        const uint32_t *const set = &builder.items[builder.set_starts[state]];
+        const uint32_t len = builder.set_lens[state];
+        regex->accepting[state] = false;
+        for (uint32_t i = 0; i < len; ++i) {
+            if (nodes[set[i]].kind == NODE_MATCH) {
+                regex->accepting[state] = true;
+            }
+        }
+        for (uint32_t class = 0; class < regex->class_count; ++class) {
+            const uint8_t byte = representatives[class];
+            ++builder.mark;
+            builder.set_len = 0;
+            // Items may move as states are added
+            const uint32_t set_start = builder.set_starts[state];
+            for (uint32_t i = 0; i < len; ++i) {
+                const Node *const node =
+                    &nodes[builder.items[set_start + i]];
+                if (node->kind == NODE_BYTES && byte >= node->low
+                    && byte <= node->high)
+                {
+                    closure(&builder, node->out);
+                }
+            }
+            const uint32_t next = find_state(&builder, &count);
+            if (next >= STATES_MAX) {
+                fits = false;
+                break;
+            }
+            regex->transitions[state * regex->class_count + class] =
+                next * regex->class_count;
+        }
+    }
+    regex->state_count = count;
+    regex->transitions = allocate(
+        regex->transitions,
+        (size_t) count * regex->class_count * sizeof(uint32_t)
+    );
+
+    mem_free(builder.items);
+    mem_free(builder.set_starts);
+    mem_free(builder.set_lens);
+    mem_free(builder.table);
+    mem_free(builder.marks);
+    mem_free(builder.stack);
+    mem_free(builder.set);
+    return fits;
+}
+
+bool regex_compile(
+    Regex *const regex,
+    const char *const pattern,
+    const char **const error
+) {
+    Parser parser = {
+        .pattern = pattern,
+        .len = strlen(pattern),
+        .pos = 0,
+        .nodes = NULL,
+        .node_count = 0,
+        .node_capacity = 0,
+        .error = NULL,
+    };
+    const uint32_t match = add_node(&parser, NODE_MATCH, 0, 0);
+    const Fragment fragment = parse_alternation(&parser);
+    if (parser.error == NULL && !at_end(&parser)) {
+        parser.error = "unmatched `)`";
+    }
+    parser.nodes[fragment.end].out = match;
+
+    regex->transitions = NULL;
+    regex->accepting = NULL;
+    bool compiled = parser.error == NULL;
+    if (compiled
+        && !build_dfa(regex, parser.nodes, parser.node_count, fragment.start))
+    {
+        parser.error = "pattern is too complex";
+        compiled = false;
+    }
+    mem_free(parser.nodes);
+    if (!compiled) {
+        regex_free(regex);
+        *error = parser.error;
+    }
+    return compiled;
+}
+
+void regex_free(Regex *const regex) {
+    mem_free(regex->transitions);
+    mem_free(regex->accepting);
+    regex->transitions = NULL;
+    regex->accepting = NULL;
+    regex->state_count = 0;
+}
+
+void validator_init(Validator *const validator, const Regex *const regex) {
+    validator->regex = regex;
+    validator->states = allocate(NULL, sizeof(uint32_t));
+    validator->states[0] = regex->start;
+    validator->len = 0;
+    validator->capacity = 1;
+}
+
+void validator_free(Validator *const validator) {
+    mem_free(validator->states);
+    validator->states = NULL;
+    validator->len = 0;
+    validator->capacity = 0;
+}
+
+void validator_edited(Validator *const validator, const uint32_t index) {
+    if (index < validator->len) {
+        validator->len = index;
+    }
+}
+
+bool validator_matches(
+    Validator *const validator,
+    const Buffer *const line
+) {
+    const Regex *const regex = validator->regex;
+    const uint32_t len = buffer_len(line);
+    uint32_t index = validator->len < len ? validator->len : len;
+    if (len + 1 > validator->capacity) {
+        uint32_t capacity = validator->capacity;
+        while (capacity < len + 1) {
+            capacity *= 2;
+        }
+        validator->states =
+            allocate(validator->states, capacity * sizeof(uint32_t));
+        validator->capacity = capacity;
+    }
+
+    uint32_t state = validator->states[index];
+    while (index < len && state != REGEX_DEAD) {
+        uint32_t span_len;
+        const char *const span = buffer_span(line, index, &span_len);
+        uint32_t *const states = &validator->states[index + 1];
+        for (uint32_t i = 0; i < span_len; ++i) {
+            state = regex_step(regex, state, span[i]);
+            states[i] = state;
+        }
+        index += span_len;
+    }
+    // No byte leaves the dead state
+    memset(
+        &validator->states[index + 1], 0, (len - index) * sizeof(uint32_t)
+    );
+    validator->len = len;
+    return regex_accepts(regex, validator->states[len]);
+}
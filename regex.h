@@ -0,0 +1,72 @@
+#ifndef REGEX_H
+#define REGEX_H
+
+#include "buffer.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// State with no way to match, which every byte leads back to
+#define REGEX_DEAD (0)
+
+// Pattern compiled to a DFA over bytes, which must match a whole line
+// Bytes are grouped into classes which no part of the pattern tells apart,
+// so each state has a row of `class_count` transitions
+// States are kept as the offset of their row, so a step is two loads
+typedef struct Regex {
+    uint8_t classes[256];
+    uint32_t class_count;
+    uint32_t *transitions;
+    bool *accepting;  // By state number, which is row offset / class count
+    uint32_t state_count;
+    uint32_t start;
+} Regex;
+
+// DFA state after each prefix of a line, so an edit only runs the DFA again
+// from where it starts
+typedef struct Validator {
+    const Regex *regex;
+    uint32_t *states;  // State after each number of bytes, from 0 to `len`
+    uint32_t len;
+    uint32_t capacity;
+} Validator;
+
+// Supports `|`, `()`, `*`, `+`, `?`, `{m}`, `{m,}`, `{m,n}`, `.`, bracket
+// classes, `\d`, `\w`, `\s` and their negations, and `^` and `$` at the ends
+// Classes and `.` match UTF-8 characters
+// Returns false and sets `error` if pattern is invalid or too large
+bool regex_compile(
+    Regex *const regex,
+    const char *const pattern,
+    const char **const error
+);
+
+void regex_free(Regex *const regex);
+
+static inline uint32_t regex_step(
+    const Regex *const regex,
+    const uint32_t state,
+    const char byte
+) {
+    return regex->transitions[state + regex->classes[(unsigned char) byte]];
+}
+
+static inline bool regex_accepts(
+    const Regex *const regex,
+    const uint32_t state
+) {
+    return regex->accepting[state / regex->class_count];
+}
+
+void validator_init(Validator *const validator, const Regex *const regex);
+
+void validator_free(Validator *const validator);
+
+// Forget states after an edit at `index`
+void validator_edited(Validator *const validator, const uint32_t index);
+
+// Whether whole line matches
+// Only bytes from the first one edited since the last call are read
+bool validator_matches(Validator *const validator, const Buffer *const line);
+
+#endif
@@ -0,0 +1,337 @@
+#include "render.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CURSOR_SHAPE_UNKNOWN (-1)
+// Furthest cells are moved by an insert or delete
+#define SHIFT_MAX (8)
+// Fewest cells moving must save writing, to be worth its escape sequences
+#define SHIFT_MIN_SAVED (8)
+// Changes closer than this are written together, as moving between them
+// would take about as many bytes
+#define GAP_MAX (4)
+
+static bool same_text(const Cell *const lhs, const Cell *const rhs) {
+    return lhs->len == rhs->len && !memcmp(lhs->text, rhs->text, lhs->len);
+}
+
+static void invalidate(Renderer *const renderer) {
+    for (int i = 0; i < renderer->rows; ++i) {
+        renderer->lines[i].len = 0;
+        renderer->boxes[i].drawn = false;
+    }
+    renderer->details_drawn = false;
+}
+
+void render_init(Renderer *const renderer, const Backend *const backend) {
+    renderer->backend = backend;
+    renderer->rows = 0;
+    renderer->cols = 0;
+    renderer->lines = NULL;
+    renderer->boxes = NULL;
+    renderer->cursor_shape = CURSOR_SHAPE_UNKNOWN;
+    invalidate(renderer);
+}
+
+bool render_begin(Renderer *const renderer, const int rows, const int cols) {
+    if (rows == renderer->rows && cols == renderer->cols) {
+        return false;
+    }
+    for (int i = 0; i < renderer->rows; ++i) {
+        free(renderer->lines[i].cells);
+    }
+    renderer->lines = realloc(renderer->lines, rows * sizeof(Line));
+    renderer->boxes = realloc(renderer->boxes, rows * sizeof(Box));
+    if (renderer->lines == NULL || renderer->boxes == NULL) {
+        perror("Failed to allocate screen");
+        exit(1);
+    }
+    for (int i = 0; i < rows; ++i) {
+        renderer->lines[i] = (Line) {.x = 0, .cells = NULL, .len = 0};
+    }
+    renderer->rows = rows;
+    renderer->cols = cols;
+    render_clear(renderer);
+    return true;
+}
+
+void render_clear(Renderer *const renderer) {
+    renderer->backend->clear();
+    invalidate(renderer);
+}
+
+void render_box(
+    Renderer *const renderer,
+    const uint32_t x,
+    const uint32_t y,
+    const uint32_t width,
+    const bool left_open,
+    const bool right_open,
+    const bool invalid
+) {
+    if (y >= (uint32_t) renderer->rows) {
+        return;
+    }
+    Box *const drawn = &renderer->boxes[y];
+    if (drawn->drawn && drawn->x == x && drawn->width == width
+        && drawn->left_open == left_open && drawn->right_open == right_open
+        && drawn->invalid == invalid)
+    {
+        return;
+    }
+
+    renderer->backend->box(x, y, width, left_open, right_open, invalid);
+
+    *drawn = (Box) {
+        .drawn = true,
+        .x = x,
+        .width = width,
+        .left_open = left_open,
+        .right_open = right_open,
+        .invalid = invalid,
+    };
+}
+
+static bool same_cell(const Cell *const lhs, const Cell *const rhs) {
+    return same_text(lhs, rhs) && lhs->style == rhs->style;
+}
+
+// Range of cells which changed, or `first` as `len` if none did
+static void find_changes(
+    const Cell *const line,
+    const Cell *const cells,
+    const uint32_t len,
+    uint32_t *const first,
+    uint32_t *const last
+) {
+    *first = len;
+    *last = 0;
+    for (uint32_t i = 0; i < len; ++i) {
+        if (!same_cell(&cells[i], &line[i])) {
+            if (*first == len) {
+                *first = i;
+            }
+            *last = i;
+        }
+    }
+}
+
+static uint32_t count_changes(
+    const Cell *const line,
+    const Cell *const cells,
+    const uint32_t first,
+    const uint32_t len
+) {
+    uint32_t count = 0;
+    for (uint32_t i = first; i < len; ++i) {
+        count += !same_cell(&cells[i], &line[i]);
+    }
+    return count;
+}
+
+// Whether cells from `first` can be moved by `count` without splitting a
+// wide character
+static bool can_shift(
+    const Cell *const line,
+    const Cell *const cells,
+    const uint32_t first,
+    const uint32_t len,
+    const int count
+) {
+    if (line[first].len == 0 || cells[first].len == 0) {
+        return false;
+    }
+    // Cells deleted to make room, or deleted by the shift
+    if (count > 0) {
+        return first + count < len && line[len - count].len != 0;
+    }
+    return first - count < len && line[first - count].len != 0;
+}
+
+// Move drawn cells from `first` by `count`, as the terminal does
+static void shift_cells(
+    Cell *const line,
+    const uint32_t first,
+    const uint32_t len,
+    const int count
+) {
+    const Cell blank = {.text = {' '}, .len = 1, .style = STYLE_NORMAL};
+    if (count > 0) {
+        memmove(
+            &line[first + count],
+            &line[first],
+            (len - first - count) * sizeof(Cell)
+        );
+        for (uint32_t i = first; i < first + count; ++i) {
+            line[i] = blank;
+        }
+    } else {
+        memmove(
+            &line[first],
+            &line[first - count],
+            (len - first + count) * sizeof(Cell)
+        );
+        for (uint32_t i = len + count; i < len; ++i) {
+            line[i] = blank;
+        }
+    }
+}
+
+// Number of cells to move drawn cells from `first` by, so that fewest cells
+// need writing, or 0 if moving them saves too little
+static int find_shift(
+    const Cell *const line,
+    const Cell *const cells,
+    const uint32_t first,
+    const uint32_t len
+) {
+    uint32_t best_changes = count_changes(line, cells, first, len);
+    if (best_changes < SHIFT_MIN_SAVED) {
+        return 0;
+    }
+    best_changes -= SHIFT_MIN_SAVED;
+    int best = 0;
+    Cell moved[len];
+    for (int count = -SHIFT_MAX; count <= SHIFT_MAX; ++count) {
+        if (count == 0 || !can_shift(line, cells, first, len, count)) {
+            continue;
+        }
+        memcpy(moved, line, len * sizeof(Cell));
+        shift_cells(moved, first, len, count);
+        const uint32_t changes = count_changes(moved, cells, first, len);
+        if (changes < best_changes) {
+            best_changes = changes;
+            best = count;
+        }
+    }
+    return best;
+}
+
+// Write cells from `first` to `last`, in runs of one style
+// Returns last cell written, as wide characters are written whole
+static uint32_t write_cells(
+    Renderer *const renderer,
+    const uint32_t x,
+    const uint32_t y,
+    const Cell *const cells,
+    const uint32_t len,
+    uint32_t first,
+    uint32_t last
+) {
+    while (first > 0 && cells[first].len == 0) {
+        --first;
+    }
+    while (last + 1 < len && cells[last + 1].len == 0) {
+        ++last;
+    }
+
+    char text[(last - first + 1) * UTF8_MAX];
+    for (uint32_t i = first; i <= last;) {
+        const uint8_t style = cells[i].style;
+        uint32_t text_len = 0;
+        uint32_t end = i;
+        while (end <= last && cells[end].style == style) {
+            memcpy(&text[text_len], cells[end].text, cells[end].len);
+            text_len += cells[end].len;
+            ++end;
+        }
+        renderer->backend->text(x + i, y, text, text_len, style);
+        i = end;
+    }
+    return last;
+}
+
+void render_line(
+    Renderer *const renderer,
+    const uint32_t x,
+    const uint32_t y,
+    const Cell *const cells,
+    const uint32_t len
+) {
+    if (len == 0 || y >= (uint32_t) renderer->rows) {
+        return;
+    }
+
+    // Different position or width, so nothing on screen can be reused
+    Line *const drawn = &renderer->lines[y];
+    if (len != drawn->len || x != drawn->x) {
+        Cell *const cells = realloc(drawn->cells, len * sizeof(Cell));
+        if (cells == NULL) {
+            perror("Failed to allocate screen");
+            exit(1);
+        }
+        drawn->x = x;
+        drawn->cells = cells;
+        drawn->len = len;
+        // Never equal to a real cell
+        memset(cells, 0xff, len * sizeof(Cell));
+    }
+    Cell *const line = drawn->cells;
+
+    uint32_t first;
+    uint32_t last;
+    find_changes(line, cells, len, &first, &last);
+    if (first == len) {
+        return;
+    }
+
+    // Rest of line is moved on the terminal after an insert or delete, so
+    // a change costs the same at any width
+    const int count = find_shift(line, cells, first, len);
+    if (count != 0
+        && renderer->backend->shift(y, x + first, x + len, count))
+    {
+        shift_cells(line, first, len, count);
+        find_changes(line, cells, len, &first, &last);
+    }
+
+    // Only changed cells are written, unless they are close together
+    uint32_t start = first;
+    while (start < len && start <= last) {
+        if (same_cell(&cells[start], &line[start])) {
+            ++start;
+            continue;
+        }
+        uint32_t end = start;
+        for (uint32_t i = start + 1; i <= last && i < end + GAP_MAX; ++i) {
+            if (!same_cell(&cells[i], &line[i])) {
+                end = i;
+            }
+        }
+        start = write_cells(renderer, x, y, cells, len, start, end) + 1;
+    }
+
+    memcpy(line, cells, len * sizeof(Cell));
+}
+
+void render_details(
+    Renderer *const renderer,
+    const int row,
+    const char *const text
+) {
+    if (renderer->details_drawn && !strcmp(renderer->details, text)) {
+        return;
+    }
+
+    renderer->backend->details(row, text);
+
+    renderer->details_drawn = true;
+    snprintf(renderer->details, DETAILS_MAX, "%s", text);
+}
+
+void render_cursor(
+    Renderer *const renderer,
+    const uint32_t x,
+    const uint32_t y,
+    const bool bar
+) {
+    // Only sent when changed
+    const int shape = bar ? 5 : 1;
+    if (shape != renderer->cursor_shape) {
+        renderer->backend->cursor_shape(shape);
+        renderer->cursor_shape = shape;
+    }
+    renderer->backend->cursor(x, y);
+}
@@ -0,0 +1,89 @@
+#ifndef RENDER_H
+#define RENDER_H
+
+#include "backend.h"
+#include "utf8.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define DETAILS_MAX (128)
+
+// One screen column, holding a UTF-8 character
+// The right half of a wide character has `len` 0
+typedef struct Cell {
+    char text[UTF8_MAX];
+    uint8_t len;
+    uint8_t style;
+} Cell;
+
+// Cells drawn on one screen row
+typedef struct Line {
+    uint32_t x;
+    Cell *cells;
+    uint32_t len;
+} Line;
+
+// Box drawn with its top on one screen row
+typedef struct Box {
+    bool drawn;
+    uint32_t x;
+    uint32_t width;
+    bool left_open;
+    bool right_open;
+    bool invalid;
+} Box;
+
+// What is currently on the screen, so only changes are drawn
+typedef struct Renderer {
+    const Backend *backend;
+    int rows;
+    int cols;
+    Line *lines;  // One for each row
+    Box *boxes;   // By top row
+    bool details_drawn;
+    char details[DETAILS_MAX];
+    int cursor_shape;
+} Renderer;
+
+void render_init(Renderer *const renderer, const Backend *const backend);
+
+// Forget previous frame if screen size changed
+// Returns whether screen was resized
+bool render_begin(Renderer *const renderer, const int rows, const int cols);
+
+// Clear screen, and forget previous frame
+void render_clear(Renderer *const renderer);
+
+void render_box(
+    Renderer *const renderer,
+    const uint32_t x,
+    const uint32_t y,
+    const uint32_t width,
+    const bool left_open,
+    const bool right_open,
+    const bool invalid
+);
+
+void render_line(
+    Renderer *const renderer,
+    const uint32_t x,
+    const uint32_t y,
+    const Cell *const cells,
+    const uint32_t len
+);
+
+void render_details(
+    Renderer *const renderer,
+    const int row,
+    const char *const text
+);
+
+void render_cursor(
+    Renderer *const renderer,
+    const uint32_t x,
+    const uint32_t y,
+    const bool bar
+);
+
+#endif
@@ -0,0 +1,343 @@
+#define _GNU_SOURCE  // ppoll, accept4
+
+#include "serve.h"
+
+#include "output.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define REQUEST_MAX (1024 * 1024)
+// Client's terminal and stderr
+#define REQUEST_FDS (2)
+
+// Connection to a client whose prompt is running
+typedef struct Client {
+    pid_t pid;
+    int conn;
+} Client;
+
+static void *allocate(void *const ptr, const size_t size) {
+    void *const result = realloc(ptr, size);
+    if (result == NULL) {
+        perror("Failed to allocate request");
+        exit(1);
+    }
+    return result;
+}
+
+// Returns false if connection ended or failed first
+static bool read_all(const int fd, void *const bytes, const size_t len) {
+    size_t done = 0;
+    while (done < len) {
+        const ssize_t count = read(fd, &((char *) bytes)[done], len - done);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            return false;
+        }
+        done += count;
+    }
+    return true;
+}
+
+static struct sockaddr_un socket_address(const char *const path) {
+    struct sockaddr_un address = {.sun_family = AF_UNIX};
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Socket path is too long.\n");
+        exit(1);
+    }
+    strcpy(address.sun_path, path);
+    return address;
+}
+
+// Only interrupts waiting for clients
+static void on_child(const int signal) {
+    (void) signal;
+}
+
+// Send exit status of each finished prompt to its client
+static void reap(Client *const clients, uint32_t *const count) {
+    int status;
+    pid_t pid;
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+        for (uint32_t i = 0; i < *count; ++i) {
+            if (clients[i].pid != pid) {
+                continue;
+            }
+            const char code = WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+            // Client may have gone already
+            write_all(clients[i].conn, &code, 1);
+            close(clients[i].conn);
+            clients[i] = clients[--*count];
+            break;
+        }
+    }
+}
+
+void serve(const char *const path, void (*const prompt)(const int conn)) {
+    const struct sockaddr_un address = socket_address(path);
+    const int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listener < 0) {
+        perror("Failed to create socket");
+        exit(1);
+    }
+    // Replace socket left by a previous server
+    struct stat info;
+    if (lstat(path, &info) == 0 && S_ISSOCK(info.st_mode)) {
+        unlink(path);
+    }
+    if (bind(listener, (const struct sockaddr *) &address, sizeof(address))
+            != 0
+        || listen(listener, SOMAXCONN) != 0)
+    {
+        perror("Failed to listen on socket");
+        exit(1);
+    }
+
+    // Children are only noticed while waiting, so none are missed
+    sigset_t child_signal;
+    sigset_t original;
+    sigemptyset(&child_signal);
+    sigaddset(&child_signal, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &child_signal, &original);
+    struct sigaction action = {.sa_handler = on_child};
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGCHLD, &action, NULL);
+
+    Client *clients = NULL;
+    uint32_t count = 0;
+    uint32_t capacity = 0;
+    while (true) {
+        reap(clients, &count);
+        struct pollfd input = {.fd = listener, .events = POLLIN};
+        if (ppoll(&input, 1, NULL, &original) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("Failed to wait for clients");
+            exit(1);
+        }
+        // Client may have gone already
+        const int conn = accept4(listener, NULL, NULL, SOCK_CLOEXEC);
+        if (conn < 0) {
+            continue;
+        }
+
+        const pid_t pid = fork();
+        if (pid < 0) {
+            perror("Failed to start prompt");
+            close(conn);
+            continue;
+        }
+        if (pid == 0) {
+            // Other clients must see the end of their own prompt only
+            close(listener);
+            for (uint32_t i = 0; i < count; ++i) {
+                close(clients[i].conn);
+            }
+            free(clients);
+            signal(SIGCHLD, SIG_DFL);
+            sigprocmask(SIG_SETMASK, &original, NULL);
+            prompt(conn);
+            exit(1);
+        }
+
+        if (count >= capacity) {
+            capacity = capacity > 0 ? capacity * 2 : 16;
+            clients = allocate(clients, capacity * sizeof(Client));
+        }
+        clients[count++] = (Client) {.pid = pid, .conn = conn};
+    }
+}
+
+static void invalid_request(void) {
+    fprintf(stderr, "Invalid request from client.\n");
+    exit(1);
+}
+
+void serve_receive(const int conn, Request *const request) {
+    uint32_t len;
+    struct iovec part = {.iov_base = &len, .iov_len = sizeof(len)};
+    union {
+        struct cmsghdr header;
+        char bytes[CMSG_SPACE(REQUEST_FDS * sizeof(int))];
+    } control;
+    struct msghdr message = {
+        .msg_iov = &part,
+        .msg_iovlen = 1,
+        .msg_control = control.bytes,
+        .msg_controllen = sizeof(control.bytes),
+    };
+    // Descriptors come with first byte, which may be read alone
+    ssize_t count;
+    do {
+        count = recvmsg(conn, &message, MSG_CMSG_CLOEXEC);
+    } while (count < 0 && errno == EINTR);
+    const struct cmsghdr *const fds = CMSG_FIRSTHDR(&message);
+    if (count <= 0
+        || !read_all(conn, &((char *) &len)[count], sizeof(len) - count)
+        || fds == NULL || fds->cmsg_level != SOL_SOCKET
+        || fds->cmsg_type != SCM_RIGHTS
+        || fds->cmsg_len != CMSG_LEN(REQUEST_FDS * sizeof(int)))
+    {
+        invalid_request();
+    }
+    int tty_fd;
+    int error_fd;
+    memcpy(&tty_fd, CMSG_DATA(fds), sizeof(int));
+    memcpy(&error_fd, CMSG_DATA(fds) + sizeof(int), sizeof(int));
+
+    if (len == 0 || len > REQUEST_MAX) {
+        invalid_request();
+    }
+    char *const data = allocate(NULL, len);
+    if (!read_all(conn, data, len) || data[len - 1] != '\0') {
+        invalid_request();
+    }
+
+    // Split into fields
+    uint32_t field_count = 0;
+    for (uint32_t i = 0; i < len; ++i) {
+        field_count += data[i] == '\0';
+    }
+    if (field_count < 3) {
+        invalid_request();
+    }
+    const char **const fields =
+        allocate(NULL, (field_count + 1) * sizeof(char *));
+    const char *field = data;
+    for (uint32_t i = 0; i < field_count; ++i) {
+        fields[i] = field;
+        field += strlen(field) + 1;
+    }
+    fields[field_count] = NULL;
+    request->data = data;
+    request->cwd = fields[0];
+    request->term = fields[1];
+    request->argc = field_count - 2;
+    request->argv = &fields[2];
+
+    if (dup2(tty_fd, STDIN_FILENO) < 0 || dup2(tty_fd, STDOUT_FILENO) < 0
+        || dup2(error_fd, STDERR_FILENO) < 0)
+    {
+        perror("Failed to use client terminal");
+        exit(1);
+    }
+    if (tty_fd > STDERR_FILENO) {
+        close(tty_fd);
+    }
+    if (error_fd > STDERR_FILENO && error_fd != tty_fd) {
+        close(error_fd);
+    }
+    if (chdir(request->cwd) != 0) {
+        perror("Failed to change directory");
+        exit(1);
+    }
+    setenv("TERM", request->term, 1);
+
+    const uint32_t pid = getpid();
+    if (!write_all(conn, (const char *) &pid, sizeof(pid))) {
+        exit(1);
+    }
+}
+
+int serve_request(
+    const char *const path,
+    const int tty_fd,
+    const int argc,
+    const char *const *const argv,
+    uint32_t *const pid
+) {
+    const struct sockaddr_un address = socket_address(path);
+    const int conn = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (conn < 0) {
+        perror("Failed to create socket");
+        exit(1);
+    }
+    if (connect(conn, (const struct sockaddr *) &address, sizeof(address))
+        != 0)
+    {
+        perror("Failed to connect to server");
+        exit(1);
+    }
+
+    char *const cwd = getcwd(NULL, 0);
+    if (cwd == NULL) {
+        perror("Failed to get working directory");
+        exit(1);
+    }
+    const char *const term = getenv("TERM");
+    const char *const leading[] = {cwd, term != NULL ? term : ""};
+
+    // Length, then fields
+    size_t len = sizeof(uint32_t);
+    for (int i = 0; i < 2; ++i) {
+        len += strlen(leading[i]) + 1;
+    }
+    for (int i = 0; i < argc; ++i) {
+        len += strlen(argv[i]) + 1;
+    }
+    if (len - sizeof(uint32_t) > REQUEST_MAX) {
+        fprintf(stderr, "Request is too large.\n");
+        exit(1);
+    }
+    char *const data = allocate(NULL, len);
+    const uint32_t data_len = len - sizeof(uint32_t);
+    memcpy(data, &data_len, sizeof(data_len));
+    size_t end = sizeof(uint32_t);
+    for (int i = 0; i < 2 + argc; ++i) {
+        const char *const field = i < 2 ? leading[i] : argv[i - 2];
+        const size_t field_len = strlen(field) + 1;
+        memcpy(&data[end], field, field_len);
+        end += field_len;
+    }
+
+    // Descriptors go with first byte, and the rest is written after
+    struct iovec part = {.iov_base = data, .iov_len = 1};
+    union {
+        struct cmsghdr header;
+        char bytes[CMSG_SPACE(REQUEST_FDS * sizeof(int))];
+    } control;
+    memset(&control, 0, sizeof(control));
+    struct msghdr message = {
+        .msg_iov = &part,
+        .msg_iovlen = 1,
+        .msg_control = control.bytes,
+        .msg_controllen = sizeof(control.bytes),
+    };
+    struct cmsghdr *const fds = CMSG_FIRSTHDR(&message);
+    fds->cmsg_level = SOL_SOCKET;
+    fds->cmsg_type = SCM_RIGHTS;
+    fds->cmsg_len = CMSG_LEN(REQUEST_FDS * sizeof(int));
+    const int sent_fds[REQUEST_FDS] = {tty_fd, STDERR_FILENO};
+    memcpy(CMSG_DATA(fds), sent_fds, sizeof(sent_fds));
+    ssize_t count;
+    do {
+        count = sendmsg(conn, &message, 0);
+    } while (count < 0 && errno == EINTR);
+    if (count != 1 || !write_all(conn, &data[1], len - 1)) {
+        perror("Failed to send request");
+        exit(1);
+    }
+    free(data);
+    free(cwd);
+
+    if (!read_all(conn, pid, sizeof(*pid))) {
+        fprintf(stderr, "Server did not start prompt.\n");
+        exit(1);
+    }
+    return conn;
+}
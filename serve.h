@@ -0,0 +1,44 @@
+#ifndef SERVE_H
+#define SERVE_H
+
+#include <stdint.h>
+
+// Prompts for clients of a Unix socket, each run in a process forked from
+// a server which has already started
+//
+// A request is a 32-bit length, then that many bytes of null-terminated
+// fields: working directory, `TERM`, program name, then options
+// The client's terminal and stderr are sent with the length
+// The reply is the 32-bit pid of the prompt process, then what it
+// printed, then its exit status as the last byte
+
+typedef struct Request {
+    char *data;
+    const char *cwd;
+    const char *term;
+    // Program name, then options
+    int argc;
+    const char **argv;
+} Request;
+
+// Handle clients until killed, calling `prompt` in a new process for each
+// `prompt` is given the connection, and should not return
+void serve(const char *const path, void (*const prompt)(const int conn));
+
+// Read request, and take client's terminal as stdin and stdout, its stderr
+// as stderr, and its working directory and `TERM`
+// Exits if the request is invalid
+void serve_receive(const int conn, Request *const request);
+
+// Connect to server, and send request with this terminal and stderr
+// Returns connection, and sets `pid` to the prompt process
+// Exits on failure
+int serve_request(
+    const char *const path,
+    const int tty_fd,
+    const int argc,
+    const char *const *const argv,
+    uint32_t *const pid
+);
+
+#endif
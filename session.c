@@ -0,0 +1,259 @@
+#include "session.h"
+
+#include "output.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <limits.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Power of 2, so positions wrap by masking
+#define RING_SIZE (1u << 20)
+// Longest event, of a 10 byte varint and two 5 byte ones
+#define EVENT_MAX (20)
+// How long the writer sleeps once it has written everything
+#define DRAIN_INTERVAL_NS (10 * 1000 * 1000)
+
+// Single producer, single consumer ring of encoded events
+// Only the main thread records, advancing `head`, and only the writer
+// advances `tail`, so neither ever takes a lock
+// Both count bytes ever written, and wrap together with the ring
+typedef struct Recorder {
+    int fd;
+    char *ring;
+    atomic_uint head;
+    atomic_uint tail;
+    atomic_bool stopping;
+    bool failed;
+    pthread_t thread;
+    uint64_t last;     // Time of last event kept
+    uint64_t dropped;  // Events which did not fit in the ring
+} Recorder;
+
+static Recorder recorder;
+static bool recording = false;
+
+uint64_t session_now(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (uint64_t) time.tv_sec * 1000000000 + time.tv_nsec;
+}
+
+static uint32_t put_varint(char *const bytes, uint64_t value) {
+    uint32_t len = 0;
+    while (value >= 0x80) {
+        bytes[len++] = (char) (value | 0x80);
+        value >>= 7;
+    }
+    bytes[len++] = (char) value;
+    return len;
+}
+
+// Write out everything in the ring
+// Returns false if it was empty
+static bool drain(void) {
+    const uint32_t head =
+        atomic_load_explicit(&recorder.head, memory_order_acquire);
+    const uint32_t tail =
+        atomic_load_explicit(&recorder.tail, memory_order_relaxed);
+    if (head == tail) {
+        return false;
+    }
+    const uint32_t start = tail & (RING_SIZE - 1);
+    const uint32_t len = head - tail;
+    const uint32_t first = len < RING_SIZE - start ? len : RING_SIZE - start;
+    // Events are still taken after a failure, so recording never blocks
+    if (!recorder.failed
+        && (!write_all(recorder.fd, &recorder.ring[start], first)
+            || !write_all(recorder.fd, recorder.ring, len - first)))
+    {
+        perror("Failed to write session");
+        recorder.failed = true;
+    }
+    atomic_store_explicit(&recorder.tail, head, memory_order_release);
+    return true;
+}
+
+static void *write_events(void *const data) {
+    (void) data;
+    const struct timespec interval = {
+        .tv_sec = 0,
+        .tv_nsec = DRAIN_INTERVAL_NS,
+    };
+    while (true) {
+        // Checked first, so events recorded before stopping are written
+        const bool stopping =
+            atomic_load_explicit(&recorder.stopping, memory_order_acquire);
+        if (drain()) {
+            continue;
+        }
+        if (stopping) {
+            return NULL;
+        }
+        nanosleep(&interval, NULL);
+    }
+}
+
+static void stop_recording(void) {
+    atomic_store_explicit(&recorder.stopping, true, memory_order_release);
+    pthread_join(recorder.thread, NULL);
+    if (recorder.dropped > 0) {
+        fprintf(
+            stderr,
+            "Session is missing %llu events, which came too fast to write.\n",
+            (unsigned long long) recorder.dropped
+        );
+    }
+    if (close(recorder.fd) != 0 && !recorder.failed) {
+        perror("Failed to write session");
+    }
+}
+
+void session_record(const char *const filename) {
+    recorder.fd =
+        open(filename, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (recorder.fd < 0) {
+        perror("Failed to open session file");
+        exit(1);
+    }
+    if (!write_all(recorder.fd, SESSION_MAGIC, strlen(SESSION_MAGIC))) {
+        perror("Failed to write session");
+        exit(1);
+    }
+    recorder.ring = malloc(RING_SIZE);
+    if (recorder.ring == NULL) {
+        perror("Failed to allocate session");
+        exit(1);
+    }
+    atomic_init(&recorder.head, 0);
+    atomic_init(&recorder.tail, 0);
+    atomic_init(&recorder.stopping, false);
+    recorder.failed = false;
+    recorder.last = session_now();
+    recorder.dropped = 0;
+    if (pthread_create(&recorder.thread, NULL, write_events, NULL) != 0) {
+        fprintf(stderr, "Failed to start recording session.\n");
+        exit(1);
+    }
+    recording = true;
+    atexit(stop_recording);
+}
+
+static void record_event(
+    const bool resize,
+    const uint64_t first,
+    const uint64_t second
+) {
+    if (!recording) {
+        return;
+    }
+    const uint64_t time = session_now();
+    char event[EVENT_MAX];
+    uint32_t len = put_varint(event, (time - recorder.last) << 1 | resize);
+    len += put_varint(&event[len], first);
+    if (resize) {
+        len += put_varint(&event[len], second);
+    }
+
+    const uint32_t head =
+        atomic_load_explicit(&recorder.head, memory_order_relaxed);
+    const uint32_t tail =
+        atomic_load_explicit(&recorder.tail, memory_order_acquire);
+    // Dropped rather than waiting for the writer
+    // The next event is timed from the last one kept, so times stay right
+    if (RING_SIZE - (head - tail) < len) {
+        ++recorder.dropped;
+        return;
+    }
+    for (uint32_t i = 0; i < len; ++i) {
+        recorder.ring[(head + i) & (RING_SIZE - 1)] = event[i];
+    }
+    atomic_store_explicit(&recorder.head, head + len, memory_order_release);
+    recorder.last = time;
+}
+
+void session_record_key(const int key) {
+    record_event(false, (uint32_t) key, 0);
+}
+
+void session_record_size(const int rows, const int cols) {
+    record_event(true, (uint32_t) rows, (uint32_t) cols);
+}
+
+void replay_open(Replay *const replay, const char *const filename) {
+    const int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        perror("Failed to open session file");
+        exit(1);
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        perror("Failed to read session file");
+        exit(1);
+    }
+    const size_t magic_len = strlen(SESSION_MAGIC);
+    if ((size_t) info.st_size < magic_len) {
+        fprintf(stderr, "Not a session file.\n");
+        exit(1);
+    }
+    const char *const bytes =
+        mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (bytes == MAP_FAILED) {
+        perror("Failed to map session file");
+        exit(1);
+    }
+    close(fd);
+    if (memcmp(bytes, SESSION_MAGIC, magic_len)) {
+        fprintf(stderr, "Not a session file.\n");
+        exit(1);
+    }
+    replay->bytes = bytes;
+    replay->len = info.st_size;
+    replay->position = magic_len;
+    replay->time = 0;
+}
+
+static bool get_varint(Replay *const replay, uint64_t *const value) {
+    *value = 0;
+    for (uint32_t shift = 0; shift < 64; shift += 7) {
+        if (replay->position >= replay->len) {
+            return false;
+        }
+        const uint8_t byte = replay->bytes[replay->position++];
+        *value |= (uint64_t) (byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool replay_next(Replay *const replay, SessionEvent *const event) {
+    uint64_t header;
+    uint64_t first;
+    uint64_t second = 0;
+    // A session cut off part way through an event, as when the program was
+    // killed, ends before it
+    if (!get_varint(replay, &header) || !get_varint(replay, &first)
+        || ((header & 1) && !get_varint(replay, &second)) || first > INT_MAX
+        || second > INT_MAX)
+    {
+        replay->position = replay->len;
+        return false;
+    }
+    replay->time += header >> 1;
+    event->time = replay->time;
+    event->resize = header & 1;
+    event->key = event->resize ? 0 : (int) first;
+    event->rows = event->resize ? first : 0;
+    event->cols = second;
+    return true;
+}
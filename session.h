@@ -0,0 +1,53 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Sessions are files of keys read from the terminal and the sizes it had,
+// each event being varints of:
+// - ns since the last event, shifted left once, with the low bit set for a
+//   size
+// - the key, or rows and columns
+// After a header of `SESSION_MAGIC`
+#define SESSION_MAGIC ("vimline-session-1\n")
+
+typedef struct SessionEvent {
+    uint64_t time;  // ns since the session started
+    bool resize;
+    int key;
+    uint32_t rows;
+    uint32_t cols;
+} SessionEvent;
+
+typedef struct Replay {
+    const char *bytes;
+    size_t len;
+    size_t position;
+    uint64_t time;  // Of the last event read
+} Replay;
+
+// Monotonic ns
+uint64_t session_now(void);
+
+// Record to `filename` until the program exits
+// Events are encoded into a ring, which a background thread writes out, so
+// recording a key never waits on the file
+// Must be called after signals are blocked, so the thread never takes them
+void session_record(const char *const filename);
+
+// Log key read from the terminal, if recording
+void session_record_key(const int key);
+
+// Log terminal size, if recording
+void session_record_size(const int rows, const int cols);
+
+// Map session file, exiting if it is not one
+void replay_open(Replay *const replay, const char *const filename);
+
+// Read next event
+// Returns false at the end of the session
+bool replay_next(Replay *const replay, SessionEvent *const event);
+
+#endif
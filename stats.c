@@ -0,0 +1,249 @@
+#include "stats.h"
+
+#include "editor.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Values below `SUB_BUCKETS` have a bucket each, and each power of 2 above
+// is split into `SUB_BUCKETS` buckets, so values are within about 3%
+#define SUB_BITS (5)
+#define SUB_BUCKETS (1 << SUB_BITS)
+#define BUCKET_COUNT ((64 - SUB_BITS + 1) * SUB_BUCKETS)
+// Keys counted, above which keys are not counted by code
+#define KEY_CODES (K_PASTE_END + 1)
+
+static const char *const PHASE_NAMES[PHASE_COUNT] = {
+    [PHASE_READ] = "read",
+    [PHASE_DISPATCH] = "dispatch",
+    [PHASE_RENDER] = "render",
+    [PHASE_FLUSH] = "flush",
+    [PHASE_LATENCY] = "latency",
+};
+
+typedef struct Histogram {
+    uint64_t count;
+    uint64_t sum;
+    uint64_t min;
+    uint64_t max;
+    uint64_t buckets[BUCKET_COUNT];
+} Histogram;
+
+typedef struct KeyCount {
+    uint64_t count;
+    uint64_t ns;
+} KeyCount;
+
+bool stats_enabled = false;
+
+// Zero until used, so costs no memory unless enabled
+static Histogram histograms[PHASE_COUNT];
+static Histogram frame_bytes;
+static KeyCount keys[MODE_COUNT][KEY_CODES];
+static const char *stats_filename = NULL;
+static bool live = false;
+
+static uint32_t bucket_index(const uint64_t value) {
+    if (value < SUB_BUCKETS) {
+        return value;
+    }
+    const uint32_t exponent = 63 - __builtin_clzll(value);
+    const uint32_t shift = exponent - SUB_BITS;
+    return (shift + 1) * SUB_BUCKETS + ((value >> shift) & (SUB_BUCKETS - 1));
+}
+
+// Highest value counted in bucket
+static uint64_t bucket_value(const uint32_t index) {
+    if (index < SUB_BUCKETS) {
+        return index;
+    }
+    const uint32_t shift = index / SUB_BUCKETS - 1;
+    const uint64_t sub = SUB_BUCKETS + index % SUB_BUCKETS;
+    return ((sub + 1) << shift) - 1;
+}
+
+static void record(Histogram *const histogram, const uint64_t ns) {
+    if (histogram->count == 0 || ns < histogram->min) {
+        histogram->min = ns;
+    }
+    if (ns > histogram->max) {
+        histogram->max = ns;
+    }
+    ++histogram->count;
+    histogram->sum += ns;
+    ++histogram->buckets[bucket_index(ns)];
+}
+
+void stats_record(const Phase phase, const uint64_t ns) {
+    record(&histograms[phase], ns);
+}
+
+void stats_record_frame(const uint64_t bytes) {
+    record(&frame_bytes, bytes);
+}
+
+void stats_record_key(const int mode, const int key, const uint64_t ns) {
+    stats_record(PHASE_DISPATCH, ns);
+    if (mode < 0 || mode >= MODE_COUNT || key < 0 || key >= KEY_CODES) {
+        return;
+    }
+    ++keys[mode][key].count;
+    keys[mode][key].ns += ns;
+}
+
+// Value at or below which `fraction` of values are
+static uint64_t percentile(const Histogram *const histogram, double fraction) {
+    if (histogram->count == 0) {
+        return 0;
+    }
+    uint64_t rank = fraction * histogram->count;
+    if (rank < 1) {
+        rank = 1;
+    }
+    uint64_t seen = 0;
+    for (uint32_t i = 0; i < BUCKET_COUNT; ++i) {
+        seen += histogram->buckets[i];
+        if (seen >= rank) {
+            const uint64_t value = bucket_value(i);
+            return value < histogram->max ? value : histogram->max;
+        }
+    }
+    return histogram->max;
+}
+
+// Values are named with their unit, such as `min_ns`
+static void write_histogram(
+    FILE *const file,
+    const Histogram *const histogram,
+    const char *const unit
+) {
+    fprintf(
+        file,
+        "{\"count\": %llu, \"min_%s\": %llu, \"max_%s\": %llu, "
+        "\"mean_%s\": %llu, \"p50_%s\": %llu, \"p90_%s\": %llu, "
+        "\"p99_%s\": %llu, \"p999_%s\": %llu, \"buckets\": [",
+        (unsigned long long) histogram->count,
+        unit,
+        (unsigned long long) histogram->min,
+        unit,
+        (unsigned long long) histogram->max,
+        unit,
+        (unsigned long long) (histogram->count > 0
+                                  ? histogram->sum / histogram->count
+                                  : 0),
+        unit,
+        (unsigned long long) percentile(histogram, 0.5),
+        unit,
+        (unsigned long long) percentile(histogram, 0.9),
+        unit,
+        (unsigned long long) percentile(histogram, 0.99),
+        unit,
+        (unsigned long long) percentile(histogram, 0.999)
+    );
+    // Only buckets with values, as highest value and count
+    bool first = true;
+    for (uint32_t i = 0; i < BUCKET_COUNT; ++i) {
+        if (histogram->buckets[i] > 0) {
+            fprintf(
+                file,
+                "%s[%llu, %llu]",
+                first ? "" : ", ",
+                (unsigned long long) bucket_value(i),
+                (unsigned long long) histogram->buckets[i]
+            );
+            first = false;
+        }
+    }
+    fprintf(file, "]}");
+}
+
+static void write_stats(void) {
+    FILE *const file = fopen(stats_filename, "w");
+    if (file == NULL) {
+        perror("Failed to open stats file");
+        return;
+    }
+
+    fprintf(file, "{\n  \"phases\": {\n");
+    for (int phase = 0; phase < PHASE_COUNT; ++phase) {
+        fprintf(file, "    \"%s\": ", PHASE_NAMES[phase]);
+        write_histogram(file, &histograms[phase], "ns");
+        fprintf(file, phase + 1 < PHASE_COUNT ? ",\n" : "\n");
+    }
+    // Not counted by every backend
+    fprintf(file, "  },\n  \"frame_bytes\": ");
+    write_histogram(file, &frame_bytes, "bytes");
+
+    fprintf(file, ",\n  \"modes\": {\n");
+    for (int mode = 0; mode < MODE_COUNT; ++mode) {
+        uint64_t count = 0;
+        uint64_t ns = 0;
+        for (int key = 0; key < KEY_CODES; ++key) {
+            count += keys[mode][key].count;
+            ns += keys[mode][key].ns;
+        }
+        fprintf(
+            file,
+            "    \"%s\": {\"keys\": %llu, \"dispatch_ns\": %llu}%s\n",
+            mode_name(mode),
+            (unsigned long long) count,
+            (unsigned long long) ns,
+            mode + 1 < MODE_COUNT ? "," : ""
+        );
+    }
+
+    // Each key pressed in each mode
+    fprintf(file, "  },\n  \"commands\": [");
+    bool first = true;
+    for (int mode = 0; mode < MODE_COUNT; ++mode) {
+        for (int key = 0; key < KEY_CODES; ++key) {
+            if (keys[mode][key].count == 0) {
+                continue;
+            }
+            fprintf(
+                file,
+                "%s\n    {\"mode\": \"%s\", \"key\": %d, \"count\": %llu, "
+                "\"dispatch_ns\": %llu}",
+                first ? "" : ",",
+                mode_name(mode),
+                key,
+                (unsigned long long) keys[mode][key].count,
+                (unsigned long long) keys[mode][key].ns
+            );
+            first = false;
+        }
+    }
+    fprintf(file, "\n  ]\n}\n");
+
+    if (fclose(file) != 0) {
+        perror("Failed to write stats file");
+    }
+}
+
+void stats_init(void) {
+    const char *const filename = getenv("VIMLINE_STATS");
+    const char *const live_value = getenv("VIMLINE_STATS_LIVE");
+    stats_filename = filename != NULL && filename[0] != '\0' ? filename : NULL;
+    live = live_value != NULL && live_value[0] != '\0';
+    stats_enabled = stats_filename != NULL || live;
+    if (stats_filename != NULL) {
+        atexit(write_stats);
+    }
+}
+
+void stats_summary(char *const text, const size_t size) {
+    if (!live) {
+        return;
+    }
+    const size_t len = strlen(text);
+    const Histogram *const latency = &histograms[PHASE_LATENCY];
+    snprintf(
+        &text[len],
+        size - len,
+        "  p50 %.1fus p99 %.1fus max %.1fus",
+        percentile(latency, 0.5) / 1000.0,
+        percentile(latency, 0.99) / 1000.0,
+        latency->max / 1000.0
+    );
+}
@@ -0,0 +1,58 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+// Timed parts of handling keys and drawing
+typedef enum Phase {
+    PHASE_READ,      // Reading a key already waiting
+    PHASE_DISPATCH,  // Handling a key
+    PHASE_RENDER,    // Finding and drawing changes
+    PHASE_FLUSH,     // Sending frame to terminal
+    PHASE_LATENCY,   // From a key arriving to its frame being sent
+    PHASE_COUNT,
+} Phase;
+
+// Set once at startup, and only then are clocks read
+extern bool stats_enabled;
+
+// Collect timings if `VIMLINE_STATS` or `VIMLINE_STATS_LIVE` is set
+// They are written as JSON to the file `VIMLINE_STATS` names on exit
+void stats_init(void);
+
+void stats_record(const Phase phase, const uint64_t ns);
+
+// Count bytes sent to terminal for a frame
+void stats_record_frame(const uint64_t bytes);
+
+// Count key, and the time taken to handle it, in the mode it was pressed
+void stats_record_key(const int mode, const int key, const uint64_t ns);
+
+// Append latency summary to details line, if shown live
+void stats_summary(char *const text, const size_t size);
+
+// Current time in ns, or 0 if not collecting timings
+static inline uint64_t stats_start(void) {
+    if (!stats_enabled) {
+        return 0;
+    }
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (uint64_t) time.tv_sec * 1000000000 + time.tv_nsec;
+}
+
+// Nanoseconds since `start`
+static inline uint64_t stats_since(const uint64_t start) {
+    return stats_start() - start;
+}
+
+static inline void stats_end(const Phase phase, const uint64_t start) {
+    if (stats_enabled) {
+        stats_record(phase, stats_since(start));
+    }
+}
+
+#endif
@@ -0,0 +1,43 @@
+#define _XOPEN_SOURCE 700
+
+#include "utf8.h"
+
+#include <wchar.h>
+
+uint32_t utf8_length(const char lead) {
+    const unsigned char byte = lead;
+    if (byte >= 0xc2 && byte <= 0xdf) {
+        return 2;
+    }
+    if (byte >= 0xe0 && byte <= 0xef) {
+        return 3;
+    }
+    if (byte >= 0xf0 && byte <= 0xf4) {
+        return 4;
+    }
+    return 1;
+}
+
+uint32_t utf8_decode(
+    const char *const text,
+    const size_t len,
+    uint32_t *const width
+) {
+    *width = 1;
+    const uint32_t length = utf8_length(text[0]);
+    if (length == 1 || length > len) {
+        return 1;
+    }
+    uint32_t codepoint = (unsigned char) text[0] & (0x7f >> length);
+    for (uint32_t i = 1; i < length; ++i) {
+        if (!utf8_continuation(text[i])) {
+            return 1;
+        }
+        codepoint = (codepoint << 6) | ((unsigned char) text[i] & 0x3f);
+    }
+    // Zero-width and unknown characters still take a cell
+    if (wcwidth(codepoint) == 2) {
+        *width = 2;
+    }
+    return length;
+}
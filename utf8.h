@@ -0,0 +1,27 @@
+#ifndef UTF8_H
+#define UTF8_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Max bytes in a character
+#define UTF8_MAX (4)
+
+static inline bool utf8_continuation(const char byte) {
+    return ((unsigned char) byte & 0xc0) == 0x80;
+}
+
+// Length of character starting with `lead`, or 1 if not a valid lead byte
+uint32_t utf8_length(const char lead);
+
+// Length of character at start of `text`, and set `width` to its display
+// width (1 or 2)
+// Invalid or truncated sequences are single bytes of width 1
+uint32_t utf8_decode(
+    const char *const text,
+    const size_t len,
+    uint32_t *const width
+);
+
+#endif
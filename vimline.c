@@ -0,0 +1,281 @@
+#include "vimline.h"
+
+#include "alloc.h"
+#include "editor.h"
+#include "keys.h"
+
+#include <errno.h>
+#include <unistd.h>
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DEFAULT_WIDTH (70)
+// Longer than any key sequence, kept until the rest of it is fed
+#define PARTIAL_MAX (8)
+#define READ_SIZE (4096)
+
+_Static_assert(VIMLINE_KEY_ESCAPE == K_ESCAPE, "key codes differ");
+_Static_assert(VIMLINE_KEY_RETURN == K_RETURN, "key codes differ");
+_Static_assert(VIMLINE_KEY_TAB == K_TAB, "key codes differ");
+_Static_assert(VIMLINE_KEY_BACKSPACE == K_BACKSPACE, "key codes differ");
+_Static_assert(VIMLINE_KEY_DOWN == K_DOWN, "key codes differ");
+_Static_assert(VIMLINE_KEY_UP == K_UP, "key codes differ");
+_Static_assert(VIMLINE_KEY_LEFT == K_LEFT, "key codes differ");
+_Static_assert(VIMLINE_KEY_RIGHT == K_RIGHT, "key codes differ");
+
+struct Vimline {
+    State state;
+    const Allocator *allocator;
+    char *value;  // Original line, which the buffer uses in place
+    VimlineStatus status;
+    // Start of a key sequence at the end of the last bytes fed
+    char partial[PARTIAL_MAX];
+    uint32_t partial_len;
+    // Text of a bracketed paste not yet ended
+    bool pasting;
+    char *paste;
+    uint32_t paste_len;
+    uint32_t paste_capacity;
+};
+
+Vimline *vimline_new(const VimlineOptions *const options) {
+    const Allocator *const previous = use_allocator(options->allocator);
+    Vimline *const editor = mem_realloc(NULL, sizeof(Vimline));
+    char *const value = mem_realloc(NULL, options->value_len + 1);
+    if (editor == NULL || value == NULL) {
+        mem_free(editor);
+        mem_free(value);
+        use_allocator(previous);
+        return NULL;
+    }
+    editor->allocator = options->allocator;
+    editor->value = value;
+    if (options->value_len > 0) {
+        memcpy(editor->value, options->value, options->value_len);
+    }
+    const bool allocated = editor_init(
+        &editor->state,
+        editor->value,
+        options->value_len,
+        options->width > 0 ? options->width : DEFAULT_WIDTH
+    );
+    editor->status = VIMLINE_EDITING;
+    editor->partial_len = 0;
+    editor->pasting = false;
+    editor->paste = NULL;
+    editor->paste_len = 0;
+    editor->paste_capacity = 0;
+    use_allocator(previous);
+    if (!allocated) {
+        vimline_free(editor);
+        return NULL;
+    }
+    return editor;
+}
+
+void vimline_free(Vimline *const editor) {
+    if (editor == NULL) {
+        return;
+    }
+    const Allocator *const previous = use_allocator(editor->allocator);
+    editor_free(&editor->state);
+    mem_free(editor->paste);
+    mem_free(editor->value);
+    mem_free(editor);
+    use_allocator(previous);
+}
+
+// Handle key with the editor's allocator already in use
+static void feed_key(Vimline *const editor, const int key) {
+    if (editor->status != VIMLINE_EDITING) {
+        return;
+    }
+    switch (handle_key(&editor->state, key)) {
+        case ACTION_SUBMIT:
+            editor->status = VIMLINE_SUBMITTED;
+            break;
+        case ACTION_QUIT:
+            editor->status = VIMLINE_QUIT;
+            break;
+        default:
+            break;
+    }
+}
+
+VimlineStatus vimline_feed_key(Vimline *const editor, const int key) {
+    const Allocator *const previous = use_allocator(editor->allocator);
+    feed_key(editor, key);
+    use_allocator(previous);
+    return editor->status;
+}
+
+static void *allocate(void *const ptr, const size_t size) {
+    void *const result = mem_realloc(ptr, size);
+    if (result == NULL) {
+        perror("Failed to allocate paste");
+        exit(1);
+    }
+    return result;
+}
+
+static void add_to_paste(Vimline *const editor, const char byte) {
+    if (editor->paste_len >= editor->paste_capacity) {
+        editor->paste_capacity =
+            editor->paste_capacity > 0 ? editor->paste_capacity * 2 : 64;
+        editor->paste = allocate(editor->paste, editor->paste_capacity);
+    }
+    editor->paste[editor->paste_len++] = byte;
+}
+
+// Handle whole keys of `bytes`, returning how many bytes were used
+static size_t feed_keys(
+    Vimline *const editor,
+    const char *const bytes,
+    const size_t len
+) {
+    size_t i = 0;
+    while (i < len && !partial_key(&bytes[i], len - i)) {
+        int key;
+        i += decode_key(&bytes[i], len - i, &key);
+        if (key == K_PASTE_START) {
+            editor->pasting = true;
+            editor->paste_len = 0;
+        } else if (key == K_PASTE_END) {
+            editor->pasting = false;
+            if (editor->status == VIMLINE_EDITING) {
+                paste_input(&editor->state, editor->paste, editor->paste_len);
+            }
+        } else if (editor->pasting) {
+            if (key <= 0xff && (key >= 0x80 || isprint(key))) {
+                add_to_paste(editor, key);
+            }
+        } else {
+            feed_key(editor, key);
+        }
+    }
+    return i;
+}
+
+VimlineStatus vimline_feed(
+    Vimline *const editor,
+    const char *const bytes,
+    const size_t len
+) {
+    const Allocator *const previous = use_allocator(editor->allocator);
+    size_t used = 0;
+    // Complete key sequence left from last time, a byte at a time
+    while (editor->partial_len > 0 && used < len) {
+        editor->partial[editor->partial_len++] = bytes[used++];
+        const uint32_t partial_len = editor->partial_len;
+        if (partial_key(editor->partial, partial_len)) {
+            continue;
+        }
+        const size_t fed = feed_keys(editor, editor->partial, partial_len);
+        editor->partial_len = partial_len - fed;
+        memmove(editor->partial, &editor->partial[fed], editor->partial_len);
+    }
+    if (editor->partial_len == 0) {
+        used += feed_keys(editor, &bytes[used], len - used);
+        editor->partial_len = len - used;
+        memcpy(editor->partial, &bytes[used], editor->partial_len);
+    }
+    use_allocator(previous);
+    return editor->status;
+}
+
+size_t vimline_text(
+    const Vimline *const editor,
+    char *const out,
+    const size_t size
+) {
+    const Buffer *const input = &editor->state.snap.input;
+    const uint32_t len = buffer_len(input);
+    buffer_copy(input, 0, size < len ? size : len, out);
+    return len;
+}
+
+uint32_t vimline_cursor(const Vimline *const editor) {
+    return editor->state.snap.cursor;
+}
+
+uint32_t vimline_offset(const Vimline *const editor) {
+    return editor->state.snap.offset;
+}
+
+const char *vimline_mode(const Vimline *const editor) {
+    return mode_name(editor->state.mode);
+}
+
+VimlineStatus vimline_edit(
+    const VimlineOptions *const options,
+    VimlineText *const out
+) {
+    Vimline *const editor = vimline_new(options);
+    if (editor == NULL) {
+        errno = ENOMEM;
+        return VIMLINE_ERROR;
+    }
+    char bytes[READ_SIZE];
+    VimlineStatus status = VIMLINE_EDITING;
+    while (status == VIMLINE_EDITING) {
+        if (options->draw != NULL) {
+            options->draw(options->draw_context, editor);
+        }
+        const ssize_t len = read(options->input_fd, bytes, sizeof(bytes));
+        if (len < 0 && errno == EINTR) {
+            continue;
+        }
+        if (len < 0) {
+            const int error = errno;
+            vimline_free(editor);
+            errno = error;
+            return VIMLINE_ERROR;
+        }
+        if (len == 0) {
+            // Start of a sequence, with no more to come, is keys by itself
+            const uint32_t partial_len = editor->partial_len;
+            editor->partial_len = 0;
+            const Allocator *const previous =
+                use_allocator(editor->allocator);
+            for (uint32_t i = 0; i < partial_len; ++i) {
+                feed_key(editor, (unsigned char) editor->partial[i]);
+            }
+            use_allocator(previous);
+            status = editor->status != VIMLINE_EDITING
+                ? editor->status
+                : VIMLINE_SUBMITTED;
+            break;
+        }
+        status = vimline_feed(editor, bytes, len);
+    }
+
+    if (status == VIMLINE_SUBMITTED) {
+        const Allocator *const previous = use_allocator(options->allocator);
+        const uint32_t len = buffer_len(&editor->state.snap.input);
+        out->bytes = mem_realloc(NULL, len + 1);
+        use_allocator(previous);
+        if (out->bytes == NULL) {
+            vimline_free(editor);
+            errno = ENOMEM;
+            return VIMLINE_ERROR;
+        }
+        out->len = vimline_text(editor, out->bytes, len);
+        out->bytes[len] = '\0';
+    }
+    vimline_free(editor);
+    return status;
+}
+
+void vimline_text_free(
+    const VimlineOptions *const options,
+    VimlineText *const text
+) {
+    const Allocator *const previous = use_allocator(options->allocator);
+    mem_free(text->bytes);
+    use_allocator(previous);
+    text->bytes = NULL;
+    text->len = 0;
+}
@@ -0,0 +1,120 @@
+#ifndef VIMLINE_H
+#define VIMLINE_H
+
+// Single-line editor with vim keybinds, for embedding in other programs
+// Each editor keeps all of its own state, so several may be used at once on
+// different threads, as long as each is used by one thread at a time
+// Drawing is left to the host, which reads the line, cursor and mode back
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define VIMLINE_API __attribute__((visibility("default")))
+
+// Keys other than bytes of text, for `vimline_feed_key`
+#define VIMLINE_KEY_ESCAPE (0x1b)
+#define VIMLINE_KEY_RETURN (0x0a)
+#define VIMLINE_KEY_TAB (0x09)
+#define VIMLINE_KEY_BACKSPACE (0x107)
+#define VIMLINE_KEY_DOWN (0x102)
+#define VIMLINE_KEY_UP (0x103)
+#define VIMLINE_KEY_LEFT (0x104)
+#define VIMLINE_KEY_RIGHT (0x105)
+#define VIMLINE_CTRL(key) ((key) - 0x60)
+
+// Used for all memory of an editor, and of the text it returns
+// `realloc` is called with NULL to allocate
+// Only a new editor can fail to allocate; running out of memory part way
+// through an edit ends the process, as it does for the program
+typedef struct VimlineAllocator {
+    void *(*realloc)(void *context, void *ptr, size_t size);
+    void (*free)(void *context, void *ptr);
+    void *context;
+} VimlineAllocator;
+
+typedef struct Vimline Vimline;
+
+typedef struct VimlineOptions {
+    // Initial line, which is copied
+    const char *value;
+    size_t value_len;
+    // Columns the host shows, which scrolling keeps the cursor within
+    // 0 for the width the program uses
+    uint32_t width;
+    // NULL for `realloc` and `free`
+    const VimlineAllocator *allocator;
+    // For `vimline_edit`, where raw terminal input is read from
+    int input_fd;
+    // For `vimline_edit`, called before each read if not NULL
+    void (*draw)(void *context, const Vimline *editor);
+    void *draw_context;
+} VimlineOptions;
+
+typedef enum VimlineStatus {
+    VIMLINE_EDITING,
+    VIMLINE_SUBMITTED,
+    VIMLINE_QUIT,
+    VIMLINE_ERROR,
+} VimlineStatus;
+
+// Line returned by `vimline_edit`, ending with a NUL not counted in `len`
+typedef struct VimlineText {
+    char *bytes;
+    size_t len;
+} VimlineText;
+
+// Returns NULL if out of memory
+VIMLINE_API Vimline *vimline_new(const VimlineOptions *options);
+
+VIMLINE_API void vimline_free(Vimline *editor);
+
+// Handle one key, either a byte of UTF-8 text or a `VIMLINE_KEY_*` code
+// Keys after submitting or quitting are ignored
+VIMLINE_API VimlineStatus vimline_feed_key(Vimline *editor, int key);
+
+// Handle raw terminal input, including escape sequences and bracketed pastes,
+// which may be split across calls
+// A lone Escape at the end of `bytes` is the Escape key, so terminal input
+// should be fed a whole read at a time
+VIMLINE_API VimlineStatus vimline_feed(
+    Vimline *editor,
+    const char *bytes,
+    size_t len
+);
+
+// Copy up to `size` bytes of the line into `out`, without a NUL
+// Returns length of the whole line
+VIMLINE_API size_t vimline_text(
+    const Vimline *editor,
+    char *out,
+    size_t size
+);
+
+// Byte index of the cursor
+VIMLINE_API uint32_t vimline_cursor(const Vimline *editor);
+
+// First display column shown
+VIMLINE_API uint32_t vimline_offset(const Vimline *editor);
+
+// Name of mode, as shown by the program
+VIMLINE_API const char *vimline_mode(const Vimline *editor);
+
+// Edit a line until it is submitted or quit, reading from
+// `options->input_fd`
+// Input ending submits the line, as for `vimline --keys`
+// On `VIMLINE_SUBMITTED`, `out` holds the line, allocated with the options'
+// allocator
+// Returns `VIMLINE_ERROR` with `errno` set if reading or allocating fails
+VIMLINE_API VimlineStatus vimline_edit(
+    const VimlineOptions *options,
+    VimlineText *out
+);
+
+// Free text returned by `vimline_edit` with the same options
+VIMLINE_API void vimline_text_free(
+    const VimlineOptions *options,
+    VimlineText *text
+);
+
+#endif